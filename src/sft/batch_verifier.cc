@@ -0,0 +1,96 @@
+#include "batch_verifier.h"
+
+#include "common/common/utility.h"
+
+#include "probes.h"
+
+#include <algorithm>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+BatchVerifier::BatchVerifier(ThreadLocal::SlotAllocator& tls, SftWorkerStats& stats)
+    : tls_(tls.allocateSlot()) {
+  tls_->set([&stats](Event::Dispatcher& dispatcher) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<ThreadLocalQueue>(dispatcher, stats);
+  });
+}
+
+bool BatchVerifier::configured(const Json::Object& config) {
+  return config.getBoolean("verify_batch", false);
+}
+
+bool BatchVerifier::add(Jwt& jwt, const std::shared_ptr<evp_pkey>& pkey,
+                        SignatureWaiter& waiter) {
+  Entry entry{&waiter, pkey, {}};
+  if (!jwt.PrepareBatchVerify(*pkey, entry.signature_)) {
+    return false;
+  }
+
+  ThreadLocalQueue& queue = tls_->getTyped<ThreadLocalQueue>();
+  if (queue.pending_.empty()) {
+    // Fires once the events already ready in this dispatcher iteration have been handled.
+    queue.timer_->enableTimer(std::chrono::milliseconds(0));
+  }
+  queue.pending_.push_back(std::move(entry));
+  return true;
+}
+
+void BatchVerifier::remove(SignatureWaiter& waiter) {
+  ThreadLocalQueue& queue = tls_->getTyped<ThreadLocalQueue>();
+  for (std::vector<Entry>* entries : {&queue.pending_, queue.flushing_}) {
+    if (!entries) {
+      continue;
+    }
+    for (Entry& entry : *entries) {
+      if (entry.waiter_ == &waiter) {
+        entry.waiter_ = nullptr;
+      }
+    }
+  }
+}
+
+BatchVerifier::ThreadLocalQueue::ThreadLocalQueue(Event::Dispatcher& dispatcher,
+                                                  SftWorkerStats& stats)
+    : stats_(stats), timer_(dispatcher.createTimer([this]() -> void { flush(); })) {}
+
+void BatchVerifier::ThreadLocalQueue::flush() {
+  std::vector<Entry> batch;
+  batch.swap(pending_);
+  batch.erase(std::remove_if(batch.begin(), batch.end(),
+                             [](const Entry& entry) -> bool { return !entry.waiter_; }),
+              batch.end());
+  if (batch.empty()) {
+    return;
+  }
+  const MonotonicTime start = ProdMonotonicTimeSource::instance_.currentTime();
+
+  // Group by key so each table is walked while it is in cache. The sort is stable to keep each
+  // key's signatures in arrival order.
+  std::stable_sort(batch.begin(), batch.end(), [](const Entry& a, const Entry& b) -> bool {
+    return a.signature_.table_ < b.signature_.table_;
+  });
+  std::vector<P256Table::BatchSignature> signatures;
+  signatures.reserve(batch.size());
+  for (const Entry& entry : batch) {
+    signatures.push_back(entry.signature_);
+  }
+  P256Table::verifyBatch(signatures);
+  const std::chrono::nanoseconds elapsed =
+      ProdMonotonicTimeSource::instance_.currentTime() - start;
+  SFT_PROBE2(verify_batch_done, batch.size(), elapsed.count());
+  stats_.local().recordBatch(batch.size(), elapsed);
+
+  flushing_ = &batch;
+  for (size_t i = 0; i < batch.size(); i++) {
+    if (batch[i].waiter_) {
+      batch[i].waiter_->onSignatureVerified(signatures[i].valid_);
+    }
+  }
+  flushing_ = nullptr;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "envoy/common/pure.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/json/json_object.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "ec_table.h"
+#include "jwt.h"
+#include "sft_stats.h"
+
+#include <memory>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Told the outcome of a signature queued on a BatchVerifier.
+class SignatureWaiter {
+public:
+  virtual ~SignatureWaiter() {}
+
+  virtual void onSignatureVerified(bool valid) PURE;
+};
+
+// Micro-batched signature verification (`verify_batch`). Signatures that would be checked with a
+// P256Table are queued on the worker instead of verified inline, and each worker verifies its
+// queue once the current dispatcher iteration is done: grouped by key, with one modular inversion
+// for the whole batch (see P256Table::verifyBatch). Waiters are then called back, key by key.
+// Other keys and algorithms keep verifying inline, there is no shared work to gain.
+class BatchVerifier {
+public:
+  BatchVerifier(ThreadLocal::SlotAllocator& tls, SftWorkerStats& stats);
+
+  // True if the filter config asks for batching.
+  static bool configured(const Json::Object& config);
+
+  // Worker only. Queues the check of `jwt`'s signature with `pkey` and returns true, or returns
+  // false if it can't be batched. The waiter is called back from the dispatcher, never from here.
+  bool add(Jwt& jwt, const std::shared_ptr<evp_pkey>& pkey, SignatureWaiter& waiter);
+  // Worker only. Forgets `waiter`'s queued signature, if any.
+  void remove(SignatureWaiter& waiter);
+
+private:
+  struct Entry {
+    SignatureWaiter* waiter_; // nullptr once removed.
+    // Holds the key's table while the signature is queued, across JWKS refreshes.
+    std::shared_ptr<evp_pkey> pkey_;
+    P256Table::BatchSignature signature_;
+  };
+
+  struct ThreadLocalQueue : public ThreadLocal::ThreadLocalObject {
+    ThreadLocalQueue(Event::Dispatcher& dispatcher, SftWorkerStats& stats);
+    void flush();
+
+    SftWorkerStats& stats_;
+    Event::TimerPtr timer_;
+    std::vector<Entry> pending_;
+    // The batch being called back, waiters may remove themselves from it.
+    std::vector<Entry>* flushing_{};
+  };
+
+  ThreadLocal::SlotPtr tls_;
+};
+
+typedef std::unique_ptr<BatchVerifier> BatchVerifierPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
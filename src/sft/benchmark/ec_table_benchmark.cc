@@ -0,0 +1,207 @@
+// Measures ES256 signature verification with and without per-key precomputed tables (see
+// ec_table.h), and cross-checks the two.
+//
+//   sft_ec_table_benchmark [--keys N] [--tokens N] [--rounds N]
+//
+// Every key signs `tokens` tokens, a quarter of which are then corrupted (signature r, signature
+// s, or payload). Each token is verified through Jwt::VerifySignature with a plain key and with a
+// precomputed one, and both must agree with the expected outcome before anything is timed. Only
+// the valid tokens are timed. The precomputed path is then timed again through
+// P256Table::verifyBatch at a few batch sizes, as `verify_batch` uses it.
+
+#include "common/common/assert.h"
+#include "common/common/utility.h"
+
+#include "../jwt.h"
+#include "../test/test_key.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+namespace {
+
+struct BenchmarkKey {
+  TestKey key_;
+  std::shared_ptr<evp_pkey> plain_;
+  std::shared_ptr<evp_pkey> precomputed_;
+};
+
+struct BenchmarkToken {
+  size_t key_;
+  std::string jwt_;
+  bool valid_;
+};
+
+// Verifies every token `rounds` times against the keys picked by `pkey`, returns ns per verify.
+template <class KeyFn>
+double run(const std::vector<BenchmarkToken>& tokens, uint64_t rounds, KeyFn pkey) {
+  std::vector<Jwt> parsed;
+  for (const BenchmarkToken& token : tokens) {
+    parsed.emplace_back(token.jwt_);
+  }
+
+  uint64_t verified = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < tokens.size(); i++) {
+      verified += parsed[i].VerifySignature(pkey(tokens[i].key_));
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  RELEASE_ASSERT(verified == rounds * tokens.size());
+  return elapsed.count() / (rounds * tokens.size());
+}
+
+// Verifies every token `rounds` times in batches of `batch_size` in arrival order, as a worker
+// would see them, returns ns per signature. Hashing is included, as it is in run().
+double runBatched(const std::vector<BenchmarkToken>& tokens, uint64_t rounds, size_t batch_size,
+                  const std::vector<std::unique_ptr<BenchmarkKey>>& keys) {
+  std::vector<Jwt> parsed;
+  for (const BenchmarkToken& token : tokens) {
+    parsed.emplace_back(token.jwt_);
+  }
+
+  uint64_t verified = 0;
+  std::vector<P256Table::BatchSignature> batch;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t round = 0; round < rounds; round++) {
+    for (size_t first = 0; first < tokens.size(); first += batch_size) {
+      const size_t last = std::min(tokens.size(), first + batch_size);
+      batch.resize(last - first);
+      for (size_t i = first; i < last; i++) {
+        RELEASE_ASSERT(
+            parsed[i].PrepareBatchVerify(*keys[tokens[i].key_]->precomputed_, batch[i - first]));
+      }
+      std::stable_sort(batch.begin(), batch.end(),
+                       [](const P256Table::BatchSignature& a, const P256Table::BatchSignature& b) {
+                         return a.table_ < b.table_;
+                       });
+      P256Table::verifyBatch(batch);
+      for (const P256Table::BatchSignature& signature : batch) {
+        verified += signature.valid_;
+      }
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  RELEASE_ASSERT(verified == rounds * tokens.size());
+  return elapsed.count() / (rounds * tokens.size());
+}
+
+int benchmark(int argc, char** argv) {
+  uint64_t key_count = 4;
+  uint64_t token_count = 250;
+  uint64_t rounds = 4;
+  bool usage = argc % 2 == 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--keys") {
+      usage |= !StringUtil::atoul(argv[i + 1], key_count) || key_count == 0;
+    } else if (flag == "--tokens") {
+      usage |= !StringUtil::atoul(argv[i + 1], token_count) || token_count == 0;
+    } else if (flag == "--rounds") {
+      usage |= !StringUtil::atoul(argv[i + 1], rounds) || rounds == 0;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    std::cerr << "usage: " << argv[0] << " [--keys N] [--tokens N] [--rounds N]" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<BenchmarkKey>> keys;
+  double build_ms = 0;
+  for (uint64_t k = 0; k < key_count; k++) {
+    keys.emplace_back(new BenchmarkKey());
+    BenchmarkKey& key = *keys.back();
+    key.plain_ = BuildECPublicKey(key.key_.compact());
+    const auto start = std::chrono::steady_clock::now();
+    key.precomputed_ = BuildECPublicKey(key.key_.compact(), true);
+    build_ms +=
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    RELEASE_ASSERT(key.plain_ && key.precomputed_ && key.precomputed_->table_);
+  }
+
+  std::mt19937_64 random(42);
+  const std::string header = Base64UrlEncode(R"({"alg":"ES256","typ":"JWT"})");
+  std::vector<BenchmarkToken> tokens;
+  for (uint64_t k = 0; k < key_count; k++) {
+    for (uint64_t t = 0; t < token_count; t++) {
+      const std::string payload =
+          Base64UrlEncode(fmt::format(R"({{"sub":"user-{}","jti":"{}"}})", t, random()));
+      std::string signature = keys[k]->key_.sign(header + "." + payload);
+      std::string signed_payload = payload;
+      const bool valid = t % 4 != 3;
+      if (!valid) {
+        switch ((t / 4) % 3) {
+        case 0:
+          signature[random() % 32] ^= 1 << (random() % 8);
+          break;
+        case 1:
+          signature[32 + random() % 32] ^= 1 << (random() % 8);
+          break;
+        default:
+          signed_payload = Base64UrlEncode(fmt::format(R"({{"sub":"user-{}"}})", t + 1));
+          break;
+        }
+      }
+      tokens.push_back(
+          {k, header + "." + signed_payload + "." + Base64UrlEncode(signature), valid});
+    }
+  }
+
+  for (const BenchmarkToken& token : tokens) {
+    Jwt jwt(token.jwt_);
+    const bool plain = jwt.VerifySignature(keys[token.key_]->plain_);
+    const bool precomputed = jwt.VerifySignature(keys[token.key_]->precomputed_);
+    if (plain != token.valid_ || precomputed != token.valid_) {
+      std::cerr << "mismatch for " << token.jwt_ << ": expected " << token.valid_ << ", EVP "
+                << plain << ", table " << precomputed << std::endl;
+      return 1;
+    }
+  }
+  std::cout << fmt::format("{} tokens cross-checked, {} keys, table build {:.2f} ms/key, {} KB/key",
+                           tokens.size(), key_count, build_ms / key_count,
+                           keys[0]->precomputed_->table_->bytes() / 1024)
+            << std::endl;
+
+  tokens.erase(std::remove_if(tokens.begin(), tokens.end(),
+                              [](const BenchmarkToken& token) { return !token.valid_; }),
+               tokens.end());
+  const double plain_ns = run(tokens, rounds, [&keys](size_t k) { return keys[k]->plain_; });
+  const double precomputed_ns =
+      run(tokens, rounds, [&keys](size_t k) { return keys[k]->precomputed_; });
+  std::cout << fmt::format("{:>12} {:>12.0f} ns/verify", "EVP", plain_ns) << std::endl;
+  std::cout << fmt::format("{:>12} {:>12.0f} ns/verify ({:.2f}x)", "precomputed", precomputed_ns,
+                           precomputed_ns > 0 ? plain_ns / precomputed_ns : 0)
+            << std::endl;
+
+  // Interleave the keys, a worker's batch mixes whatever tokens arrived together.
+  std::vector<BenchmarkToken> interleaved;
+  for (uint64_t t = 0; t < tokens.size(); t++) {
+    interleaved.push_back(tokens[(t % key_count) * (tokens.size() / key_count) + t / key_count]);
+  }
+  for (size_t batch_size : {1, 4, 16, 64}) {
+    const double batched_ns = runBatched(interleaved, rounds, batch_size, keys);
+    std::cout << fmt::format("{:>12} {:>12.0f} ns/verify ({:.2f}x)",
+                             fmt::format("batch {}", batch_size), batched_ns,
+                             batched_ns > 0 ? plain_ns / batched_ns : 0)
+              << std::endl;
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
+
+int main(int argc, char** argv) { return Envoy::Http::Sft::benchmark(argc, argv); }
@@ -0,0 +1,132 @@
+// Measures the cost of setting up a verification with a shared key as the number of workers grows:
+// the evp_pkeys of the published JWKS, as every worker used before, against per-worker KeyReplicas
+// (see key_cache.h).
+//
+//   sft_key_replica_benchmark [--requests N] [--keys N] [--max-workers N]
+//
+// Each simulated request looks its key up by kid and initializes an EVP verify context with it,
+// which is where the shared key's reference counts are touched, then releases both. The signature
+// math itself is left out: it only reads the key and costs the same either way.
+
+#include "common/common/assert.h"
+#include "common/common/utility.h"
+
+#include "../jwks.h"
+#include "../key_cache.h"
+#include "../test/test_key.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+namespace {
+
+// Adds a freshly generated P-256 key under `kid`.
+void addKey(JWKS& jwks, const std::string& kid) {
+  const TestKey key;
+  RELEASE_ASSERT(jwks.add(kid, "ES256", "P-256", Base64UrlEncode(key.compact().x()),
+                          Base64UrlEncode(key.compact().y())));
+}
+
+// What verifying does with the key before any signature math.
+void setUp(const std::shared_ptr<evp_pkey>& key) {
+  evp_md_ctx ctx;
+  RELEASE_ASSERT(EVP_DigestVerifyInit(ctx, nullptr, EVP_sha256(), nullptr, *key) == 1);
+}
+
+// Runs `requests` requests on each of `workers` threads and returns the wall time per request.
+template <class Request>
+double run(uint64_t workers, uint64_t requests, Request request) {
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (uint64_t w = 0; w < workers; w++) {
+    threads.emplace_back([&go, &request, w, requests]() -> void {
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (uint64_t i = 0; i < requests; i++) {
+        request(w, i);
+      }
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / requests;
+}
+
+int benchmark(int argc, char** argv) {
+  uint64_t requests = 200000;
+  uint64_t key_count = 4;
+  uint64_t max_workers = 64;
+  bool usage = argc % 2 == 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--requests") {
+      usage |= !StringUtil::atoul(argv[i + 1], requests) || requests == 0;
+    } else if (flag == "--keys") {
+      usage |= !StringUtil::atoul(argv[i + 1], key_count) || key_count == 0;
+    } else if (flag == "--max-workers") {
+      usage |= !StringUtil::atoul(argv[i + 1], max_workers) || max_workers == 0;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    std::cerr << "usage: " << argv[0] << " [--requests N] [--keys N] [--max-workers N]"
+              << std::endl;
+    return 1;
+  }
+
+  JWKSSharedPtr jwks = std::make_shared<JWKS>();
+  std::vector<std::string> kids;
+  for (uint64_t k = 0; k < key_count; k++) {
+    kids.push_back(fmt::format("key-{}", k));
+    addKey(*jwks, kids.back());
+  }
+
+  std::cout << fmt::format("{} keys, {} hardware threads", key_count,
+                           std::thread::hardware_concurrency())
+            << std::endl;
+  std::cout << fmt::format("{:>8} {:>18} {:>18} {:>10}", "workers", "shared ns/req",
+                           "replica ns/req", "speedup")
+            << std::endl;
+  for (uint64_t workers = 1; workers <= max_workers; workers *= 2) {
+    const double shared_ns = run(workers, requests, [&jwks, &kids](uint64_t, uint64_t i) {
+      setUp(jwks->get(kids[i % kids.size()]));
+    });
+
+    // Replicated up front, as workers do when the key set is published.
+    std::vector<std::unique_ptr<KeyReplicas>> replicas;
+    for (uint64_t w = 0; w < workers; w++) {
+      replicas.emplace_back(new KeyReplicas());
+      replicas.back()->update(jwks);
+    }
+    const double replica_ns =
+        run(workers, requests, [&jwks, &kids, &replicas](uint64_t w, uint64_t i) {
+          setUp(replicas[w]->get(*jwks, kids[i % kids.size()]));
+        });
+
+    std::cout << fmt::format("{:>8} {:>18.1f} {:>18.1f} {:>9.2f}x", workers, shared_ns,
+                             replica_ns, replica_ns > 0 ? shared_ns / replica_ns : 0)
+              << std::endl;
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
+
+int main(int argc, char** argv) { return Envoy::Http::Sft::benchmark(argc, argv); }
@@ -0,0 +1,246 @@
+// Measures how fast malformed tokens are rejected, by the exception based parse the filter used to
+// do (Json::Factory in a try/catch, then getString() on the header) and by Jwt's error code parse,
+// at 1 to `max-threads` threads. Tokens that parse but whose claims have the wrong type are
+// measured the same way: read with the throwing Json::Object getters, and from Jwt::Claims().
+//
+//   sft_malformed_token_benchmark [--tokens N] [--max-threads N]
+//
+// Each kind of malformed token is parsed `tokens` times on every thread. Before anything is timed,
+// the error code parse must reject every kind with the expected VerifyStatus. Unwinding can take
+// a lock shared by the whole process, so the gap may widen with the thread count.
+
+#include "common/common/assert.h"
+#include "common/common/base64.h"
+#include "common/common/utility.h"
+#include "common/json/json_loader.h"
+
+#include "../jwt.h"
+#include "../test/test_key.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+namespace {
+
+std::string base64UrlDecode(const std::string& input) {
+  std::string padded = input + std::string((4 - input.size() % 4) % 4, '=');
+  std::replace(padded.begin(), padded.end(), '-', '+');
+  std::replace(padded.begin(), padded.end(), '_', '/');
+  return Base64::decode(padded);
+}
+
+// The policy claims are checked against.
+const std::string Issuer = "iss1";
+const std::string Audience = "aud1";
+const std::vector<std::string> Audiences = {Audience};
+const int64_t Now = 1510989561;
+
+struct MalformedToken {
+  std::string name_;
+  std::string token_;
+  VerifyStatus expected_;
+};
+
+std::string fakeSignature() { return Base64UrlEncode(std::string(64, '\x5a')); }
+
+std::vector<MalformedToken> malformedTokens() {
+  const std::string payload = Base64UrlEncode(R"({"iss":"iss1","sub":"user","exp":4102444800})");
+  const std::string signature = fakeSignature();
+  const auto token = [&](const std::string& header) -> std::string {
+    return Base64UrlEncode(header) + "." + payload + "." + signature;
+  };
+
+  return {
+      {"segments", "not-a-jwt", VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+      {"base64", "%%%." + payload + "." + signature, VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+      {"header_json", token("not json"), VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+      {"header_array", token(R"(["kid","alg"])"), VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+      {"kid_type", token(R"({"kid":5,"alg":"ES256"})"), VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+      {"no_kid", token(R"({"alg":"ES256"})"), VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS},
+      {"no_alg", token(R"({"kid":"k"})"), VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE},
+      {"payload_json",
+       Base64UrlEncode(R"({"kid":"k","alg":"ES256"})") + "." + Base64UrlEncode("{\"sub\":") + "." +
+           signature,
+       VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+      {"payload_dup",
+       Base64UrlEncode(R"({"kid":"k","alg":"ES256"})") + "." +
+           Base64UrlEncode(R"({"iss":"iss1","aud":"aud1","iss":"iss2"})") + "." + signature,
+       VerifyStatus::JWT_VERIFY_FAIL_MALFORMED},
+  };
+}
+
+// Tokens that parse, with a claim of the wrong type.
+std::vector<MalformedToken> malformedClaims() {
+  const auto token = [](const std::string& payload) -> std::string {
+    return Base64UrlEncode(R"({"kid":"k","alg":"ES256"})") + "." + Base64UrlEncode(payload) + "." +
+           fakeSignature();
+  };
+
+  return {
+      {"iss_type", token(R"({"iss":5,"aud":"aud1"})"),
+       VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH},
+      {"aud_type", token(R"({"iss":"iss1","aud":{"aud1":true}})"),
+       VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH},
+      {"aud_element", token(R"({"iss":"iss1","aud":[5,"aud2"]})"),
+       VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH},
+      {"nbf_type", token(R"({"iss":"iss1","aud":"aud1","nbf":[0]})"),
+       VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE},
+      {"exp_type", token(R"({"iss":"iss1","aud":["aud1"],"exp":"4102444800"})"),
+       VerifyStatus::JWT_VERIFY_FAIL_EXPIRED},
+  };
+}
+
+// What the filter did before Jwt had error codes: parse both segments with Json::Factory, then
+// read kid and alg with getString(), which throws on a missing alg or a kid that isn't a string.
+bool throwingParse(const std::string& jwt) {
+  const std::vector<std::string> segments = StringUtil::split(jwt, '.');
+  if (segments.size() != 3) {
+    return false;
+  }
+  try {
+    Json::ObjectSharedPtr header = Json::Factory::loadFromString(base64UrlDecode(segments[0]));
+    Json::ObjectSharedPtr payload = Json::Factory::loadFromString(base64UrlDecode(segments[1]));
+    return !header->getString("kid", "").empty() && !header->getString("alg").empty() &&
+           !base64UrlDecode(segments[2]).empty();
+  } catch (...) {
+    return false;
+  }
+}
+
+bool errorCodeParse(const std::string& jwt) { return Jwt(jwt).IsParsed(); }
+
+// What the filter did before the claims were typed: build the payload with Json::Factory and read
+// the claims with the Json::Object getters, which throw on a claim of the wrong type.
+bool throwingClaims(const std::string& token) {
+  Jwt jwt(token);
+  if (!jwt.IsParsed()) {
+    return false;
+  }
+  try {
+    Json::ObjectSharedPtr payload = Json::Factory::loadFromString(jwt.PayloadJson());
+    std::vector<std::string> audience = payload->getStringArray("aud", true);
+    if (audience.empty()) {
+      audience.push_back(payload->getString("aud", ""));
+    }
+    return payload->getString("iss", "") == Issuer &&
+           std::find(audience.begin(), audience.end(), Audience) != audience.end() &&
+           Now >= payload->getInteger("nbf", 0) && Now <= payload->getInteger("exp", Now);
+  } catch (...) {
+    return false;
+  }
+}
+
+VerifyStatus claimsStatus(const JwtClaims& claims) {
+  return CheckClaims(claims, Now, &Issuer, &Audiences);
+}
+
+bool typedClaims(const std::string& token) {
+  Jwt jwt(token);
+  return jwt.IsParsed() && claimsStatus(jwt.Claims()) == VerifyStatus::JWT_VERIFY_SUCCESS;
+}
+
+// Parses `token` `count` times on each of `threads` threads and returns the wall time per parse.
+template <class Parse>
+double run(uint64_t threads, uint64_t count, const std::string& token, Parse parse) {
+  std::atomic<bool> go{false};
+  std::atomic<uint64_t> accepted{0};
+  std::vector<std::thread> workers;
+  for (uint64_t t = 0; t < threads; t++) {
+    workers.emplace_back([&go, &accepted, &token, &parse, count]() -> void {
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      uint64_t local = 0;
+      for (uint64_t i = 0; i < count; i++) {
+        local += parse(token);
+      }
+      accepted += local;
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  RELEASE_ASSERT(accepted == 0);
+  return elapsed.count() / count;
+}
+
+int benchmark(int argc, char** argv) {
+  uint64_t count = 100000;
+  uint64_t max_threads = std::max<uint64_t>(std::thread::hardware_concurrency(), 1);
+  bool usage = argc % 2 == 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--tokens") {
+      usage |= !StringUtil::atoul(argv[i + 1], count) || count == 0;
+    } else if (flag == "--max-threads") {
+      usage |= !StringUtil::atoul(argv[i + 1], max_threads) || max_threads == 0;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    std::cerr << "usage: " << argv[0] << " [--tokens N] [--max-threads N]" << std::endl;
+    return 1;
+  }
+
+  const std::vector<MalformedToken> tokens = malformedTokens();
+  for (const MalformedToken& token : tokens) {
+    Jwt jwt(token.token_);
+    RELEASE_ASSERT(!jwt.IsParsed());
+    RELEASE_ASSERT(JwtStatusToVerifyStatus(jwt.Status()) == token.expected_);
+  }
+  const std::vector<MalformedToken> claims = malformedClaims();
+  for (const MalformedToken& token : claims) {
+    Jwt jwt(token.token_);
+    RELEASE_ASSERT(jwt.IsParsed());
+    RELEASE_ASSERT(claimsStatus(jwt.Claims()) == token.expected_);
+  }
+
+  std::cout << fmt::format("{} hardware threads", std::thread::hardware_concurrency())
+            << std::endl;
+  std::cout << fmt::format("{:<14} {:>8} {:>18} {:>18} {:>10}", "token", "threads",
+                           "throwing ns/tok", "error code ns/tok", "speedup")
+            << std::endl;
+  for (const MalformedToken& token : tokens) {
+    for (uint64_t threads = 1; threads <= max_threads; threads *= 2) {
+      const double throwing_ns = run(threads, count, token.token_, throwingParse);
+      const double error_code_ns = run(threads, count, token.token_, errorCodeParse);
+      std::cout << fmt::format("{:<14} {:>8} {:>18.1f} {:>18.1f} {:>9.2f}x", token.name_, threads,
+                               throwing_ns, error_code_ns,
+                               error_code_ns > 0 ? throwing_ns / error_code_ns : 0)
+                << std::endl;
+    }
+  }
+
+  std::cout << fmt::format("{:<14} {:>8} {:>18} {:>18} {:>10}", "claims", "threads",
+                           "throwing ns/tok", "typed ns/tok", "speedup")
+            << std::endl;
+  for (const MalformedToken& token : claims) {
+    for (uint64_t threads = 1; threads <= max_threads; threads *= 2) {
+      const double throwing_ns = run(threads, count, token.token_, throwingClaims);
+      const double typed_ns = run(threads, count, token.token_, typedClaims);
+      std::cout << fmt::format("{:<14} {:>8} {:>18.1f} {:>18.1f} {:>9.2f}x", token.name_, threads,
+                               throwing_ns, typed_ns, typed_ns > 0 ? throwing_ns / typed_ns : 0)
+                << std::endl;
+    }
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
+
+int main(int argc, char** argv) { return Envoy::Http::Sft::benchmark(argc, argv); }
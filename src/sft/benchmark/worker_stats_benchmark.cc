@@ -0,0 +1,116 @@
+// Measures the request path cost of the filter's counters as the number of workers grows:
+// per-worker WorkerStats (see sft_stats.h) against shared atomic counters, as every request used
+// to update before.
+//
+//   sft_worker_stats_benchmark [--requests N] [--max-workers N]
+//
+// Each simulated request makes the updates an accepted request makes: one outcome counter, one
+// verify status count and one latency sample. Envoy counters keep two atomics (value and pending
+// increment), so the shared variant bumps both.
+
+#include "common/common/utility.h"
+
+#include "../sft_stats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+namespace {
+
+struct SharedCounters {
+  std::array<std::atomic<uint64_t>, SftCounterCount> values_{};
+  std::array<std::atomic<uint64_t>, SftCounterCount> pending_{};
+  std::array<std::atomic<uint64_t>, VerifyStatusCount> verify_counts_{};
+};
+
+// Runs `requests` requests on each of `workers` threads and returns the wall time per request.
+template <class Request>
+double run(uint64_t workers, uint64_t requests, Request request) {
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (uint64_t w = 0; w < workers; w++) {
+    threads.emplace_back([&go, &request, w, requests]() -> void {
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (uint64_t i = 0; i < requests; i++) {
+        request(w, i);
+      }
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / requests;
+}
+
+int benchmark(int argc, char** argv) {
+  uint64_t requests = 10000000;
+  uint64_t max_workers = std::max<uint64_t>(std::thread::hardware_concurrency(), 1);
+  bool usage = argc % 2 == 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--requests") {
+      usage |= !StringUtil::atoul(argv[i + 1], requests) || requests == 0;
+    } else if (flag == "--max-workers") {
+      usage |= !StringUtil::atoul(argv[i + 1], max_workers) || max_workers == 0;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    std::cerr << "usage: " << argv[0] << " [--requests N] [--max-workers N]" << std::endl;
+    return 1;
+  }
+
+  std::cout << fmt::format("{:>8} {:>18} {:>18} {:>10}", "workers", "shared ns/req",
+                           "per-worker ns/req", "speedup")
+            << std::endl;
+  for (uint64_t workers = 1; workers <= max_workers; workers *= 2) {
+    const size_t accepted = static_cast<size_t>(SftCounter::jwt_accepted);
+    const size_t success = static_cast<size_t>(VerifyStatus::JWT_VERIFY_SUCCESS);
+
+    SharedCounters shared;
+    const double shared_ns =
+        run(workers, requests, [&shared, accepted, success](uint64_t, uint64_t) {
+          shared.values_[accepted].fetch_add(1, std::memory_order_relaxed);
+          shared.pending_[accepted].fetch_add(1, std::memory_order_relaxed);
+          shared.verify_counts_[success].fetch_add(1, std::memory_order_relaxed);
+        });
+
+    std::vector<WorkerStatsSharedPtr> local;
+    for (uint64_t w = 0; w < workers; w++) {
+      local.push_back(std::make_shared<WorkerStats>());
+    }
+    const double local_ns = run(workers, requests, [&local](uint64_t w, uint64_t i) {
+      WorkerStats& stats = *local[w];
+      stats.inc(SftCounter::jwt_accepted);
+      stats.recordVerify(VerifyStatus::JWT_VERIFY_SUCCESS, std::chrono::nanoseconds(i & 0xffff));
+    });
+
+    std::cout << fmt::format("{:>8} {:>18.2f} {:>18.2f} {:>9.1f}x", workers, shared_ns, local_ns,
+                             local_ns > 0 ? shared_ns / local_ns : 0)
+              << std::endl;
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
+
+int main(int argc, char** argv) { return Envoy::Http::Sft::benchmark(argc, argv); }
@@ -0,0 +1,74 @@
+#include "body_digest.h"
+
+#include "common/common/base64.h"
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+
+#include <strings.h>
+
+#include <cstring>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+BodyDigest::BodyDigest(const Json::Object& config)
+    : claim_(config.getString("body_digest_claim")) {
+  if (claim_.empty()) {
+    throw EnvoyException("empty 'body_digest_claim' in sft filter config");
+  }
+}
+
+bool BodyDigest::configured(const Json::Object& config) {
+  return config.hasObject("body_digest_claim");
+}
+
+bool BodyDigest::parse(const std::string& value, Digest& out) {
+  for (const std::string& member : StringUtil::split(value, ',')) {
+    const size_t begin = member.find_first_not_of(" \t");
+    const size_t equals = member.find('=');
+    if (begin == std::string::npos || equals == std::string::npos || equals - begin != 7 ||
+        strncasecmp(member.c_str() + begin, "sha-256", 7) != 0) {
+      continue;
+    }
+
+    std::string encoded = member.substr(equals + 1);
+    encoded.erase(encoded.find_last_not_of(" \t") + 1);
+    // Content-Digest wraps the value in colons (a structured field byte sequence).
+    if (encoded.size() >= 2 && encoded.front() == ':' && encoded.back() == ':') {
+      encoded = encoded.substr(1, encoded.size() - 2);
+    }
+    const std::string digest = Base64::decode(encoded);
+    if (digest.size() != out.size()) {
+      return false;
+    }
+    memcpy(out.data(), digest.data(), out.size());
+    return true;
+  }
+  return false;
+}
+
+BodyHasher::BodyHasher() { SHA256_Init(&ctx_); }
+
+void BodyHasher::update(const Buffer::Instance& data) {
+  const uint64_t count = data.getRawSlices(nullptr, 0);
+  if (count == 0) {
+    return;
+  }
+  Buffer::RawSlice slices[count];
+  data.getRawSlices(slices, count);
+  for (uint64_t i = 0; i < count; i++) {
+    SHA256_Update(&ctx_, slices[i].mem_, slices[i].len_);
+  }
+}
+
+BodyDigest::Digest BodyHasher::finish() {
+  BodyDigest::Digest digest;
+  SHA256_Final(digest.data(), &ctx_);
+  return digest;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "envoy/buffer/buffer.h"
+#include "envoy/json/json_object.h"
+
+#include "openssl/sha.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Binds request bodies to tokens (`body_digest_claim`): a verified token carrying the claim is only
+// good for a request whose body has that SHA-256 digest. The claim is written like a
+// Content-Digest header (`sha-256=:<base64>:`, other algorithms in the list are ignored) or a
+// Digest header (`SHA-256=<base64>`).
+//
+// The body is hashed slice by slice as it streams through the filter, without linearizing or
+// buffering it. Only the end of the request (the last data frame, or the trailers) waits on the
+// comparison, so a body that doesn't match is answered with a 401 before the upstream sees the
+// request complete.
+class BodyDigest {
+public:
+  typedef std::array<uint8_t, SHA256_DIGEST_LENGTH> Digest;
+
+  BodyDigest(const Json::Object& config);
+
+  // True if the filter config asks for body binding.
+  static bool configured(const Json::Object& config);
+
+  // The claim holding a token's body digest.
+  const std::string& claim() const { return claim_; }
+
+  // Reads the SHA-256 digest out of a claim value, returns false if it has none.
+  static bool parse(const std::string& value, Digest& out);
+
+private:
+  const std::string claim_;
+};
+
+typedef std::unique_ptr<BodyDigest> BodyDigestPtr;
+
+// SHA-256 of a request body, fed as it streams through.
+class BodyHasher {
+public:
+  BodyHasher();
+
+  void update(const Buffer::Instance& data);
+  BodyDigest::Digest finish();
+
+private:
+  SHA256_CTX ctx_;
+};
+
+typedef std::unique_ptr<BodyHasher> BodyHasherPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,86 @@
+#include "capture.h"
+
+#include "envoy/common/exception.h"
+
+#include "openssl/hmac.h"
+#include "openssl/rand.h"
+
+#include <cstring>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+void put(std::string& out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t get(const char*& in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+  }
+  in += bytes;
+  return value;
+}
+
+} // namespace
+
+std::string EncodeCaptureRecord(const CaptureRecord& record) {
+  std::string frame;
+  frame.reserve(CaptureFrameSize);
+  put(frame, record.time_us_, 8);
+  put(frame, record.path_hash_, 4);
+  put(frame, record.token_hash_, 4);
+  put(frame, record.kid_hash_, 4);
+  put(frame, record.token_size_, 2);
+  put(frame, record.status_, 1);
+  put(frame, 0, 1); // Reserved.
+  put(frame, record.verify_ns_, 4);
+  return frame;
+}
+
+bool DecodeCaptureRecord(const char* frame, CaptureRecord& record) {
+  if (memcmp(frame, CaptureMagic, sizeof(CaptureMagic) - 1) == 0) {
+    return false;
+  }
+
+  record.time_us_ = get(frame, 8);
+  record.path_hash_ = get(frame, 4);
+  record.token_hash_ = get(frame, 4);
+  record.kid_hash_ = get(frame, 4);
+  record.token_size_ = get(frame, 2);
+  record.status_ = get(frame, 1);
+  get(frame, 1);
+  record.verify_ns_ = get(frame, 4);
+  return true;
+}
+
+CaptureWriter::CaptureWriter(Filesystem::FileSharedPtr file) : file_(file) {
+  if (RAND_bytes(key_, sizeof(key_)) != 1) {
+    throw EnvoyException("unable to generate a capture key");
+  }
+
+  std::string header(CaptureMagic, sizeof(CaptureMagic) - 1);
+  header.resize(CaptureFrameSize, '\0');
+  file_->write(header);
+}
+
+uint32_t CaptureWriter::hash(const char* data, size_t size) const {
+  uint8_t digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  HMAC(EVP_sha256(), key_, sizeof(key_), reinterpret_cast<const uint8_t*>(data), size, digest,
+       &digest_len);
+  const char* in = reinterpret_cast<const char*>(digest);
+  const uint32_t hash = get(in, 4);
+  return hash == 0 ? 1 : hash;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "envoy/filesystem/filesystem.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// One verified request in a capture trace. Nothing identifying is kept: the path, token and kid
+// are reduced to 32 bit hashes keyed with a random secret that only lives in the writer's memory.
+// That is enough to group requests by path, token and key within one trace for replay (see
+// tools/replay.cc), while guessing which path or kid a hash stands for needs the key. Hashes from
+// different traces (writers) can't be compared.
+struct CaptureRecord {
+  uint64_t time_us_{};    // Wall clock time of the request, microseconds since the epoch.
+  uint32_t path_hash_{};  // Path without the query string.
+  uint32_t token_hash_{}; // 0 if the request had no token.
+  uint32_t kid_hash_{};   // 0 if the token had no kid (or didn't parse).
+  uint16_t token_size_{}; // Saturates at 65535.
+  uint8_t status_{};      // VerifyStatus.
+  uint32_t verify_ns_{};  // Time spent in verify(), saturates at ~4s.
+};
+
+// Records are stored as fixed size little endian frames. Each writer starts a new trace with a
+// header frame (the magic followed by zeros), so traces appended across restarts remain readable.
+const size_t CaptureFrameSize = 28;
+const char CaptureMagic[] = "SFTCAP01";
+
+std::string EncodeCaptureRecord(const CaptureRecord& record);
+// Decodes a CaptureFrameSize byte frame. Returns false for header frames.
+bool DecodeCaptureRecord(const char* frame, CaptureRecord& record);
+
+// Appends records to a capture file through Envoy's buffered, flushed-off-thread access log
+// files. Safe to use from every worker.
+class CaptureWriter {
+public:
+  CaptureWriter(Filesystem::FileSharedPtr file);
+
+  // HMAC-SHA256 of `data` under this trace's key, truncated to 32 bits. Never 0, which records
+  // use for "absent".
+  uint32_t hash(const char* data, size_t size) const;
+  void write(const CaptureRecord& record) { file_->write(EncodeCaptureRecord(record)); }
+
+private:
+  static const size_t KeySize = 32;
+
+  Filesystem::FileSharedPtr file_;
+  uint8_t key_[KeySize];
+};
+
+typedef std::unique_ptr<CaptureWriter> CaptureWriterPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,82 @@
+#include "claims_metadata.h"
+
+#include "rapidjson/document.h"
+
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+// Nesting kept below a claim, anything deeper is published as null.
+const int MaxDepth = 16;
+
+void toValue(const rapidjson::Value& json, int depth, ProtobufWkt::Value& value) {
+  switch (json.GetType()) {
+  case rapidjson::kNullType:
+    value.set_null_value(ProtobufWkt::NULL_VALUE);
+    return;
+  case rapidjson::kFalseType:
+  case rapidjson::kTrueType:
+    value.set_bool_value(json.GetBool());
+    return;
+  case rapidjson::kNumberType:
+    value.set_number_value(json.GetDouble());
+    return;
+  case rapidjson::kStringType:
+    value.set_string_value(json.GetString(), json.GetStringLength());
+    return;
+  case rapidjson::kArrayType:
+  case rapidjson::kObjectType:
+    break;
+  }
+
+  if (depth >= MaxDepth) {
+    value.set_null_value(ProtobufWkt::NULL_VALUE);
+  } else if (json.IsArray()) {
+    ProtobufWkt::ListValue& list = *value.mutable_list_value();
+    for (auto it = json.Begin(); it != json.End(); ++it) {
+      toValue(*it, depth + 1, *list.add_values());
+    }
+  } else {
+    auto& fields = *value.mutable_struct_value()->mutable_fields();
+    for (auto it = json.MemberBegin(); it != json.MemberEnd(); ++it) {
+      toValue(it->value, depth + 1,
+              fields[std::string(it->name.GetString(), it->name.GetStringLength())]);
+    }
+  }
+}
+
+} // namespace
+
+ClaimsMetadata::ClaimsMetadata(const Json::Object& config) : name_("scaleft.accessfabric") {
+  for (const std::string& claim : config.getStringArray("metadata_claims", true)) {
+    claims_.insert(claim);
+  }
+}
+
+bool ClaimsMetadata::configured(const Json::Object& config) {
+  return config.getBoolean("dynamic_metadata", false);
+}
+
+void ClaimsMetadata::claims(const std::string& payload, ProtobufWkt::Struct& claims) const {
+  rapidjson::Document document;
+  document.Parse(payload.c_str());
+  if (document.HasParseError() || !document.IsObject()) {
+    return;
+  }
+
+  auto& fields = *claims.mutable_fields();
+  for (auto it = document.MemberBegin(); it != document.MemberEnd(); ++it) {
+    const std::string name(it->name.GetString(), it->name.GetStringLength());
+    if (claims_.empty() || claims_.count(name)) {
+      toValue(it->value, 1, fields[name]);
+    }
+  }
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common/protobuf/protobuf.h"
+#include "envoy/json/json_object.h"
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Verification results published as stream dynamic metadata (`dynamic_metadata`,
+// `metadata_claims`), so later filters and access logs read them without decoding the token again.
+// Everything goes under the filter's name:
+//
+//   status: the VerifyStatus, for every verified request.
+//   kid:    the token's kid, once it is known.
+//   claims: the verified token's payload, or the subject of a session cookie, only set when the
+//           request is allowed through.
+//
+// The metadata is built once per request, after verification; the claims are converted straight
+// from the payload JSON.
+class ClaimsMetadata {
+public:
+  ClaimsMetadata(const Json::Object& config);
+
+  // True if the filter config asks for dynamic metadata.
+  static bool configured(const Json::Object& config);
+
+  // Namespace of the metadata.
+  const std::string& name() const { return name_; }
+
+  // Adds the published claims of a verified token's payload (its JSON text) to `claims`.
+  void claims(const std::string& payload, ProtobufWkt::Struct& claims) const;
+
+private:
+  const std::string name_;
+  // Claims to publish, all of them when empty.
+  std::unordered_set<std::string> claims_;
+};
+
+typedef std::unique_ptr<ClaimsMetadata> ClaimsMetadataPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
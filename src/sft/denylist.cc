@@ -0,0 +1,114 @@
+#include "denylist.h"
+
+#include "common/common/hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+// splitmix64 finalizer, used to separate the claim kinds and to derive the second Bloom hash.
+uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+} // namespace
+
+Denylist::Denylist(std::vector<uint64_t>&& hashes, uint32_t bits_per_entry)
+    : hashes_(std::move(hashes)) {
+  std::sort(hashes_.begin(), hashes_.end());
+  hashes_.erase(std::unique(hashes_.begin(), hashes_.end()), hashes_.end());
+  hashes_.shrink_to_fit();
+  if (hashes_.empty()) {
+    return;
+  }
+
+  // k = ln(2) * m/n minimizes the false positive rate for a given size.
+  bits_per_entry = std::max<uint32_t>(bits_per_entry, 1);
+  num_probes_ = std::min<uint32_t>(
+      std::max<uint32_t>(static_cast<uint32_t>(std::lround(bits_per_entry * 0.693)), 1), 16);
+  const size_t words = (hashes_.size() * bits_per_entry + 63) / 64;
+  bits_.assign(words, 0);
+  num_bits_ = words * 64;
+
+  for (uint64_t hash : hashes_) {
+    const uint64_t step = mix(hash) | 1;
+    uint64_t probe = hash;
+    for (uint32_t i = 0; i < num_probes_; i++, probe += step) {
+      const uint64_t bit = probe % num_bits_;
+      bits_[bit / 64] |= 1ULL << (bit % 64);
+    }
+  }
+}
+
+uint64_t Denylist::hash(DenylistKind kind, const std::string& value) {
+  return mix(HashUtil::xxHash64(value) + static_cast<uint64_t>(kind));
+}
+
+bool Denylist::mayContain(uint64_t hash) const {
+  if (num_bits_ == 0) {
+    return false;
+  }
+
+  const uint64_t step = mix(hash) | 1;
+  uint64_t probe = hash;
+  for (uint32_t i = 0; i < num_probes_; i++, probe += step) {
+    const uint64_t bit = probe % num_bits_;
+    if (!(bits_[bit / 64] & (1ULL << (bit % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Denylist::contains(uint64_t hash) const {
+  return std::binary_search(hashes_.begin(), hashes_.end(), hash);
+}
+
+DenylistConstSharedPtr ParseDenylist(const std::string& body, uint32_t bits_per_entry) {
+  std::vector<uint64_t> hashes;
+  size_t start = 0;
+  while (start < body.size()) {
+    size_t end = body.find('\n', start);
+    if (end == std::string::npos) {
+      end = body.size();
+    }
+    size_t line_end = end;
+    if (line_end > start && body[line_end - 1] == '\r') {
+      line_end--;
+    }
+
+    if (line_end > start && body[start] != '#') {
+      // `<kind> <value>`, the value runs to the end of the line.
+      const std::string line = body.substr(start, line_end - start);
+      if (line.size() < 5 || line[3] != ' ') {
+        return nullptr;
+      }
+      const std::string kind = line.substr(0, 3);
+      if (kind == "jti") {
+        hashes.push_back(Denylist::hash(DenylistKind::JTI, line.substr(4)));
+      } else if (kind == "sub") {
+        hashes.push_back(Denylist::hash(DenylistKind::SUB, line.substr(4)));
+      } else {
+        return nullptr;
+      }
+    }
+
+    start = end + 1;
+  }
+
+  return std::make_shared<const Denylist>(std::move(hashes), bits_per_entry);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
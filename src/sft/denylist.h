@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// The token claim a denylist entry revokes.
+enum class DenylistKind : uint8_t { JTI, SUB };
+
+// Immutable set of revoked `jti` and `sub` values. Built once (off the main thread) and then
+// published read-only to every worker.
+//
+// Entries are only kept as 64 bit hashes (xxHash, see hash()): a Bloom filter answers the common
+// "not revoked" case with a handful of bit probes, and a sorted array of the hashes confirms Bloom
+// hits, so Bloom false positives never reject a token. The array is exact over hashes, not values:
+// a token whose claim hashes the same as a revoked value is rejected too, with odds of about n/2^64
+// per token for n entries. At the default 10 bits per entry that is ~9 bytes per revocation in
+// total, independent of the length of the revoked values.
+class Denylist {
+public:
+  // An empty denylist.
+  Denylist() {}
+  // Takes ownership of `hashes` (see hash()), which may contain duplicates.
+  Denylist(std::vector<uint64_t>&& hashes, uint32_t bits_per_entry);
+
+  static uint64_t hash(DenylistKind kind, const std::string& value);
+
+  // False if `hash` is definitely not in the set.
+  bool mayContain(uint64_t hash) const;
+  // Exact membership of the hash, for confirming mayContain() hits.
+  bool contains(uint64_t hash) const;
+
+  size_t size() const { return hashes_.size(); }
+  // Approximate memory used by the filter and the exact set.
+  size_t bytes() const { return (bits_.size() + hashes_.size()) * sizeof(uint64_t); }
+
+private:
+  std::vector<uint64_t> bits_;
+  uint64_t num_bits_{};
+  uint32_t num_probes_{};
+  std::vector<uint64_t> hashes_; // Sorted and unique.
+};
+
+typedef std::shared_ptr<const Denylist> DenylistConstSharedPtr;
+
+// Parses a denylist document: one `jti <value>` or `sub <value>` entry per line. Blank lines and
+// lines starting with `#` are ignored. Returns nullptr if any other line is malformed.
+DenylistConstSharedPtr ParseDenylist(const std::string& body, uint32_t bits_per_entry);
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,192 @@
+#include "denylist_provider.h"
+
+#include "common/common/enum_to_int.h"
+#include "common/filesystem/filesystem_impl.h"
+#include "common/http/headers.h"
+#include "common/http/message_impl.h"
+#include "common/http/utility.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+DenylistProvider::DenylistProvider(const Json::Object& config,
+                                   JwksParseThreadSharedPtr build_thread,
+                                   ThreadLocal::SlotAllocator& tls, Upstream::ClusterManager& cm,
+                                   Event::Dispatcher& dispatcher, Stats::Scope& scope,
+                                   Runtime::RandomGenerator& random)
+    : path_(config.getString("denylist_path", "")),
+      cluster_(config.getString("denylist_api_cluster", "")),
+      api_path_(config.getString("denylist_api_path", "")),
+      refresh_interval_(config.getInteger("denylist_refresh_delay_ms", 60000)),
+      bits_per_entry_(config.getInteger("denylist_bits_per_entry", 10)),
+      build_thread_(build_thread), cm_(cm), dispatcher_(dispatcher), random_(random),
+      refresh_timer_(dispatcher.createTimer([this]() -> void { refresh(); })),
+      stats_(generateStats("scaleft.accessfabric.", scope)), tls_(tls.allocateSlot()) {
+  if (refresh_interval_.count() <= 0) {
+    throw EnvoyException("invalid 'denylist_refresh_delay_ms' in sft filter config");
+  }
+  if (bits_per_entry_ < 1 || bits_per_entry_ > 64) {
+    throw EnvoyException("invalid 'denylist_bits_per_entry' in sft filter config");
+  }
+
+  tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<ThreadLocalDenylist>();
+  });
+
+  if (!path_.empty()) {
+    DenylistConstSharedPtr denylist =
+        ParseDenylist(Filesystem::fileReadToEnd(path_), bits_per_entry_);
+    if (!denylist) {
+      throw EnvoyException(fmt::format("invalid denylist file '{}' in sft filter config", path_));
+    }
+    ENVOY_LOG(debug, "DenylistProvider::{}: loaded {} entries from {}", __func__,
+              denylist->size(), path_);
+    stats_.denylist_load_success_.inc();
+    publish(denylist);
+    refresh_timer_->enableTimer(refresh_interval_);
+    return;
+  }
+
+  if (!cm.get(cluster_)) {
+    throw EnvoyException(
+        fmt::format("unknown denylist cluster '{}' in sft filter config", cluster_));
+  }
+  if (api_path_.empty()) {
+    throw EnvoyException("empty 'denylist_api_path' in sft filter config");
+  }
+
+  // Nothing is revoked until the first fetch completes.
+  publish(std::make_shared<const Denylist>());
+  refresh();
+}
+
+DenylistProvider::~DenylistProvider() {
+  if (active_request_) {
+    active_request_->cancel();
+  }
+}
+
+bool DenylistProvider::configured(const Json::Object& config) {
+  return config.hasObject("denylist_path") || config.hasObject("denylist_api_cluster");
+}
+
+DenylistStats DenylistProvider::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_DENYLIST_STATS(POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+bool DenylistProvider::isRevoked(const std::string& jti, const std::string& sub) {
+  const Denylist& denylist = *tls_->getTyped<ThreadLocalDenylist>().reader_.get(snapshot_);
+  if (check(denylist, DenylistKind::JTI, jti) || check(denylist, DenylistKind::SUB, sub)) {
+    stats_.jwt_revoked_.inc();
+    return true;
+  }
+  return false;
+}
+
+bool DenylistProvider::check(const Denylist& denylist, DenylistKind kind,
+                             const std::string& value) {
+  if (value.empty()) {
+    return false;
+  }
+
+  const uint64_t hash = Denylist::hash(kind, value);
+  if (!denylist.mayContain(hash)) {
+    return false;
+  }
+  if (denylist.contains(hash)) {
+    return true;
+  }
+  stats_.denylist_false_positive_.inc();
+  return false;
+}
+
+void DenylistProvider::publish(DenylistConstSharedPtr denylist) {
+  stats_.denylist_entries_.set(denylist->size());
+  stats_.denylist_bytes_.set(denylist->bytes());
+  snapshot_.publish(denylist);
+}
+
+void DenylistProvider::refresh() {
+  ENVOY_LOG(debug, "DenylistProvider::{}", __func__);
+  if (build_pending_) {
+    return;
+  }
+
+  if (!path_.empty()) {
+    build(nullptr);
+    return;
+  }
+
+  MessagePtr message(new RequestMessageImpl());
+  message->headers().insertMethod().value().setReference(Http::Headers::get().MethodValues.Get);
+  message->headers().insertPath().value(api_path_);
+  message->headers().insertHost().value(cluster_);
+  active_request_ = cm_.httpAsyncClientForCluster(cluster_).send(
+      std::move(message), *this,
+      Optional<std::chrono::milliseconds>(std::chrono::milliseconds(5000)));
+}
+
+void DenylistProvider::onSuccess(Http::MessagePtr&& response) {
+  active_request_ = nullptr;
+  uint64_t response_code = Http::Utility::getResponseStatus(response->headers());
+  if (response_code != enumToInt(Http::Code::OK)) {
+    ENVOY_LOG(warn, "DenylistProvider::{}: failed request: response {} != 200", __func__,
+              response_code);
+    onBuilt(nullptr);
+    return;
+  }
+
+  build(std::make_shared<std::string>(response->bodyAsString()));
+}
+
+void DenylistProvider::onFailure(Http::AsyncClient::FailureReason) {
+  ENVOY_LOG(warn, "DenylistProvider::{}: failed request", __func__);
+  active_request_ = nullptr;
+  onBuilt(nullptr);
+}
+
+void DenylistProvider::build(std::shared_ptr<std::string> body) {
+  build_pending_ = true;
+  std::weak_ptr<DenylistProvider> weak_this = shared_from_this();
+  Event::Dispatcher& dispatcher = dispatcher_;
+  const std::string path = path_;
+  const uint32_t bits_per_entry = bits_per_entry_;
+  build_thread_->post([weak_this, &dispatcher, body, path, bits_per_entry]() -> void {
+    DenylistConstSharedPtr denylist;
+    try {
+      denylist = ParseDenylist(body ? *body : Filesystem::fileReadToEnd(path), bits_per_entry);
+    } catch (const EnvoyException&) {
+      // Unreadable file, handled as a parse failure below.
+    }
+    dispatcher.post([weak_this, denylist]() -> void {
+      if (DenylistProviderSharedPtr provider = weak_this.lock()) {
+        provider->build_pending_ = false;
+        provider->onBuilt(denylist);
+      }
+    });
+  });
+}
+
+void DenylistProvider::onBuilt(DenylistConstSharedPtr denylist) {
+  if (denylist) {
+    ENVOY_LOG(debug, "DenylistProvider::{}: publishing {} entries", __func__, denylist->size());
+    stats_.denylist_load_success_.inc();
+    publish(denylist);
+  } else {
+    ENVOY_LOG(warn, "DenylistProvider::{}: load failed, keeping previous denylist", __func__);
+    stats_.denylist_load_failed_.inc();
+  }
+
+  // Add refresh jitter based on the configured interval.
+  std::chrono::milliseconds jitter(random_.random() % refresh_interval_.count());
+  refresh_timer_->enableTimer(refresh_interval_ + jitter);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/http/async_client.h"
+#include "envoy/json/json_object.h"
+#include "envoy/runtime/runtime.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+#include "envoy/upstream/cluster_manager.h"
+
+#include "denylist.h"
+#include "jwks_parser.h"
+#include "snapshot.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// clang-format off
+#define ALL_DENYLIST_STATS(COUNTER, GAUGE)                                                  \
+  COUNTER(denylist_load_success)                                                            \
+  COUNTER(denylist_load_failed)                                                             \
+  COUNTER(denylist_false_positive)                                                          \
+  COUNTER(jwt_revoked)                                                                      \
+  GAUGE(denylist_entries)                                                                   \
+  GAUGE(denylist_bytes)
+// clang-format on
+
+struct DenylistStats {
+  ALL_DENYLIST_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+// Per-worker view of the published denylist.
+struct ThreadLocalDenylist : public ThreadLocal::ThreadLocalObject {
+  SnapshotReader<Denylist> reader_;
+};
+
+class DenylistProvider;
+typedef std::shared_ptr<DenylistProvider> DenylistProviderSharedPtr;
+
+// Loads the revocation denylist from a local file (`denylist_path`) or by polling a cluster
+// (`denylist_api_cluster`, `denylist_api_path`), and reloads it every `denylist_refresh_delay_ms`.
+//
+// Like JwksProvider, documents are parsed on the shared background thread and published to workers
+// with an atomic snapshot swap. A failed reload keeps serving the previous denylist.
+class DenylistProvider : public Http::AsyncClient::Callbacks,
+                         public Logger::Loggable<Logger::Id::http>,
+                         public std::enable_shared_from_this<DenylistProvider> {
+public:
+  // Loads a file backed denylist synchronously, throwing EnvoyException if it can't be read or
+  // parsed, so a bad path fails the config rather than silently revoking nothing.
+  DenylistProvider(const Json::Object& config, JwksParseThreadSharedPtr build_thread,
+                   ThreadLocal::SlotAllocator& tls, Upstream::ClusterManager& cm,
+                   Event::Dispatcher& dispatcher, Stats::Scope& scope,
+                   Runtime::RandomGenerator& random);
+  ~DenylistProvider();
+
+  // True if the filter config asks for a denylist.
+  static bool configured(const Json::Object& config);
+
+  // Called from workers after the signature has been verified. Empty values are never revoked.
+  bool isRevoked(const std::string& jti, const std::string& sub);
+
+  const DenylistStats& stats() { return stats_; }
+  static DenylistStats generateStats(const std::string& prefix, Stats::Scope& scope);
+
+private:
+  // Http::AsyncClient::Callbacks
+  void onSuccess(Http::MessagePtr&& response) override;
+  void onFailure(Http::AsyncClient::FailureReason reason) override;
+
+  void refresh();
+  // Parses `body` on the build thread, or reads and parses the file if `body` is null.
+  void build(std::shared_ptr<std::string> body);
+  void onBuilt(DenylistConstSharedPtr denylist);
+  void publish(DenylistConstSharedPtr denylist);
+  bool check(const Denylist& denylist, DenylistKind kind, const std::string& value);
+
+  const std::string path_;
+  const std::string cluster_;
+  const std::string api_path_;
+  const std::chrono::milliseconds refresh_interval_;
+  const uint32_t bits_per_entry_;
+  JwksParseThreadSharedPtr build_thread_;
+  Upstream::ClusterManager& cm_;
+  Event::Dispatcher& dispatcher_;
+  Runtime::RandomGenerator& random_;
+  Event::TimerPtr refresh_timer_;
+  Http::AsyncClient::Request* active_request_{};
+  bool build_pending_{};
+
+  const DenylistStats stats_;
+  AtomicSnapshot<Denylist> snapshot_;
+  ThreadLocal::SlotPtr tls_;
+};
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
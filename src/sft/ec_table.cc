@@ -0,0 +1,457 @@
+#include "ec_table.h"
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+typedef P256Table::Limbs Limbs;
+typedef unsigned __int128 uint128_t;
+
+// A Montgomery modulus: m, -m^-1 mod 2^64 and R^2 mod m (R = 2^256).
+struct Modulus {
+  Limbs m_;
+  uint64_t n0_;
+  Limbs rr_;
+};
+
+// The field prime p and the group order n.
+const Modulus FieldP = {
+    {0xffffffffffffffff, 0x00000000ffffffff, 0x0000000000000000, 0xffffffff00000001},
+    0x0000000000000001,
+    {0x0000000000000003, 0xfffffffbffffffff, 0xfffffffffffffffe, 0x00000004fffffffd}};
+const Modulus OrderN = {
+    {0xf3b9cac2fc632551, 0xbce6faada7179e84, 0xffffffffffffffff, 0xffffffff00000000},
+    0xccd1c8aaee00bc4f,
+    {0x83244c95be79eea2, 0x4699799c49bd6fa6, 0x2845b2392b6bec59, 0x66e12d94f3d95620}};
+
+// b, and 1 in Montgomery form mod p.
+const Limbs CurveB = {0xd89cdf6229c4bddf, 0xacf005cd78843090, 0xe5a220abf7212ed6,
+                      0xdc30061d04874834};
+const Limbs One = {0x0000000000000001, 0xffffffff00000000, 0xffffffffffffffff,
+                   0x00000000fffffffe};
+
+const uint8_t GeneratorX[32] = {0x6b, 0x17, 0xd1, 0xf2, 0xe1, 0x2c, 0x42, 0x47, 0xf8, 0xbc, 0xe6,
+                                0xe5, 0x63, 0xa4, 0x40, 0xf2, 0x77, 0x03, 0x7d, 0x81, 0x2d, 0xeb,
+                                0x33, 0xa0, 0xf4, 0xa1, 0x39, 0x45, 0xd8, 0x98, 0xc2, 0x96};
+const uint8_t GeneratorY[32] = {0x4f, 0xe3, 0x42, 0xe2, 0xfe, 0x1a, 0x7f, 0x9b, 0x8e, 0xe7, 0xeb,
+                                0x4a, 0x7c, 0x0f, 0x9e, 0x16, 0x2b, 0xce, 0x33, 0x57, 0x6b, 0x31,
+                                0x5e, 0xce, 0xcb, 0xb6, 0x40, 0x68, 0x37, 0xbf, 0x51, 0xf5};
+
+Limbs fromBytes(const uint8_t* in) {
+  Limbs out;
+  for (size_t i = 0; i < 4; i++) {
+    uint64_t limb = 0;
+    for (size_t j = 0; j < 8; j++) {
+      limb = (limb << 8) | in[(3 - i) * 8 + j];
+    }
+    out[i] = limb;
+  }
+  return out;
+}
+
+bool isZero(const Limbs& a) { return (a[0] | a[1] | a[2] | a[3]) == 0; }
+
+bool lessThan(const Limbs& a, const Limbs& b) {
+  for (size_t i = 4; i-- > 0;) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i];
+    }
+  }
+  return false;
+}
+
+// out = a - b, returns the borrow.
+uint64_t subLimbs(const Limbs& a, const Limbs& b, Limbs& out) {
+  uint64_t borrow = 0;
+  for (size_t i = 0; i < 4; i++) {
+    const uint128_t d = static_cast<uint128_t>(a[i]) - b[i] - borrow;
+    out[i] = static_cast<uint64_t>(d);
+    borrow = static_cast<uint64_t>(d >> 64) & 1;
+  }
+  return borrow;
+}
+
+// out = a + b, returns the carry.
+uint64_t addLimbs(const Limbs& a, const Limbs& b, Limbs& out) {
+  uint64_t carry = 0;
+  for (size_t i = 0; i < 4; i++) {
+    const uint128_t s = static_cast<uint128_t>(a[i]) + b[i] + carry;
+    out[i] = static_cast<uint64_t>(s);
+    carry = static_cast<uint64_t>(s >> 64);
+  }
+  return carry;
+}
+
+Limbs addMod(const Modulus& m, const Limbs& a, const Limbs& b) {
+  Limbs sum, reduced;
+  const uint64_t carry = addLimbs(a, b, sum);
+  const uint64_t borrow = subLimbs(sum, m.m_, reduced);
+  return (carry || !borrow) ? reduced : sum;
+}
+
+Limbs subMod(const Modulus& m, const Limbs& a, const Limbs& b) {
+  Limbs diff;
+  if (subLimbs(a, b, diff)) {
+    addLimbs(diff, m.m_, diff);
+  }
+  return diff;
+}
+
+// t + a * b + carry, returns the low limb and leaves the high one in carry.
+inline uint64_t mulAdd(uint64_t t, uint64_t a, uint64_t b, uint64_t& carry) {
+  const uint128_t c = static_cast<uint128_t>(a) * b + t + carry;
+  carry = static_cast<uint64_t>(c >> 64);
+  return static_cast<uint64_t>(c);
+}
+
+// Montgomery multiplication (CIOS): a * b / R mod m, for a, b < m. Unrolled by hand, compilers
+// don't at -O2 and the loop version is a third slower.
+Limbs mulMod(const Modulus& m, const Limbs& a, const Limbs& b) {
+  uint64_t t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0;
+  for (size_t i = 0; i < 4; i++) {
+    uint64_t carry = 0;
+    t0 = mulAdd(t0, a[0], b[i], carry);
+    t1 = mulAdd(t1, a[1], b[i], carry);
+    t2 = mulAdd(t2, a[2], b[i], carry);
+    t3 = mulAdd(t3, a[3], b[i], carry);
+    uint128_t sum = static_cast<uint128_t>(t4) + carry;
+    t4 = static_cast<uint64_t>(sum);
+    const uint64_t t5 = static_cast<uint64_t>(sum >> 64);
+
+    // Add q * m, which zeroes the low limb, and shift it out.
+    const uint64_t q = t0 * m.n0_;
+    carry = 0;
+    mulAdd(t0, q, m.m_[0], carry);
+    t0 = mulAdd(t1, q, m.m_[1], carry);
+    t1 = mulAdd(t2, q, m.m_[2], carry);
+    t2 = mulAdd(t3, q, m.m_[3], carry);
+    sum = static_cast<uint128_t>(t4) + carry;
+    t3 = static_cast<uint64_t>(sum);
+    t4 = t5 + static_cast<uint64_t>(sum >> 64);
+  }
+
+  const Limbs out = {t0, t1, t2, t3};
+  Limbs reduced;
+  const uint64_t borrow = subLimbs(out, m.m_, reduced);
+  return (t4 || !borrow) ? reduced : out;
+}
+
+Limbs sqrMod(const Modulus& m, const Limbs& a) { return mulMod(m, a, a); }
+
+Limbs toMont(const Modulus& m, const Limbs& a) { return mulMod(m, a, m.rr_); }
+
+// a^-1 in Montgomery form, by Fermat: a^(m - 2).
+Limbs invMod(const Modulus& m, const Limbs& a, const Limbs& one) {
+  Limbs exponent;
+  subLimbs(m.m_, Limbs{2, 0, 0, 0}, exponent);
+  Limbs result = one;
+  for (size_t i = 256; i-- > 0;) {
+    result = sqrMod(m, result);
+    if ((exponent[i / 64] >> (i % 64)) & 1) {
+      result = mulMod(m, result, a);
+    }
+  }
+  return result;
+}
+
+Limbs invP(const Limbs& a) { return invMod(FieldP, a, One); }
+
+bool isOne(const Limbs& a) { return a[0] == 1 && (a[1] | a[2] | a[3]) == 0; }
+
+// a >>= 1, shifting `carry` into the top bit.
+void halve(Limbs& a, uint64_t carry) {
+  for (size_t i = 0; i < 3; i++) {
+    a[i] = (a[i] >> 1) | (a[i + 1] << 63);
+  }
+  a[3] = (a[3] >> 1) | (carry << 63);
+}
+
+// x / 2 mod m.
+void halveMod(const Modulus& m, Limbs& x) {
+  if (x[0] & 1) {
+    const uint64_t carry = addLimbs(x, m.m_, x);
+    halve(x, carry);
+  } else {
+    halve(x, 0);
+  }
+}
+
+// a^-1 mod m for 0 < a < m, plain (not Montgomery) form, by the binary extended Euclidean
+// algorithm. Variable time, and an order of magnitude faster than invMod().
+Limbs invBinary(const Modulus& m, const Limbs& a) {
+  Limbs u = a;
+  Limbs v = m.m_;
+  Limbs x1 = {1, 0, 0, 0};
+  Limbs x2 = {};
+  while (!isOne(u) && !isOne(v)) {
+    while (!(u[0] & 1)) {
+      halve(u, 0);
+      halveMod(m, x1);
+    }
+    while (!(v[0] & 1)) {
+      halve(v, 0);
+      halveMod(m, x2);
+    }
+    if (!lessThan(u, v)) {
+      subLimbs(u, v, u);
+      x1 = subMod(m, x1, x2);
+    } else {
+      subLimbs(v, u, v);
+      x2 = subMod(m, x2, x1);
+    }
+  }
+  return isOne(u) ? x1 : x2;
+}
+
+// Jacobian coordinates (x = X/Z^2, y = Y/Z^3), Z = 0 is the point at infinity.
+struct JacobianPoint {
+  Limbs x_;
+  Limbs y_;
+  Limbs z_;
+
+  bool infinity() const { return isZero(z_); }
+};
+
+// dbl-2001-b, for a = -3.
+void doublePoint(JacobianPoint& p) {
+  if (p.infinity()) {
+    return;
+  }
+  const Limbs delta = sqrMod(FieldP, p.z_);
+  const Limbs gamma = sqrMod(FieldP, p.y_);
+  const Limbs beta = mulMod(FieldP, p.x_, gamma);
+  Limbs alpha = mulMod(FieldP, subMod(FieldP, p.x_, delta), addMod(FieldP, p.x_, delta));
+  alpha = addMod(FieldP, addMod(FieldP, alpha, alpha), alpha);
+
+  const Limbs beta4 = addMod(FieldP, addMod(FieldP, beta, beta), addMod(FieldP, beta, beta));
+  const Limbs x = subMod(FieldP, sqrMod(FieldP, alpha), addMod(FieldP, beta4, beta4));
+  const Limbs yz = addMod(FieldP, p.y_, p.z_);
+  p.z_ = subMod(FieldP, subMod(FieldP, sqrMod(FieldP, yz), gamma), delta);
+
+  Limbs gamma8 = sqrMod(FieldP, gamma);
+  gamma8 = addMod(FieldP, gamma8, gamma8);
+  gamma8 = addMod(FieldP, gamma8, gamma8);
+  gamma8 = addMod(FieldP, gamma8, gamma8);
+  p.y_ = subMod(FieldP, mulMod(FieldP, alpha, subMod(FieldP, beta4, x)), gamma8);
+  p.x_ = x;
+}
+
+// p += (x, y), a mixed Jacobian + affine addition.
+void addAffine(JacobianPoint& p, const Limbs& x, const Limbs& y) {
+  if (p.infinity()) {
+    p.x_ = x;
+    p.y_ = y;
+    p.z_ = One;
+    return;
+  }
+
+  const Limbs z1z1 = sqrMod(FieldP, p.z_);
+  const Limbs u2 = mulMod(FieldP, x, z1z1);
+  const Limbs s2 = mulMod(FieldP, y, mulMod(FieldP, p.z_, z1z1));
+  const Limbs h = subMod(FieldP, u2, p.x_);
+  const Limbs r = subMod(FieldP, s2, p.y_);
+  if (isZero(h)) {
+    if (isZero(r)) {
+      doublePoint(p);
+    } else {
+      p.z_ = Limbs{};
+    }
+    return;
+  }
+
+  const Limbs hh = sqrMod(FieldP, h);
+  const Limbs hhh = mulMod(FieldP, h, hh);
+  const Limbs v = mulMod(FieldP, p.x_, hh);
+  const Limbs x3 = subMod(FieldP, subMod(FieldP, sqrMod(FieldP, r), hhh), addMod(FieldP, v, v));
+  p.y_ = subMod(FieldP, mulMod(FieldP, r, subMod(FieldP, v, x3)), mulMod(FieldP, p.y_, hhh));
+  p.x_ = x3;
+  p.z_ = mulMod(FieldP, p.z_, h);
+}
+
+// r and s of a JWS ECDSA signature, false unless both are in [1, n).
+bool parseSignature(const uint8_t* signature, Limbs& r, Limbs& s) {
+  r = fromBytes(signature);
+  s = fromBytes(signature + 32);
+  return !isZero(r) && !isZero(s) && lessThan(r, OrderN.m_) && lessThan(s, OrderN.m_);
+}
+
+// The digest as a scalar mod n. It is below 2^256 < 2n, one subtraction reduces it.
+Limbs digestScalar(const uint8_t* digest) {
+  Limbs e = fromBytes(digest);
+  if (!lessThan(e, OrderN.m_)) {
+    subLimbs(e, OrderN.m_, e);
+  }
+  return e;
+}
+
+bool onCurve(const Limbs& x, const Limbs& y) {
+  // y^2 = x^3 - 3x + b
+  const Limbs x3 = mulMod(FieldP, sqrMod(FieldP, x), x);
+  const Limbs x_3 = addMod(FieldP, addMod(FieldP, x, x), x);
+  return sqrMod(FieldP, y) == addMod(FieldP, subMod(FieldP, x3, x_3), CurveB);
+}
+
+} // namespace
+
+P256TableConstSharedPtr P256Table::build(const uint8_t* x, const uint8_t* y) {
+  const Limbs ax = fromBytes(x);
+  const Limbs ay = fromBytes(y);
+  if (!lessThan(ax, FieldP.m_) || !lessThan(ay, FieldP.m_)) {
+    return nullptr;
+  }
+  const Limbs mx = toMont(FieldP, ax);
+  const Limbs my = toMont(FieldP, ay);
+  if (!onCurve(mx, my)) {
+    return nullptr;
+  }
+
+  // Built on first use, which is the first key table, on the JWKS parse thread.
+  generator();
+  return buildTable(mx, my);
+}
+
+const P256Table& P256Table::generator() {
+  static const P256TableConstSharedPtr table =
+      buildTable(toMont(FieldP, fromBytes(GeneratorX)), toMont(FieldP, fromBytes(GeneratorY)));
+  return *table;
+}
+
+P256TableConstSharedPtr P256Table::buildTable(const Limbs& x, const Limbs& y) {
+  // Every digit multiple of every window base, in Jacobian coordinates first. The window's base is
+  // normalized on its own, as the multiples are built with mixed additions of it.
+  std::vector<JacobianPoint> multiples(Windows * Digits);
+  AffinePoint base{x, y};
+  for (size_t window = 0; window < Windows; window++) {
+    JacobianPoint acc{};
+    for (size_t digit = 1; digit <= Digits; digit++) {
+      addAffine(acc, base.x_, base.y_);
+      multiples[window * Digits + digit - 1] = acc;
+    }
+    if (window + 1 == Windows) {
+      break;
+    }
+    // 2^TableWindow * base = (2^TableWindow - 1) * base + base.
+    addAffine(acc, base.x_, base.y_);
+    const Limbs zinv = invP(acc.z_);
+    const Limbs zinv2 = sqrMod(FieldP, zinv);
+    base.x_ = mulMod(FieldP, acc.x_, zinv2);
+    base.y_ = mulMod(FieldP, acc.y_, mulMod(FieldP, zinv2, zinv));
+  }
+
+  // Then to affine with a single inversion (Montgomery's trick). None of the multiples can be the
+  // point at infinity: digit * 2^(TableWindow * window) is never a multiple of the group order.
+  std::vector<Limbs> prefix(multiples.size());
+  Limbs running = One;
+  for (size_t i = 0; i < multiples.size(); i++) {
+    prefix[i] = running;
+    running = mulMod(FieldP, running, multiples[i].z_);
+  }
+  Limbs inverse = invP(running);
+
+  std::shared_ptr<P256Table> table(new P256Table());
+  table->points_.resize(multiples.size());
+  for (size_t i = multiples.size(); i-- > 0;) {
+    const Limbs zinv = mulMod(FieldP, inverse, prefix[i]);
+    inverse = mulMod(FieldP, inverse, multiples[i].z_);
+    const Limbs zinv2 = sqrMod(FieldP, zinv);
+    table->points_[i].x_ = mulMod(FieldP, multiples[i].x_, zinv2);
+    table->points_[i].y_ = mulMod(FieldP, multiples[i].y_, mulMod(FieldP, zinv2, zinv));
+  }
+  return table;
+}
+
+bool P256Table::verify(const uint8_t* digest, const uint8_t* signature, size_t size) const {
+  Limbs r, s;
+  if (size != 64 || !parseSignature(signature, r, s)) {
+    return false;
+  }
+
+  // u1 = e / s, u2 = r / s, both in normal form: mulMod(xR, w) = x w.
+  const Limbs w = invBinary(OrderN, s);
+  return check(mulMod(OrderN, toMont(OrderN, digestScalar(digest)), w),
+               mulMod(OrderN, toMont(OrderN, r), w), r);
+}
+
+void P256Table::verifyBatch(std::vector<BatchSignature>& batch) {
+  // Every valid s in Montgomery form, and the running product of the ones before it.
+  std::vector<Limbs> r(batch.size());
+  std::vector<Limbs> s(batch.size());
+  std::vector<Limbs> prefix(batch.size());
+  Limbs product = toMont(OrderN, Limbs{1, 0, 0, 0});
+  bool any = false;
+  for (size_t i = 0; i < batch.size(); i++) {
+    batch[i].valid_ = parseSignature(batch[i].signature_, r[i], s[i]);
+    if (!batch[i].valid_) {
+      continue;
+    }
+    s[i] = toMont(OrderN, s[i]);
+    prefix[i] = product;
+    product = mulMod(OrderN, product, s[i]);
+    any = true;
+  }
+  if (!any) {
+    return;
+  }
+
+  // invBinary() gives the plain inverse of the product's Montgomery form, 1 / (s1..sk R), two
+  // multiplications by R^2 take it to (s1..sk)^-1 R. Then walk back, peeling one s off at a time.
+  Limbs inverse =
+      mulMod(OrderN, mulMod(OrderN, invBinary(OrderN, product), OrderN.rr_), OrderN.rr_);
+  for (size_t i = batch.size(); i-- > 0;) {
+    if (!batch[i].valid_) {
+      continue;
+    }
+    // w = s^-1 R, so mulMod(x, w) = x / s in normal form.
+    const Limbs w = mulMod(OrderN, inverse, prefix[i]);
+    inverse = mulMod(OrderN, inverse, s[i]);
+    batch[i].valid_ = batch[i].table_->check(mulMod(OrderN, digestScalar(batch[i].digest_), w),
+                                             mulMod(OrderN, r[i], w), r[i]);
+  }
+}
+
+bool P256Table::check(const Limbs& u1, const Limbs& u2, const Limbs& r) const {
+  const P256Table& g = generator();
+  JacobianPoint acc{};
+  for (size_t window = 0; window < Windows; window++) {
+    const size_t bit = window * TableWindow;
+    const size_t limb = bit / 64;
+    const size_t shift = bit % 64;
+    uint64_t d1 = u1[limb] >> shift;
+    uint64_t d2 = u2[limb] >> shift;
+    if (shift + TableWindow > 64 && limb < 3) {
+      d1 |= u1[limb + 1] << (64 - shift);
+      d2 |= u2[limb + 1] << (64 - shift);
+    }
+    d1 &= Digits;
+    d2 &= Digits;
+    if (d1) {
+      const AffinePoint& p = g.point(window, d1);
+      addAffine(acc, p.x_, p.y_);
+    }
+    if (d2) {
+      const AffinePoint& p = point(window, d2);
+      addAffine(acc, p.x_, p.y_);
+    }
+  }
+  if (acc.infinity()) {
+    return false;
+  }
+
+  // x(acc) mod n == r, without leaving Jacobian coordinates: x = X/Z^2 is r or r + n (when that is
+  // still below p).
+  const Limbs zz = sqrMod(FieldP, acc.z_);
+  if (mulMod(FieldP, toMont(FieldP, r), zz) == acc.x_) {
+    return true;
+  }
+  Limbs rn;
+  if (addLimbs(r, OrderN.m_, rn) || !lessThan(rn, FieldP.m_)) {
+    return false;
+  }
+  return mulMod(FieldP, toMont(FieldP, rn), zz) == acc.x_;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+class P256Table;
+typedef std::shared_ptr<const P256Table> P256TableConstSharedPtr;
+
+/**
+ * Precomputed multiples of a P-256 public point, for verifying ES256 signatures without the
+ * variable-base scalar multiplication EVP does on every call.
+ *
+ * The scalar is split into TableWindow bit windows and the table holds every nonzero digit times
+ * each window's base, in affine coordinates, so a multiplication is one mixed addition per window
+ * and no doublings. The generator gets the same treatment (built once per process), making u1*G +
+ * u2*Q two fixed-base multiplications that share an accumulator. Verification only handles public
+ * values, so none of this is constant time. Signing must never use it.
+ *
+ * With 8 bit windows a table is 32 * 255 points, 510KB, and a verify is 64 mixed additions.
+ */
+class P256Table {
+public:
+  // 4 x 64 bit limbs, least significant first.
+  typedef std::array<uint64_t, 4> Limbs;
+
+  static const size_t TableWindow = 8;
+  static const size_t Windows = (256 + TableWindow - 1) / TableWindow;
+  static const size_t Digits = (1 << TableWindow) - 1;
+
+  // Builds the table for the affine point (x, y), 32 byte big endian coordinates. Returns nullptr
+  // if the point is not on the curve. Takes a few milliseconds, keep it off the workers.
+  static P256TableConstSharedPtr build(const uint8_t* x, const uint8_t* y);
+
+  // Verifies the JWS encoding of an ECDSA signature (32 byte big endian r || s) over a SHA-256
+  // `digest` with the table's point.
+  bool verify(const uint8_t* digest, const uint8_t* signature, size_t size) const;
+
+  // One signature of a batch, see verifyBatch().
+  struct BatchSignature {
+    const P256Table* table_;
+    uint8_t digest_[32];
+    uint8_t signature_[64];
+    bool valid_;
+  };
+
+  // Sets valid_ on every signature of `batch` as verify() would, but with one modular inversion
+  // for the whole batch (Montgomery's trick) instead of one per signature. Signatures are checked
+  // in order, sort the batch by table to walk each table once.
+  static void verifyBatch(std::vector<BatchSignature>& batch);
+
+  size_t bytes() const { return points_.size() * sizeof(AffinePoint); }
+
+private:
+  // Field elements are kept in Montgomery form.
+  struct AffinePoint {
+    Limbs x_;
+    Limbs y_;
+  };
+
+  P256Table() {}
+
+  static const P256Table& generator();
+  static P256TableConstSharedPtr buildTable(const Limbs& x, const Limbs& y);
+
+  // x(u1 * G + u2 * Q) mod n == r.
+  bool check(const Limbs& u1, const Limbs& u2, const Limbs& r) const;
+
+  const AffinePoint& point(size_t window, size_t digit) const {
+    return points_[window * Digits + digit - 1];
+  }
+
+  std::vector<AffinePoint> points_;
+};
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -2,8 +2,24 @@
 #include "test/integration/utility.h"
 #include "../sft_filter.h"
 
+#include <chrono>
+#include <thread>
+
 namespace Envoy {
 
+// aud1, signed with the first key.
+const std::string ValidJwt1 =
+    "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+    "eyJhdWQiOlsiYXVkMSJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMSIsInN1YiI6In"
+    "N1YjEifQ."
+    "6VI2lPN09XWiszKN_ioIDAPYpE9Eeu_6s1nN7dnPpjtQBK2m8VfqN5bqSCJ-ZFvM3jeRSvZtS3CJV5ZwPd-t1w";
+// aud2, signed with the second key.
+const std::string ValidJwt2 =
+    "eyJhbGciOiJFUzI1NiIsImtpZCI6ImVlZmRmODc5LWM5NDEtNDcwMS1iZDVkLWYzNTdiZmY3Nzk4ZCJ9."
+    "eyJhdWQiOlsiYXVkMiJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMiIsInN1YiI6In"
+    "N1YjIifQ."
+    "HeXTyMXfUM7J_reCkGI3OnbfXc7HbUpz98knlBmwu39CNHx90r4qUbe3KwpLl54P9UiF2PkfOfhUo0NlA6gYlQ";
+
 class SFTFilterIntegrationTestBase : public HttpIntegrationTest,
                                      public testing::TestWithParam<Network::Address::IpVersion> {
 public:
@@ -14,7 +30,9 @@ public:
   void SetUp() override {
     fake_upstreams_.emplace_back(new FakeUpstream(0, FakeHttpConnection::Type::HTTP1, version_));
     registerPort("upstream_0", fake_upstreams_.back()->localAddress()->ip()->port());
-    createTestServer("src/sft/integration_test/envoy.conf", {"http"});
+    // The other listeners are "http" plus optional features, see envoy.conf.
+    createTestServer("src/sft/integration_test/envoy.conf",
+                     {"http", "http_features", "http_rate_limit", "http_shed", "http_body_digest"});
   }
 
   void TearDown() override {
@@ -31,6 +49,10 @@ protected:
     return Http::TestHeaderMapImpl{{":method", "GET"}, {":path", path}, {":authority", "host"}};
   }
 
+  Http::TestHeaderMapImpl HostRequestHeaders(const std::string& host, const std::string& path) {
+    return Http::TestHeaderMapImpl{{":method", "GET"}, {":path", path}, {":authority", host}};
+  }
+
   Http::TestHeaderMapImpl createHeaders(const std::string& token) {
     auto headers = BaseRequestHeaders();
     headers.addCopy("Authenticated-User-Jwt", token);
@@ -65,13 +87,13 @@ protected:
 
   void TestVerification(const Http::HeaderMap& request_headers, const std::string& request_body,
                         bool verification_success, const Http::HeaderMap& expected_headers,
-                        const std::string& expected_body) {
+                        const std::string& expected_body, const std::string& port = "http") {
     IntegrationCodecClientPtr codec_client;
     FakeHttpConnectionPtr fake_upstream_connection_backend;
     FakeStreamPtr request_stream_backend;
     IntegrationStreamDecoderPtr response(new IntegrationStreamDecoder(*dispatcher_));
 
-    codec_client = makeHttpConnection(lookupPort("http"));
+    codec_client = makeHttpConnection(lookupPort(port));
 
     // Send a request to Envoy.
     if (!request_body.empty()) {
@@ -115,6 +137,49 @@ protected:
 
     codec_client->close();
   }
+
+  // Sends a header only request to `port`. If it is let through the upstream answers with a 200.
+  IntegrationStreamDecoderPtr SendRequest(const Http::HeaderMap& request_headers,
+                                          bool verification_success,
+                                          const std::string& port = "http") {
+    IntegrationStreamDecoderPtr response(new IntegrationStreamDecoder(*dispatcher_));
+    IntegrationCodecClientPtr codec_client = makeHttpConnection(lookupPort(port));
+    codec_client->makeHeaderOnlyRequest(request_headers, *response);
+
+    if (verification_success) {
+      FakeHttpConnectionPtr fake_upstream_connection_backend =
+          fake_upstreams_[0]->waitForHttpConnection(*dispatcher_);
+      FakeStreamPtr request_stream_backend =
+          fake_upstream_connection_backend->waitForNewStream(*dispatcher_);
+      request_stream_backend->waitForEndStream(*dispatcher_);
+      request_stream_backend->encodeHeaders(Http::TestHeaderMapImpl{{":status", "200"}}, true);
+      response->waitForEndStream();
+      fake_upstream_connection_backend->close();
+      fake_upstream_connection_backend->waitForDisconnect();
+    } else {
+      response->waitForEndStream();
+    }
+
+    codec_client->close();
+    return response;
+  }
+
+  // The `name=value` part of the response's Set-Cookie, empty if it has none.
+  std::string SessionCookie(const IntegrationStreamDecoder& response) {
+    const Http::HeaderEntry* set_cookie =
+        response.headers().get(Http::LowerCaseString("set-cookie"));
+    if (!set_cookie) {
+      return "";
+    }
+    const std::string value = set_cookie->value().c_str();
+    return value.substr(0, value.find(';'));
+  }
+
+  Http::TestHeaderMapImpl CookieHeaders(const std::string& cookie, const std::string& path = "/") {
+    auto headers = BaseRequestHeaders(path);
+    headers.addCopy("Cookie", cookie);
+    return headers;
+  }
 };
 
 class SFTVerificationFilterIntegrationTest : public SFTFilterIntegrationTestBase {};
@@ -298,6 +363,456 @@ TEST_P(SFTVerificationFilterIntegrationTest, InvalidJWTAudienceMismatch) {
       Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH));
 }
 
+// Denylist: a token whose jti isn't revoked.
+TEST_P(SFTVerificationFilterIntegrationTest, DenylistNotRevoked) {
+  const std::string jwt = "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFh"
+                          "ZGIwZCJ9."
+                          "eyJhdWQiOlsiYXVkMSJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0"
+                          "aSI6ImlkMSIsInN1YiI6InN1YjEifQ.6VI2lPN09XWiszKN_ioIDAPYpE9Eeu_"
+                          "6s1nN7dnPpjtQBK2m8VfqN5bqSCJ-ZFvM3jeRSvZtS3CJV5ZwPd-t1w";
+
+  auto expected_headers = BaseRequestHeaders();
+  expected_headers.addCopy("authenticated-user-jwt", jwt);
+
+  TestVerification(createHeaders(jwt), "", true, expected_headers, "", "http_features");
+}
+
+// Denylist: a valid token whose jti is revoked.
+TEST_P(SFTVerificationFilterIntegrationTest, DenylistRevokedJti) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJpc3MiOiJpc3MxIiwianRpIjoicmV2b2tlZDEiLCJzdWIiOiJzdWIzIn0."
+      "Rc6HJieW9fpLv1INURwqD69eCySB4x-fwJDOr8hXMJ5jUkBoTipSitFl_zKIg6gBJFlyq8d80BAE2x4TIDF5yQ";
+
+  TestVerification(
+      createHeaders(jwt), "", false, Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_REVOKED),
+      "http_features");
+
+  // The listener without a denylist accepts it.
+  auto expected_headers = BaseRequestHeaders();
+  expected_headers.addCopy("authenticated-user-jwt", jwt);
+  TestVerification(createHeaders(jwt), "", true, expected_headers, "");
+}
+
+// Denylist: a valid token whose sub is revoked.
+TEST_P(SFTVerificationFilterIntegrationTest, DenylistRevokedSub) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6ImVlZmRmODc5LWM5NDEtNDcwMS1iZDVkLWYzNTdiZmY3Nzk4ZCJ9."
+      "eyJhdWQiOlsiYXVkMiJdLCJpc3MiOiJpc3MxIiwianRpIjoiaWQ5Iiwic3ViIjoicmV2b2tlZC1zdWIifQ."
+      "GXxK_p5-6_fOktpxRmp5vM-YlIy6Ae9RXZHvigf3ewIGR-q0j54GcvRVGgS3yhvRREnkMfj1DooIu3f2dzykWg";
+
+  TestVerification(
+      createHeaders(jwt), "", false, Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_REVOKED),
+      "http_features");
+}
+
+// Session cookie: issued for a valid token and accepted in its place.
+TEST_P(SFTVerificationFilterIntegrationTest, SessionCookieRoundTrip) {
+  const std::string jwt = "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFh"
+                          "ZGIwZCJ9."
+                          "eyJhdWQiOlsiYXVkMSJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0"
+                          "aSI6ImlkMSIsInN1YiI6InN1YjEifQ.6VI2lPN09XWiszKN_ioIDAPYpE9Eeu_"
+                          "6s1nN7dnPpjtQBK2m8VfqN5bqSCJ-ZFvM3jeRSvZtS3CJV5ZwPd-t1w";
+
+  IntegrationStreamDecoderPtr response = SendRequest(createHeaders(jwt), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+  const std::string cookie = SessionCookie(*response);
+  ASSERT_EQ(0U, cookie.find("sft_session="));
+
+  // The cookie alone is enough.
+  response = SendRequest(CookieHeaders(cookie), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+  EXPECT_EQ("", SessionCookie(*response));
+
+  // A tampered one isn't.
+  std::string tampered = cookie;
+  tampered.back() = tampered.back() == 'A' ? 'B' : 'A';
+  response = SendRequest(CookieHeaders(tampered), false);
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT),
+            response->body());
+}
+
+// Session cookie: issued for a token whose jti was revoked since.
+TEST_P(SFTVerificationFilterIntegrationTest, SessionCookieRevokedJti) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJpc3MiOiJpc3MxIiwianRpIjoicmV2b2tlZDEiLCJzdWIiOiJzdWIzIn0."
+      "Rc6HJieW9fpLv1INURwqD69eCySB4x-fwJDOr8hXMJ5jUkBoTipSitFl_zKIg6gBJFlyq8d80BAE2x4TIDF5yQ";
+
+  // Both listeners share the cookie secret, only "http_features" has the denylist.
+  const std::string cookie = SessionCookie(*SendRequest(createHeaders(jwt), true));
+  ASSERT_EQ(0U, cookie.find("sft_session="));
+
+  IntegrationStreamDecoderPtr response = SendRequest(CookieHeaders(cookie), false, "http_features");
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_REVOKED),
+            response->body());
+}
+
+// Session cookie: only accepted on routes with the issuer and audiences it was issued under.
+TEST_P(SFTVerificationFilterIntegrationTest, SessionCookieRoutePolicy) {
+  // aud1, accepted on "/" but not on "/aud2" (see envoy.conf).
+  const std::string jwt1 =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMSIsInN1Yi"
+      "I6InN1YjEifQ."
+      "6VI2lPN09XWiszKN_ioIDAPYpE9Eeu_6s1nN7dnPpjtQBK2m8VfqN5bqSCJ-ZFvM3jeRSvZtS3CJV5ZwPd-t1w";
+  // aud2, accepted on "/aud2".
+  const std::string jwt2 =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6ImVlZmRmODc5LWM5NDEtNDcwMS1iZDVkLWYzNTdiZmY3Nzk4ZCJ9."
+      "eyJhdWQiOlsiYXVkMiJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMiIsInN1Yi"
+      "I6InN1YjIifQ."
+      "HeXTyMXfUM7J_reCkGI3OnbfXc7HbUpz98knlBmwu39CNHx90r4qUbe3KwpLl54P9UiF2PkfOfhUo0NlA6gYlQ";
+
+  auto headers1 = BaseRequestHeaders("/aud2");
+  headers1.addCopy("Authenticated-User-Jwt", jwt1);
+  IntegrationStreamDecoderPtr response = SendRequest(headers1, false);
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(
+                Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH),
+            response->body());
+
+  // A cookie issued on "/" doesn't stand in for the token on "/aud2".
+  const std::string cookie1 = SessionCookie(*SendRequest(createHeaders(jwt1), true));
+  ASSERT_EQ(0U, cookie1.find("sft_session="));
+  response = SendRequest(CookieHeaders(cookie1, "/aud2"), false);
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT),
+            response->body());
+
+  // One issued on "/aud2" does.
+  auto headers2 = BaseRequestHeaders("/aud2");
+  headers2.addCopy("Authenticated-User-Jwt", jwt2);
+  const std::string cookie2 = SessionCookie(*SendRequest(headers2, true));
+  ASSERT_EQ(0U, cookie2.find("sft_session="));
+  response = SendRequest(CookieHeaders(cookie2, "/aud2"), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+}
+
+// Route policy: "/public" disables auth, tokens aren't even looked at.
+TEST_P(SFTVerificationFilterIntegrationTest, RouteAuthDisabled) {
+  IntegrationStreamDecoderPtr response = SendRequest(BaseRequestHeaders("/public"), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  auto headers = BaseRequestHeaders("/public");
+  headers.addCopy("Authenticated-User-Jwt", "invalid");
+  response = SendRequest(headers, true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  // Nor is a session cookie issued for a valid one.
+  headers = BaseRequestHeaders("/public");
+  headers.addCopy("Authenticated-User-Jwt", ValidJwt1);
+  response = SendRequest(headers, true);
+  EXPECT_EQ("", SessionCookie(*response));
+}
+
+// Route policy: "/optional" lets requests without a token through, but still checks one that is
+// presented.
+TEST_P(SFTVerificationFilterIntegrationTest, RouteAuthOptional) {
+  IntegrationStreamDecoderPtr response = SendRequest(BaseRequestHeaders("/optional"), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  auto headers = BaseRequestHeaders("/optional");
+  headers.addCopy("Authenticated-User-Jwt", "invalid");
+  response = SendRequest(headers, false);
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_MALFORMED),
+            response->body());
+
+  headers = BaseRequestHeaders("/optional");
+  headers.addCopy("Authenticated-User-Jwt", ValidJwt1);
+  response = SendRequest(headers, true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+  EXPECT_EQ(0U, SessionCookie(*response).find("sft_session="));
+}
+
+// Virtual host policy: "open" disables auth (see `virtual_host_policies` in envoy.conf), except
+// on its "/required" route.
+TEST_P(SFTVerificationFilterIntegrationTest, VirtualHostAuthDisabled) {
+  IntegrationStreamDecoderPtr response =
+      SendRequest(HostRequestHeaders("open.example.com", "/"), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  auto headers = HostRequestHeaders("open.example.com", "/");
+  headers.addCopy("Authenticated-User-Jwt", "invalid");
+  response = SendRequest(headers, true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  response = SendRequest(HostRequestHeaders("open.example.com", "/required"), false);
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT),
+            response->body());
+}
+
+// Virtual host policy: "anonymous" makes auth optional and only accepts aud2.
+TEST_P(SFTVerificationFilterIntegrationTest, VirtualHostAuthOptional) {
+  IntegrationStreamDecoderPtr response =
+      SendRequest(HostRequestHeaders("anonymous.example.com", "/"), true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  auto headers = HostRequestHeaders("anonymous.example.com", "/");
+  headers.addCopy("Authenticated-User-Jwt", ValidJwt1);
+  response = SendRequest(headers, false);
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+  EXPECT_EQ(Http::Sft::VerifyStatusToString(
+                Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH),
+            response->body());
+
+  headers = HostRequestHeaders("anonymous.example.com", "/");
+  headers.addCopy("Authenticated-User-Jwt", ValidJwt2);
+  response = SendRequest(headers, true);
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+}
+
+// Rate limiting: "http_rate_limit" allows a burst of 2 per jti, cookie requests included.
+TEST_P(SFTVerificationFilterIntegrationTest, RateLimited) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMSIsInN1Yi"
+      "I6InN1YjEifQ."
+      "6VI2lPN09XWiszKN_ioIDAPYpE9Eeu_6s1nN7dnPpjtQBK2m8VfqN5bqSCJ-ZFvM3jeRSvZtS3CJV5ZwPd-t1w";
+  const std::string other_jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6ImVlZmRmODc5LWM5NDEtNDcwMS1iZDVkLWYzNTdiZmY3Nzk4ZCJ9."
+      "eyJhdWQiOlsiYXVkMiJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMiIsInN1Yi"
+      "I6InN1YjIifQ."
+      "HeXTyMXfUM7J_reCkGI3OnbfXc7HbUpz98knlBmwu39CNHx90r4qUbe3KwpLl54P9UiF2PkfOfhUo0NlA6gYlQ";
+
+  const std::string cookie =
+      SessionCookie(*SendRequest(createHeaders(jwt), true, "http_rate_limit"));
+  ASSERT_EQ(0U, cookie.find("sft_session="));
+  IntegrationStreamDecoderPtr response =
+      SendRequest(CookieHeaders(cookie), true, "http_rate_limit");
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+
+  // A cookie issued without rate limiting doesn't carry a jti to limit on.
+  const std::string unlimited_cookie = SessionCookie(*SendRequest(createHeaders(jwt), true));
+  ASSERT_EQ(0U, unlimited_cookie.find("sft_session="));
+  response = SendRequest(CookieHeaders(unlimited_cookie), false, "http_rate_limit");
+  EXPECT_STREQ("401", response->headers().Status()->value().c_str());
+
+  // The cookie shares the token's bucket. A rejected token isn't issued a cookie.
+  response = SendRequest(CookieHeaders(cookie), false, "http_rate_limit");
+  EXPECT_STREQ("429", response->headers().Status()->value().c_str());
+  response = SendRequest(createHeaders(jwt), false, "http_rate_limit");
+  EXPECT_STREQ("429", response->headers().Status()->value().c_str());
+  EXPECT_EQ("", SessionCookie(*response));
+
+  // Another jti has its own.
+  response = SendRequest(createHeaders(other_jwt), true, "http_rate_limit");
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+}
+
+// Load shedding: "http_shed" sheds once its cold verifications average more than 1us, which the
+// first one does. Session cookies don't need a signature check and are still served.
+TEST_P(SFTVerificationFilterIntegrationTest, Shed) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMSIsInN1Yi"
+      "I6InN1YjEifQ."
+      "6VI2lPN09XWiszKN_ioIDAPYpE9Eeu_6s1nN7dnPpjtQBK2m8VfqN5bqSCJ-ZFvM3jeRSvZtS3CJV5ZwPd-t1w";
+
+  const std::string cookie = SessionCookie(*SendRequest(createHeaders(jwt), true, "http_shed"));
+  ASSERT_EQ(0U, cookie.find("sft_session="));
+
+  IntegrationStreamDecoderPtr response = SendRequest(createHeaders(jwt), false, "http_shed");
+  EXPECT_STREQ("503", response->headers().Status()->value().c_str());
+  const Http::HeaderEntry* retry_after =
+      response->headers().get(Http::LowerCaseString("retry-after"));
+  ASSERT_NE(nullptr, retry_after);
+  EXPECT_STREQ("7", retry_after->value().c_str());
+
+  response = SendRequest(CookieHeaders(cookie), true, "http_shed");
+  EXPECT_STREQ("200", response->headers().Status()->value().c_str());
+}
+
+// Body binding: "http_body_digest" only lets the token through with the body its body_sha256
+// claim holds the digest of.
+TEST_P(SFTVerificationFilterIntegrationTest, BodyDigest) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJib2R5X3NoYTI1NiI6InNoYS0yNTY9OjRvSUdkVFdsU0ltb2xQMTM3MkNxbldJUXhiZG4y"
+      "ei9NZUltNVpJdjF1dFE9OiIsImlzcyI6ImlzczEiLCJqdGkiOiJpZDEiLCJzdWIiOiJzdWIxIn0."
+      "xCBEAMFWgj2ktuAb2ryA3Q2p5qD_iR4SElUgWErnn5zTageJHc_Vg2FyHmSDTGlhvRNl2vD5OLuX_CwjQZrlKA";
+  const std::string body = "{\"amount\":100,\"to\":\"acct-2\"}";
+
+  Http::TestHeaderMapImpl headers{
+      {":method", "POST"}, {":path", "/"}, {":authority", "host"}, {"authenticated-user-jwt", jwt}};
+  TestVerification(headers, body, true, headers, body, "http_body_digest");
+}
+
+TEST_P(SFTVerificationFilterIntegrationTest, BodyDigestMismatch) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJib2R5X3NoYTI1NiI6InNoYS0yNTY9OjRvSUdkVFdsU0ltb2xQMTM3MkNxbldJUXhiZG4y"
+      "ei9NZUltNVpJdjF1dFE9OiIsImlzcyI6ImlzczEiLCJqdGkiOiJpZDEiLCJzdWIiOiJzdWIxIn0."
+      "xCBEAMFWgj2ktuAb2ryA3Q2p5qD_iR4SElUgWErnn5zTageJHc_Vg2FyHmSDTGlhvRNl2vD5OLuX_CwjQZrlKA";
+
+  Http::TestHeaderMapImpl headers{
+      {":method", "POST"}, {":path", "/"}, {":authority", "host"}, {"authenticated-user-jwt", jwt}};
+  TestVerification(
+      headers, "{\"amount\":900,\"to\":\"acct-3\"}", false,
+      Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST),
+      "http_body_digest");
+}
+
+// Claims: a single string "aud" is as good as an array holding it.
+TEST_P(SFTVerificationFilterIntegrationTest, ValidJWTStringAudience) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOiJhdWQxIiwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMSIsInN1YiI6InN1YjEifQ."
+      "B6PxPO8f4s6wSrYEDdgtspV4PH_C9fzzuGude2frYwvZ4Mo318k2kBZfTJzwMZFk88T6ABp2OQgCJ3Kf0Plqag";
+
+  auto expected_headers = BaseRequestHeaders();
+  expected_headers.addCopy("authenticated-user-jwt", jwt);
+
+  TestVerification(createHeaders(jwt), "", true, expected_headers, "");
+}
+
+// Claims: "aud" is a number.
+TEST_P(SFTVerificationFilterIntegrationTest, InvalidJWTAudienceType) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOjUsImlzcyI6ImlzczEiLCJqdGkiOiJpZDEiLCJzdWIiOiJzdWIxIn0."
+      "TdpeXjIKhbX-AHaUZrMq9kYzLjpl8kF3WZ51uEPLCGJiO_5XNHxwzRCVKnk3-lNSk_m6f3rIlu3Dt0SH5FMQ8w";
+
+  TestVerification(
+      createHeaders(jwt), "", false, Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH));
+}
+
+// Claims: "iss" is a number.
+TEST_P(SFTVerificationFilterIntegrationTest, InvalidJWTIssuerType) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJpc3MiOjUsImp0aSI6ImlkMSIsInN1YiI6InN1YjEifQ."
+      "5bwiojOUgadt0ms_sk83ybvWRkOAeDjXKdMYsabkBNQa_UZvs7XZP9ZsQk3lxo7scFEvoCeYX-8fXod-w7fX7w";
+
+  TestVerification(
+      createHeaders(jwt), "", false, Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH));
+}
+
+// Claims: "exp" is a string, which is never treated as unexpired.
+TEST_P(SFTVerificationFilterIntegrationTest, InvalidJWTExpirationType) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMSJdLCJleHAiOiI0MTAyNDQ0ODAwIiwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMSIsInN1YiI6InN1"
+      "YjEifQ."
+      "5_CTPoXRps1_AV32aWOSfgVWUdBcOld5azvTNwcUDg-uBHkgqNCxoT4QLt4UNgCUbuFidBInGOk-wDFNq61sZQ";
+
+  TestVerification(
+      createHeaders(jwt), "", false, Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_EXPIRED));
+}
+
+// Claims: "aud" appears twice, so which one applies is ambiguous.
+TEST_P(SFTVerificationFilterIntegrationTest, InvalidJWTDuplicateClaim) {
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6IjY1Mjg5YjE5LWUwYzYtNDkxOC04OTMzLTc5NjE3ODFhZGIwZCJ9."
+      "eyJhdWQiOlsiYXVkMiJdLCJhdWQiOlsiYXVkMSJdLCJpc3MiOiJpc3MxIiwianRpIjoiaWQxIiwic3ViIjoic3ViMSJ9"
+      "."
+      "-q98-P6vDUMGG5kQPJew4-8Z1p08dStCWlksuKDzdSoJ97H7UosPWFjoZFmjJ4w2roWbLM0cZzLUPcCctTDtsg";
+
+  TestVerification(
+      createHeaders(jwt), "", false, Http::TestHeaderMapImpl{{":status", "401"}},
+      Http::Sft::VerifyStatusToString(Http::Sft::VerifyStatus::JWT_VERIFY_FAIL_MALFORMED));
+}
+
 // TODO(morgabra) exp and nbf tests - need to figure out how to mock time.
 
+// Fetches its keys from "upstream_1", see envoy_jwks.conf.
+class SFTJwksRefetchIntegrationTest : public SFTFilterIntegrationTestBase {
+public:
+  void SetUp() override {
+    fake_upstreams_.emplace_back(new FakeUpstream(0, FakeHttpConnection::Type::HTTP1, version_));
+    registerPort("upstream_0", fake_upstreams_.back()->localAddress()->ip()->port());
+    fake_upstreams_.emplace_back(new FakeUpstream(0, FakeHttpConnection::Type::HTTP1, version_));
+    registerPort("upstream_1", fake_upstreams_.back()->localAddress()->ip()->port());
+    createTestServer("src/sft/integration_test/envoy_jwks.conf", {"http"});
+  }
+
+protected:
+  void RespondJwks(FakeStream& fetch, const std::string& jwks) {
+    fetch.waitForEndStream(*dispatcher_);
+    fetch.encodeHeaders(Http::TestHeaderMapImpl{{":status", "200"}}, false);
+    Buffer::OwnedImpl body(jwks);
+    fetch.encodeData(body, true);
+  }
+
+  void WaitForCounter(const std::string& name, uint64_t value) {
+    while (!test_server_->counter(name) || test_server_->counter(name)->value() < value) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+};
+
+INSTANTIATE_TEST_CASE_P(IpVersions, SFTJwksRefetchIntegrationTest,
+                        testing::ValuesIn(TestEnvironment::getIpVersionsForTest()));
+
+// Kid miss: requests for a kid published after the fetch in flight was sent are paused until a
+// fetch made after the miss has the kid, with a single refetch between them.
+TEST_P(SFTJwksRefetchIntegrationTest, KidMissDuringFetch) {
+  const std::string key1 = R"({"kty": "EC", "kid": "65289b19-e0c6-4918-8933-7961781adb0d",
+      "crv": "P-256", "alg": "ES256", "x": "NlKjrC2WShZ1_Vge_NnnlI_AvyS4O8-Fe6FjD4ulZ_8",
+      "y": "dyDmVlk98cXnTnggviphJYDmEQNacdCzcAOoLuUWqGY"})";
+  const std::string key2 = R"({"kty": "EC", "kid": "eefdf879-c941-4701-bd5d-f357bff7798d",
+      "crv": "P-256", "alg": "ES256", "x": "EawrkuYeV-Bjzab97rDIah46eCiYSJJ0lZIWd74OfJ8",
+      "y": "n6QyeaqQ1VvX6YKlMWTGxRvx_qZ0_mv-n2SFjhoa_Dk"})";
+  // Signed with key2.
+  const std::string jwt =
+      "eyJhbGciOiJFUzI1NiIsImtpZCI6ImVlZmRmODc5LWM5NDEtNDcwMS1iZDVkLWYzNTdiZmY3Nzk4ZCJ9."
+      "eyJhdWQiOlsiYXVkMiJdLCJpYXQiOjEuNTEwOTg5NTYxZSswOSwiaXNzIjoiaXNzMSIsImp0aSI6ImlkMiIsInN1Yi"
+      "I6InN1YjIifQ."
+      "HeXTyMXfUM7J_reCkGI3OnbfXc7HbUpz98knlBmwu39CNHx90r4qUbe3KwpLl54P9UiF2PkfOfhUo0NlA6gYlQ";
+
+  // The startup fetch is in flight.
+  FakeHttpConnectionPtr jwks_connection = fake_upstreams_[1]->waitForHttpConnection(*dispatcher_);
+  FakeStreamPtr fetch = jwks_connection->waitForNewStream(*dispatcher_);
+
+  // Both requests miss and are paused on one refetch.
+  std::vector<IntegrationCodecClientPtr> clients;
+  std::vector<IntegrationStreamDecoderPtr> responses;
+  for (size_t i = 0; i < 2; i++) {
+    clients.push_back(makeHttpConnection(lookupPort("http")));
+    responses.emplace_back(new IntegrationStreamDecoder(*dispatcher_));
+    clients.back()->makeHeaderOnlyRequest(createHeaders(jwt), *responses.back());
+  }
+  WaitForCounter("http.ingress_http.downstream_rq_total", 2);
+  EXPECT_EQ(1U, test_server_->counter("scaleft.accessfabric.jwks_kid_miss_fetch")->value());
+
+  // The fetch in flight was sent before the misses, and its key set doesn't have the kid yet. The
+  // requests keep waiting on another fetch rather than being rejected with it.
+  RespondJwks(*fetch, "{\"keys\": [" + key1 + "]}");
+  fetch = jwks_connection->waitForNewStream(*dispatcher_);
+  EXPECT_FALSE(responses[0]->complete());
+  EXPECT_FALSE(responses[1]->complete());
+  RespondJwks(*fetch, "{\"keys\": [" + key1 + ", " + key2 + "]}");
+
+  // Both are resumed with the new key set and let through.
+  std::vector<FakeHttpConnectionPtr> upstream_connections;
+  for (size_t i = 0; i < 2; i++) {
+    upstream_connections.push_back(fake_upstreams_[0]->waitForHttpConnection(*dispatcher_));
+    FakeStreamPtr request = upstream_connections.back()->waitForNewStream(*dispatcher_);
+    request->waitForEndStream(*dispatcher_);
+    request->encodeHeaders(Http::TestHeaderMapImpl{{":status", "200"}}, true);
+  }
+  for (size_t i = 0; i < 2; i++) {
+    responses[i]->waitForEndStream();
+    EXPECT_STREQ("200", responses[i]->headers().Status()->value().c_str());
+    clients[i]->close();
+  }
+  EXPECT_EQ(1U, test_server_->counter("scaleft.accessfabric.jwks_kid_miss_fetch")->value());
+  EXPECT_EQ(0U, test_server_->counter("scaleft.accessfabric.jwks_kid_miss_rejected")->value());
+
+  for (FakeHttpConnectionPtr& connection : upstream_connections) {
+    connection->close();
+    connection->waitForDisconnect();
+  }
+  jwks_connection->close();
+  jwks_connection->waitForDisconnect();
+}
+
 } // namespace Envoy
\ No newline at end of file
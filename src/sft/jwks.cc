@@ -0,0 +1,104 @@
+#include "jwks.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+std::shared_ptr<evp_pkey> JWKS::get(const std::string& kid) const {
+  auto it = keys_.find(kid);
+  if (it != keys_.end()) {
+    return it->second.pkey_;
+  }
+
+  ENVOY_LOG(debug, "unable to find jwk with kid {}", kid);
+  return nullptr;
+}
+
+const CompactECKey* JWKS::getCompact(const std::string& kid) const {
+  auto it = keys_.find(kid);
+  if (it != keys_.end()) {
+    return &it->second.compact_;
+  }
+
+  ENVOY_LOG(debug, "unable to find jwk with kid {}", kid);
+  return nullptr;
+}
+
+bool JWKS::add(const Json::ObjectSharedPtr jwk) {
+  return add(jwk->getString("kid", ""), jwk->getString("alg", ""), jwk->getString("crv", ""),
+             jwk->getString("x", ""), jwk->getString("y", ""));
+}
+
+bool JWKS::add(const std::string& kid, const std::string& alg, const std::string& crv,
+               const std::string& x, const std::string& y, const JWKS* previous) {
+  if (kid == "") {
+    ENVOY_LOG(warn, "jwk missing required key `kid`");
+    return false;
+  }
+  // The first key listed under a kid is the one used, later ones aren't built.
+  if (keys_.count(kid) > 0) {
+    ENVOY_LOG(warn, "duplicate jwk kid {}", kid);
+    return false;
+  }
+
+  Key key;
+  key.alg_ = alg;
+  if (!DecodeECPublicKey(crv, x, y, key.compact_)) {
+    ENVOY_LOG(warn, "jwk parse error");
+    return false;
+  }
+
+  if (!lazy_) {
+    // Reuse the previous key set's key for an unchanged kid, as long as its table (if any) still
+    // fits in our budget.
+    const Key* old = nullptr;
+    if (previous) {
+      auto it = previous->keys_.find(kid);
+      old = it != previous->keys_.end() ? &it->second : nullptr;
+    }
+    if (old && old->pkey_ && old->compact_ == key.compact_ &&
+        (!old->pkey_->table_ || precomputed_ < MaxPrecomputedKeys)) {
+      key.pkey_ = old->pkey_;
+      ENVOY_LOG(debug, "reused jwk {}", kid);
+    } else {
+      key.pkey_ = BuildECPublicKey(key.compact_, precomputed_ < MaxPrecomputedKeys);
+      if (!key.pkey_) {
+        ENVOY_LOG(warn, "jwk parse error");
+        return false;
+      }
+      ENVOY_LOG(debug, "parsed jwk {}", kid);
+    }
+    if (key.pkey_->table_) {
+      precomputed_++;
+    }
+  }
+
+  keys_[kid] = std::move(key);
+  return true;
+}
+
+void JWKS::setLoadTimes(const JWKS* previous, SystemTime now) {
+  for (auto& entry : keys_) {
+    entry.second.loaded_at_ = now;
+    if (!previous) {
+      continue;
+    }
+
+    auto it = previous->keys_.find(entry.first);
+    if (it != previous->keys_.end() && it->second.compact_ == entry.second.compact_) {
+      entry.second.loaded_at_ = it->second.loaded_at_;
+    }
+  }
+}
+
+void JWKS::iterate(KeyCb cb) const {
+  for (const auto& entry : keys_) {
+    cb(entry.first, entry.second.alg_, entry.second.compact_.nid_, entry.second.loaded_at_);
+  }
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "envoy/common/time.h"
+#include "envoy/json/json_object.h"
+
+#include "jwt.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Struct to hold a JSON Web Key Set. Built once and then published read-only to every worker.
+//
+// By default every key is materialized as an evp_pkey up front. A lazy key set only keeps the
+// decoded curve and point per kid (see CompactECKey); keys are built on first use by a per-worker
+// KeyCache instead, so memory tracks the active working set rather than the total number of kids.
+//
+// Eager key sets also precompute verification tables (see P256Table) for their first
+// MaxPrecomputedKeys P-256 keys. Lazy key sets never do, they are meant for many keys.
+class JWKS : public Logger::Loggable<Logger::Id::http> {
+public:
+  static const size_t MaxPrecomputedKeys = 16;
+
+  JWKS(bool lazy = false) : lazy_(lazy) {}
+
+  bool add(const Json::ObjectSharedPtr jwk);
+  // Same as above, from the individual jwk members. Returns false without building the key if
+  // `kid` is already in the key set. If `previous` (the key set this one replaces) already built
+  // the same key under the same kid, its evp_pkey and P256Table are reused instead of being built
+  // again.
+  bool add(const std::string& kid, const std::string& alg, const std::string& crv,
+           const std::string& x, const std::string& y, const JWKS* previous = nullptr);
+
+  // Eager key sets only.
+  std::shared_ptr<evp_pkey> get(const std::string& kid) const;
+  // Both eager and lazy key sets.
+  const CompactECKey* getCompact(const std::string& kid) const;
+
+  bool lazy() const { return lazy_; }
+  size_t size() const { return keys_.size(); }
+
+  // Stamps every key with `now` unless `previous` already held the same key under the same kid, in
+  // which case its original load time is kept. Called before the key set is published.
+  void setLoadTimes(const JWKS* previous, SystemTime now);
+
+  typedef std::function<void(const std::string& kid, const std::string& alg, int nid,
+                             SystemTime loaded_at)>
+      KeyCb;
+  void iterate(KeyCb cb) const;
+
+private:
+  struct Key {
+    CompactECKey compact_;
+    std::shared_ptr<evp_pkey> pkey_; // Unset for lazy key sets.
+    std::string alg_;
+    SystemTime loaded_at_;
+  };
+
+  const bool lazy_;
+  std::unordered_map<std::string, Key> keys_;
+  size_t precomputed_{};
+};
+
+typedef std::shared_ptr<JWKS> JWKSSharedPtr;
+typedef std::shared_ptr<const JWKS> JWKSConstSharedPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
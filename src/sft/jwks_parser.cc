@@ -0,0 +1,180 @@
+#include "jwks_parser.h"
+
+#include "rapidjson/reader.h"
+#include "rapidjson/stream.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+// SAX handler for `{"keys": [{...jwk...}, ...]}`. Depth counts open objects and arrays: the root
+// object is depth 1, the keys array depth 2 and each jwk depth 3. Anything nested deeper inside a
+// jwk (x5c chains, key_ops), jwk members that aren't strings and any other top level member are
+// skipped. A document with more than one `keys` array is rejected.
+class JwksSaxHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JwksSaxHandler> {
+public:
+  JwksSaxHandler(JWKS& jwks, const JWKS* previous) : jwks_(jwks), previous_(previous) {}
+
+  bool sawKeys() const { return saw_keys_; }
+
+  bool Default() { return true; }
+
+  bool String(const char* str, rapidjson::SizeType length, bool) {
+    if (depth_ != 3 || !in_jwk_) {
+      return true;
+    }
+
+    if (field_ == "kid") {
+      kid_.assign(str, length);
+    } else if (field_ == "alg") {
+      alg_.assign(str, length);
+    } else if (field_ == "crv") {
+      crv_.assign(str, length);
+    } else if (field_ == "x") {
+      x_.assign(str, length);
+    } else if (field_ == "y") {
+      y_.assign(str, length);
+    }
+    return true;
+  }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    if (depth_ == 1) {
+      root_key_.assign(str, length);
+    } else if (depth_ == 3 && in_jwk_) {
+      field_.assign(str, length);
+    }
+    return true;
+  }
+
+  bool StartObject() {
+    depth_++;
+    if (depth_ == 3 && in_keys_) {
+      in_jwk_ = true;
+      field_.clear();
+      kid_.clear();
+      alg_.clear();
+      crv_.clear();
+      x_.clear();
+      y_.clear();
+    }
+    return true;
+  }
+
+  bool EndObject(rapidjson::SizeType) {
+    if (depth_ == 3 && in_jwk_) {
+      in_jwk_ = false;
+      jwks_.add(kid_, alg_, crv_, x_, y_, previous_);
+    }
+    depth_--;
+    return true;
+  }
+
+  bool StartArray() {
+    depth_++;
+    if (depth_ == 2 && root_key_ == "keys") {
+      // Which of two `keys` arrays is the key set is ambiguous, reject the document.
+      if (saw_keys_) {
+        return false;
+      }
+      in_keys_ = true;
+      saw_keys_ = true;
+    }
+    return true;
+  }
+
+  bool EndArray(rapidjson::SizeType) {
+    if (depth_ == 2) {
+      in_keys_ = false;
+    }
+    depth_--;
+    return true;
+  }
+
+private:
+  JWKS& jwks_;
+  const JWKS* previous_;
+
+  int depth_{};
+  bool in_keys_{};
+  bool saw_keys_{};
+  bool in_jwk_{};
+  std::string root_key_;
+  std::string field_;
+
+  std::string kid_;
+  std::string alg_;
+  std::string crv_;
+  std::string x_;
+  std::string y_;
+};
+
+} // namespace
+
+JWKSSharedPtr ParseJwks(const std::string& body, bool lazy, const JWKS* previous) {
+  JWKSSharedPtr jwks(new JWKS(lazy));
+  JwksSaxHandler handler(*jwks, previous);
+  rapidjson::Reader reader;
+  rapidjson::StringStream stream(body.c_str());
+  // The iterative parser keeps deeply nested input from the upstream off the stack.
+  if (reader.Parse<rapidjson::kParseIterativeFlag>(stream, handler).IsError() ||
+      !handler.sawKeys()) {
+    return nullptr;
+  }
+  return jwks;
+}
+
+JwksParseThread::JwksParseThread()
+    : thread_(new Thread::Thread([this]() -> void { threadRoutine(); })) {}
+
+JwksParseThread::~JwksParseThread() {
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    shutdown_ = true;
+  }
+  cv_.notify_one();
+  thread_->join();
+}
+
+void JwksParseThread::parse(std::string&& body, bool lazy, JWKSConstSharedPtr previous,
+                            ParseCb cb) {
+  // std::function needs a copyable closure, so the body moves into a shared buffer.
+  std::shared_ptr<std::string> shared_body = std::make_shared<std::string>(std::move(body));
+  post([this, shared_body, lazy, previous, cb]() -> void {
+    ENVOY_LOG(debug, "JwksParseThread::parse: parsing {} byte jwks", shared_body->size());
+    cb(ParseJwks(*shared_body, lazy, previous.get()));
+  });
+}
+
+void JwksParseThread::post(std::function<void()> work) {
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    queue_.push_back(std::move(work));
+  }
+  cv_.notify_one();
+}
+
+void JwksParseThread::threadRoutine() {
+  while (true) {
+    std::function<void()> work;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      cv_.wait(lock, [this]() -> bool { return shutdown_ || !queue_.empty(); });
+      if (shutdown_) {
+        return;
+      }
+      work = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    work();
+  }
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
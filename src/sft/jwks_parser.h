@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "common/common/thread.h"
+
+#include "jwks.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Parses a JWKS document with a streaming (SAX) reader, building each key as its object closes
+// instead of materializing the whole document as a DOM first. Returns nullptr if the document is
+// not valid JSON or hasn't exactly one `keys` array. Individual keys that fail to parse, and keys
+// under a kid listed earlier, are skipped. A lazy key set only decodes each key (see JWKS). Keys
+// `previous` already built are reused, see JWKS::add().
+JWKSSharedPtr ParseJwks(const std::string& body, bool lazy, const JWKS* previous = nullptr);
+
+// A single background thread that parses fetched JWKS bodies, keeping the (potentially large)
+// parse and key construction off the main thread. Shared by every provider in the process, and
+// also used to build revocation denylists.
+class JwksParseThread : public Logger::Loggable<Logger::Id::http> {
+public:
+  // Called on the parse thread with the parsed key set, or nullptr on failure.
+  typedef std::function<void(JWKSSharedPtr)> ParseCb;
+
+  JwksParseThread();
+  ~JwksParseThread();
+
+  // `previous` is the key set the result replaces, if any, see ParseJwks().
+  void parse(std::string&& body, bool lazy, JWKSConstSharedPtr previous, ParseCb cb);
+  // Runs `work` on the parse thread, after any previously queued work.
+  void post(std::function<void()> work);
+
+private:
+  void threadRoutine();
+
+  std::mutex lock_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> queue_;
+  bool shutdown_{};
+  Thread::ThreadPtr thread_;
+};
+
+typedef std::shared_ptr<JwksParseThread> JwksParseThreadSharedPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
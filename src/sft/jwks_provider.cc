@@ -0,0 +1,607 @@
+#include "jwks_provider.h"
+
+#include "common/common/enum_to_int.h"
+#include "common/common/utility.h"
+#include "common/http/headers.h"
+#include "common/http/message_impl.h"
+#include "common/http/utility.h"
+
+#include "openssl/obj.h"
+
+#include "probes.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+JwksProvider::JwksProvider(JWKSConstSharedPtr static_jwks, size_t key_cache_size,
+                           ThreadLocal::SlotAllocator& tls, Event::Dispatcher& dispatcher,
+                           Stats::Scope& scope)
+    : static_jwks_(true), refresh_interval_(0), dispatcher_(dispatcher), refetch_min_interval_(0),
+      stats_(generateStats("scaleft.accessfabric.", scope)), key_cache_size_(key_cache_size),
+      key_cache_stats_(generateKeyCacheStats("scaleft.accessfabric.", scope)),
+      key_cache_counters_(std::make_shared<KeyCacheCounters>()), tls_(tls.allocateSlot()),
+      waiters_tls_(tls.allocateSlot()) {
+  ENVOY_LOG(debug, "JwksProvider::{}: Using statically configued jwks", __func__);
+  publish(static_jwks);
+  initThreadLocal({});
+}
+
+JwksProvider::JwksProvider(const std::string& cluster, const std::string& path,
+                           std::chrono::milliseconds refresh_interval,
+                           std::chrono::milliseconds refetch_min_interval,
+                           size_t key_cache_size, ThreadLocal::SlotAllocator& tls,
+                           Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
+                           Stats::Scope& scope, Runtime::RandomGenerator& random,
+                           JwksParseThreadSharedPtr parse_thread, const RetainedJwks& retained)
+    : static_jwks_(false), remote_cluster_name_(cluster), jwks_api_path_(path), cm_(&cm),
+      random_(&random), refresh_interval_(refresh_interval),
+      refresh_timer_(dispatcher.createTimer([this]() -> void { refresh(); })),
+      parse_thread_(parse_thread), dispatcher_(dispatcher),
+      refetch_min_interval_(refetch_min_interval),
+      stats_(generateStats("scaleft.accessfabric.", scope)), key_cache_size_(key_cache_size),
+      key_cache_stats_(generateKeyCacheStats("scaleft.accessfabric.", scope)),
+      key_cache_counters_(std::make_shared<KeyCacheCounters>()),
+      key_working_set_(key_cache_size > 0 ? std::make_shared<KeyWorkingSet>(key_cache_size)
+                                          : nullptr),
+      tls_(tls.allocateSlot()), waiters_tls_(tls.allocateSlot()) {
+  ENVOY_LOG(debug, "JwksProvider::{}: Using jwks from upstream {}{}", __func__,
+            remote_cluster_name_, jwks_api_path_);
+
+  // Pick up where the previous provider for this source left off, as long as it loaded keys the
+  // same way we do.
+  if (!retained.jwks_ || retained.jwks_->lazy() != (key_cache_size_ > 0)) {
+    snapshot_.publish(std::make_shared<const JWKS>(key_cache_size_ > 0));
+    initThreadLocal({});
+
+    // Start polling.
+    refresh();
+    return;
+  }
+
+  stats().jwks_retained_reused_.inc();
+  publish(retained.jwks_);
+  next_refresh_ = retained.next_refresh_;
+  initThreadLocal(retained.warm_kids_);
+
+  const MonotonicTime now = ProdMonotonicTimeSource::instance_.currentTime();
+  if (next_refresh_ > now) {
+    std::chrono::milliseconds delay =
+        std::chrono::duration_cast<std::chrono::milliseconds>(next_refresh_ - now);
+    ENVOY_LOG(debug, "JwksProvider::{}: reusing retained jwks, refresh in {} ms", __func__,
+              delay.count());
+    refresh_timer_->enableTimer(delay);
+    return;
+  }
+
+  refresh();
+}
+
+void JwksProvider::initThreadLocal(const std::vector<std::string>& warm_kids) {
+  // Runs later on each worker, so don't capture `this`.
+  const size_t key_cache_size = key_cache_size_;
+  KeyCacheStats key_cache_stats = key_cache_stats_;
+  KeyCacheCountersSharedPtr key_cache_counters = key_cache_counters_;
+  KeyWorkingSetSharedPtr key_working_set = key_working_set_;
+  JWKSConstSharedPtr jwks = current_;
+  tls_->set([key_cache_size, key_cache_stats, key_cache_counters, key_working_set, jwks,
+             warm_kids](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    std::shared_ptr<ThreadLocalJwks> local = std::make_shared<ThreadLocalJwks>();
+    if (jwks && !jwks->lazy()) {
+      local->replicas_.update(jwks);
+    }
+    if (key_cache_size > 0) {
+      local->key_cache_.reset(
+          new KeyCache(key_cache_size, key_cache_stats, key_cache_counters, key_working_set));
+      // Build the keys our predecessor's workers were using before the first request needs them.
+      for (const std::string& kid : warm_kids) {
+        const CompactECKey* compact = jwks ? jwks->getCompact(kid) : nullptr;
+        if (compact) {
+          local->key_cache_->prime(kid, *compact);
+        }
+      }
+    }
+    return local;
+  });
+  waiters_tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<KidMissWaiters>();
+  });
+}
+
+JwksProvider::~JwksProvider() {
+  if (active_request_) {
+    active_request_->cancel();
+  }
+}
+
+RetainedJwks JwksProvider::retained() const {
+  RetainedJwks retained;
+  retained.jwks_ = current_;
+  retained.next_refresh_ = next_refresh_;
+  if (key_working_set_) {
+    retained.warm_kids_ = key_working_set_->kids();
+  }
+  return retained;
+}
+
+std::string JwksProvider::sourceKey(const std::string& cluster, const std::string& path) {
+  return cluster + "|" + path;
+}
+
+JwksProviderStats JwksProvider::generateStats(const std::string& prefix, Stats::Scope& scope) {
+  return {
+      ALL_JWKS_PROVIDER_STATS(POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix))};
+}
+
+KeyCacheStats JwksProvider::generateKeyCacheStats(const std::string& prefix, Stats::Scope& scope) {
+  return {ALL_KEY_CACHE_STATS(POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix),
+                              POOL_HISTOGRAM_PREFIX(scope, prefix))};
+}
+
+const JWKS& JwksProvider::jwks() {
+  return *tls_->getTyped<ThreadLocalJwks>().reader_.get(snapshot_);
+}
+
+std::shared_ptr<evp_pkey> JwksProvider::getKey(const std::string& kid,
+                                               KeyCacheResult* cache_result) {
+  const uint64_t start = SFT_PROBE_ENABLED(jwks_get_done) ? ProbeNowNs() : 0;
+  SFT_PROBE1(jwks_get_start, kid.c_str());
+  std::shared_ptr<evp_pkey> key = lookupKey(kid, cache_result);
+  SFT_PROBE3(jwks_get_done, kid.c_str(), key != nullptr, ProbeElapsedNs(start));
+  return key;
+}
+
+std::shared_ptr<evp_pkey> JwksProvider::lookupKey(const std::string& kid,
+                                                  KeyCacheResult* cache_result) {
+  ThreadLocalJwks& local = tls_->getTyped<ThreadLocalJwks>();
+  const JWKS& jwks = *local.reader_.get(snapshot_);
+  if (!jwks.lazy()) {
+    return local.replicas_.get(jwks, kid);
+  }
+
+  const CompactECKey* compact = jwks.getCompact(kid);
+  if (!compact || !local.key_cache_) {
+    return nullptr;
+  }
+  return local.key_cache_->get(kid, *compact, cache_result);
+}
+
+void JwksProvider::publish(JWKSConstSharedPtr jwks) {
+  current_ = jwks;
+  snapshot_.publish(jwks);
+}
+
+void JwksProvider::replicate() {
+  JWKSConstSharedPtr jwks = current_;
+  if (!jwks || jwks->lazy()) {
+    return;
+  }
+
+  // Until this runs on a worker, it verifies the new key set's kids with the shared keys.
+  std::weak_ptr<JwksProvider> weak_this = shared_from_this();
+  tls_->runOnAllThreads([weak_this, jwks]() -> void {
+    if (JwksProviderSharedPtr provider = weak_this.lock()) {
+      provider->tls_->getTyped<ThreadLocalJwks>().replicas_.update(jwks);
+    }
+  });
+}
+
+bool JwksProvider::onKidMiss() {
+  // Static keys never change, there is nothing to wait on.
+  if (static_jwks_) {
+    return false;
+  }
+
+  // Someone else already kicked off a refetch, piggyback on it.
+  if (refetch_pending_.load()) {
+    return true;
+  }
+
+  const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          ProdMonotonicTimeSource::instance_.currentTime().time_since_epoch())
+                          .count();
+  const int64_t last = last_refetch_ms_.load();
+  if (last != 0 && now - last < refetch_min_interval_.count()) {
+    stats().jwks_kid_miss_rejected_.inc();
+    return false;
+  }
+
+  // Only one worker wins the race to start the refetch, the rest wait on it.
+  bool expected = false;
+  if (!refetch_pending_.compare_exchange_strong(expected, true)) {
+    return true;
+  }
+  last_refetch_ms_.store(now);
+  stats().jwks_kid_miss_fetch_.inc();
+
+  std::weak_ptr<JwksProvider> weak_this = shared_from_this();
+  dispatcher_.post([weak_this]() -> void {
+    if (JwksProviderSharedPtr provider = weak_this.lock()) {
+      provider->refetch();
+    }
+  });
+  return true;
+}
+
+void JwksProvider::addKidMissWaiter(KidMissWaiter& waiter) {
+  waiters_tls_->getTyped<KidMissWaiters>().waiters_.insert(&waiter);
+}
+
+void JwksProvider::removeKidMissWaiter(KidMissWaiter& waiter) {
+  waiters_tls_->getTyped<KidMissWaiters>().waiters_.erase(&waiter);
+}
+
+// Runs on the main thread once a kid-miss refetch has been requested by a worker.
+void JwksProvider::refetch() {
+  ENVOY_LOG(debug, "JwksProvider::{}", __func__);
+
+  // A fetch is already in flight. If it was sent before the miss its completion fetches again, see
+  // fetchAfterMiss(), otherwise it wakes the waiters.
+  if (active_request_ || parse_pending_) {
+    return;
+  }
+  // Or one that started after the miss has completed already.
+  if (!refetch_pending_.load()) {
+    return;
+  }
+
+  refresh_timer_->disableTimer();
+  refresh();
+}
+
+bool JwksProvider::fetchAfterMiss() {
+  if (fetch_covers_miss_ || !refetch_pending_.load()) {
+    return false;
+  }
+
+  // The key set we just got may predate the kid the waiters are after.
+  ENVOY_LOG(debug, "JwksProvider::{}: fetch predates a kid miss, fetching again", __func__);
+  active_request_ = nullptr;
+  refresh();
+  return true;
+}
+
+// Wakes every stream waiting on a kid-miss refetch. Only called once a fetch sent after the miss has
+// completed, and the new key set (if any) is published first, so waiters always see a key set at
+// least as recent as the kid they were waiting on.
+void JwksProvider::notifyKidMissWaiters() {
+  if (!refetch_pending_.exchange(false)) {
+    return;
+  }
+
+  std::weak_ptr<JwksProvider> weak_this = shared_from_this();
+  waiters_tls_->runOnAllThreads([weak_this]() -> void {
+    JwksProviderSharedPtr provider = weak_this.lock();
+    if (!provider) {
+      return;
+    }
+
+    // Swap the set out first, waiters may re-register or remove themselves while being woken.
+    std::unordered_set<KidMissWaiter*> waiters;
+    waiters.swap(provider->waiters_tls_->getTyped<KidMissWaiters>().waiters_);
+    for (KidMissWaiter* waiter : waiters) {
+      waiter->onJwksUpdated();
+    }
+  });
+}
+
+void JwksProvider::recordFetch(const std::string& status) {
+  last_fetch_status_ = status;
+  last_fetch_time_ = ProdSystemTimeSource::instance_.currentTime();
+  last_fetch_latency_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+      ProdMonotonicTimeSource::instance_.currentTime() - fetch_started_);
+  SFT_PROBE3(jwks_refresh_done, remote_cluster_name_.c_str(), status.c_str(),
+             last_fetch_latency_.count());
+}
+
+void JwksProvider::refresh() {
+  ENVOY_LOG(debug, "JwksProvider::{}", __func__);
+  fetch_started_ = ProdMonotonicTimeSource::instance_.currentTime();
+  fetch_covers_miss_ = refetch_pending_.load();
+  SFT_PROBE2(jwks_refresh_start, remote_cluster_name_.c_str(), jwks_api_path_.c_str());
+  MessagePtr message(new RequestMessageImpl());
+  message->headers().insertMethod().value().setReference(Http::Headers::get().MethodValues.Get);
+  message->headers().insertPath().value(jwks_api_path_);
+  message->headers().insertHost().value(remote_cluster_name_);
+  active_request_ = cm_->httpAsyncClientForCluster(remote_cluster_name_)
+                        .send(std::move(message), *this,
+                              Optional<std::chrono::milliseconds>(std::chrono::milliseconds(5000)));
+}
+
+void JwksProvider::requestFailed(Http::AsyncClient::FailureReason) {
+  ENVOY_LOG(debug, "JwksProvider::{} retry count: {}", __func__, retry_count_);
+  stats().jwks_fetch_failed_.inc();
+  if (fetchAfterMiss()) {
+    return;
+  }
+  notifyKidMissWaiters();
+
+  if (retry_count_ < 30) {
+    retry_count_++;
+    requestComplete(std::chrono::milliseconds((retry_count_ * retry_count_) * 1000));
+  } else {
+    requestComplete(refresh_interval_); // Poll normally
+  }
+}
+
+void JwksProvider::onFailure(Http::AsyncClient::FailureReason reason) {
+  recordFetch("reset");
+  requestFailed(reason);
+  return;
+}
+
+void JwksProvider::requestComplete(std::chrono::milliseconds interval) {
+  ENVOY_LOG(debug, "JwksProvider::{}", __func__);
+  active_request_ = nullptr;
+
+  // Add refresh jitter based on the configured interval.
+  std::chrono::milliseconds final_delay =
+      interval + std::chrono::milliseconds(random_->random() % interval.count());
+
+  ENVOY_LOG(debug, "JwksProvider::{} setting refresh timer: {} ms", __func__, final_delay.count());
+  next_refresh_ = ProdMonotonicTimeSource::instance_.currentTime() + final_delay;
+  refresh_timer_->enableTimer(final_delay);
+}
+
+void JwksProvider::onSuccess(Http::MessagePtr&& response) {
+  uint64_t response_code = Http::Utility::getResponseStatus(response->headers());
+  if (response_code != enumToInt(Http::Code::OK)) {
+    ENVOY_LOG(warn, "JwksProvider::{}: failed request: response {} != 200", __func__,
+              response_code);
+    recordFetch(fmt::format("response {}", response_code));
+    requestFailed(Http::AsyncClient::FailureReason::Reset);
+    return;
+  }
+
+  // Parse off the main thread, then hop back here to publish and reschedule.
+  std::string body = response->bodyAsString();
+  ENVOY_LOG(debug, "JwksProvider::{}: success: {} bytes", __func__, body.size());
+  active_request_ = nullptr;
+  parse_pending_ = true;
+  std::weak_ptr<JwksProvider> weak_this = shared_from_this();
+  Event::Dispatcher& dispatcher = dispatcher_;
+  // Keys the current key set already built are reused rather than built again.
+  parse_thread_->parse(std::move(body), key_cache_size_ > 0, current_,
+                       [weak_this, &dispatcher](JWKSSharedPtr jwks) -> void {
+                         dispatcher.post([weak_this, jwks]() -> void {
+                           if (JwksProviderSharedPtr provider = weak_this.lock()) {
+                             provider->onParsed(jwks);
+                           }
+                         });
+                       });
+}
+
+void JwksProvider::onParsed(JWKSSharedPtr jwks) {
+  parse_pending_ = false;
+  if (!jwks) {
+    ENVOY_LOG(warn, "JwksProvider::{}: failed request: parse failure", __func__);
+    recordFetch("parse failure");
+    requestFailed(Http::AsyncClient::FailureReason::Reset);
+    return;
+  }
+
+  ENVOY_LOG(debug, "JwksProvider::{}: publishing {} keys", __func__, jwks->size());
+  recordFetch("ok");
+  jwks->setLoadTimes(current_.get(), last_fetch_time_);
+  publish(jwks);
+  replicate();
+
+  retry_count_ = 0;
+  stats().jwks_fetch_success_.inc();
+  if (fetchAfterMiss()) {
+    return;
+  }
+  notifyKidMissWaiters();
+  requestComplete(refresh_interval_);
+}
+
+void JwksProvider::dumpState(AdminWriter& writer, uint64_t max_kids) const {
+  DateFormatter formatter("%Y-%m-%dT%H:%M:%SZ");
+  const MonotonicTime now = ProdMonotonicTimeSource::instance_.currentTime();
+
+  writer.StartObject();
+  writer.Key("source");
+  writer.String(static_jwks_ ? "static" : sourceKey(remote_cluster_name_, jwks_api_path_).c_str());
+
+  if (!static_jwks_) {
+    writer.Key("last_fetch_status");
+    writer.String(last_fetch_status_.c_str());
+    if (last_fetch_status_ != "none") {
+      writer.Key("last_fetch_time");
+      writer.String(formatter.fromTime(last_fetch_time_).c_str());
+      writer.Key("last_fetch_latency_ms");
+      writer.Uint64(last_fetch_latency_.count());
+    }
+    writer.Key("retry_count");
+    writer.Int(retry_count_);
+    writer.Key("fetch_in_flight");
+    writer.Bool(active_request_ != nullptr || parse_pending_);
+    writer.Key("next_refresh_in_ms");
+    writer.Int64(
+        std::chrono::duration_cast<std::chrono::milliseconds>(next_refresh_ - now).count());
+  }
+
+  writer.Key("keys_total");
+  writer.Uint64(current_ ? current_->size() : 0);
+  writer.Key("keys");
+  writer.StartArray();
+  uint64_t listed = 0;
+  if (current_) {
+    current_->iterate([&](const std::string& kid, const std::string& alg, int nid,
+                          SystemTime loaded_at) -> void {
+      if (listed++ >= max_kids) {
+        return;
+      }
+      writer.StartObject();
+      writer.Key("kid");
+      writer.String(kid.c_str());
+      writer.Key("alg");
+      writer.String(alg.c_str());
+      writer.Key("crv");
+      writer.String(OBJ_nid2sn(nid));
+      writer.Key("loaded_at");
+      writer.String(formatter.fromTime(loaded_at).c_str());
+      writer.EndObject();
+    });
+  }
+  writer.EndArray();
+
+  writer.Key("key_cache");
+  writer.StartObject();
+  writer.Key("enabled");
+  writer.Bool(key_cache_size_ > 0);
+  if (key_cache_size_ > 0) {
+    const uint64_t hits = key_cache_counters_->hits_.load(std::memory_order_relaxed);
+    const uint64_t misses = key_cache_counters_->misses_.load(std::memory_order_relaxed);
+    writer.Key("max_size_per_worker");
+    writer.Uint64(key_cache_size_);
+    writer.Key("size");
+    writer.Uint64(key_cache_counters_->size_.load(std::memory_order_relaxed));
+    writer.Key("hits");
+    writer.Uint64(hits);
+    writer.Key("misses");
+    writer.Uint64(misses);
+    writer.Key("hit_rate");
+    writer.Double(hits + misses > 0 ? double(hits) / (hits + misses) : 0);
+    writer.Key("avg_build_us");
+    writer.Double(
+        misses > 0 ? double(key_cache_counters_->build_us_.load(std::memory_order_relaxed)) / misses
+                   : 0);
+  }
+  writer.EndObject();
+
+  writer.EndObject();
+}
+
+JwksProviderRegistry::JwksProviderRegistry(Stats::Scope& scope) : scope_(scope.createScope("")) {}
+
+JwksProviderSharedPtr JwksProviderRegistry::get(const Json::Object& config,
+                                                ThreadLocal::SlotAllocator& tls,
+                                                Upstream::ClusterManager& cm,
+                                                Event::Dispatcher& dispatcher,
+                                                Runtime::RandomGenerator& random) {
+  if (!expire_timer_) {
+    expire_timer_ = dispatcher.createTimer([this]() -> void { expireRetained(); });
+    expire_timer_->enableTimer(std::chrono::seconds(RetainedMaxAgeS));
+  }
+
+  // Check if we have any static keys, if any fail to parse bail out.
+  std::vector<Json::ObjectSharedPtr> static_keys = config.getObjectArray("keys", true);
+  const size_t key_cache_size = config.getInteger("jwks_key_cache_size", 0);
+  if (static_keys.size() != 0) {
+    JWKSSharedPtr jwks(new JWKS(key_cache_size > 0));
+    for (auto& key : static_keys) {
+      if (!jwks->add(key)) {
+        throw EnvoyException(fmt::format("invalid static key in config"));
+      }
+    }
+    jwks->setLoadTimes(nullptr, ProdSystemTimeSource::instance_.currentTime());
+    return std::make_shared<JwksProvider>(jwks, key_cache_size, tls, dispatcher, *scope_);
+  }
+
+  // If we don't have any statically configured keys, ensure we can fetch them.
+  const std::string cluster = config.getString("jwks_api_cluster", "");
+  if (!cm.get(cluster)) {
+    throw EnvoyException(fmt::format("unknown cluster '{}' in sft filter config", cluster));
+  }
+  const std::string path = config.getString("jwks_api_path", "");
+  if (path == "") {
+    throw EnvoyException(fmt::format("empty 'jwks_api_path' in sft jwt auth config"));
+  }
+
+  // Share the provider with any other live config fetching from the same source and loading keys
+  // the same way. The refresh settings of the first config to reference a source win.
+  const std::string key =
+      fmt::format("{}|{}", JwksProvider::sourceKey(cluster, path), key_cache_size);
+  auto it = providers_.find(key);
+  if (it != providers_.end()) {
+    if (JwksProviderSharedPtr provider = it->second.lock()) {
+      ENVOY_LOG(debug, "JwksProviderRegistry::{}: sharing jwks provider for {}", __func__, key);
+      return provider;
+    }
+  }
+
+  // Hand our state to the registry on the way out so a replacement config can pick it up.
+  std::weak_ptr<JwksProviderRegistry> weak_this = shared_from_this();
+  JwksProviderSharedPtr provider(
+      new JwksProvider(
+          cluster, path,
+          std::chrono::milliseconds(config.getInteger("jwks_refresh_delay_ms", 60000)),
+          std::chrono::milliseconds(config.getInteger("jwks_refetch_min_interval_ms", 10000)),
+          key_cache_size, tls, cm, dispatcher, *scope_, random, parseThread(), takeRetained(key)),
+      [weak_this, key](JwksProvider* provider) -> void {
+        if (JwksProviderRegistrySharedPtr registry = weak_this.lock()) {
+          registry->retain(key, provider->retained());
+        }
+        delete provider;
+      });
+  providers_[key] = provider;
+
+  // Drop entries for providers that have gone away so the map tracks live sources only.
+  for (auto entry = providers_.begin(); entry != providers_.end();) {
+    if (entry->second.expired()) {
+      entry = providers_.erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+
+  return provider;
+}
+
+JwksParseThreadSharedPtr JwksProviderRegistry::parseThread() {
+  if (!parse_thread_) {
+    parse_thread_ = std::make_shared<JwksParseThread>();
+  }
+  return parse_thread_;
+}
+
+void JwksProviderRegistry::retain(const std::string& key, const RetainedJwks& retained) {
+  // Nothing worth keeping if the provider never completed a fetch.
+  if (!retained.jwks_) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(retained_lock_);
+  RetainedJwks& entry = retained_[key];
+  entry = retained;
+  entry.retained_at_ = ProdMonotonicTimeSource::instance_.currentTime();
+}
+
+RetainedJwks JwksProviderRegistry::takeRetained(const std::string& key) {
+  std::unique_lock<std::mutex> lock(retained_lock_);
+  auto it = retained_.find(key);
+  if (it == retained_.end()) {
+    return {};
+  }
+
+  RetainedJwks retained = it->second;
+  retained_.erase(it);
+  return retained;
+}
+
+void JwksProviderRegistry::expireRetained() {
+  const MonotonicTime now = ProdMonotonicTimeSource::instance_.currentTime();
+  {
+    std::unique_lock<std::mutex> lock(retained_lock_);
+    for (auto it = retained_.begin(); it != retained_.end();) {
+      if (now - it->second.retained_at_ >= std::chrono::seconds(RetainedMaxAgeS)) {
+        ENVOY_LOG(debug, "JwksProviderRegistry::{}: releasing retained jwks for {}", __func__,
+                  it->first);
+        it = retained_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  expire_timer_->enableTimer(std::chrono::seconds(RetainedMaxAgeS));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/http/async_client.h"
+#include "envoy/json/json_object.h"
+#include "envoy/runtime/runtime.h"
+#include "envoy/singleton/instance.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+#include "envoy/upstream/cluster_manager.h"
+
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "jwks.h"
+#include "jwks_parser.h"
+#include "key_cache.h"
+#include "snapshot.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// clang-format off
+#define ALL_JWKS_PROVIDER_STATS(COUNTER, GAUGE)                                             \
+  COUNTER(jwks_fetch_failed)                                                                \
+  COUNTER(jwks_fetch_success)                                                               \
+  COUNTER(jwks_kid_miss_fetch)                                                              \
+  COUNTER(jwks_kid_miss_rejected)                                                           \
+  COUNTER(jwks_retained_reused)
+// clang-format on
+
+struct JwksProviderStats {
+  ALL_JWKS_PROVIDER_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+// Used to build the /accessfabric admin response.
+typedef rapidjson::Writer<rapidjson::StringBuffer> AdminWriter;
+
+// Per-worker view of a provider's published key set, plus the worker's own keys: materialized on
+// demand when the key set is lazy, replicated from it as it is published when it is eager.
+struct ThreadLocalJwks : public ThreadLocal::ThreadLocalObject {
+  SnapshotReader<JWKS> reader_;
+  std::unique_ptr<KeyCache> key_cache_;
+  KeyReplicas replicas_;
+};
+
+// Implemented by streams that are paused waiting on a JWKS refetch triggered by an unknown kid.
+class KidMissWaiter {
+public:
+  virtual ~KidMissWaiter() {}
+
+  // Called on the waiter's worker once the refetch has completed (successfully or not) and any new
+  // key set is visible to that worker.
+  virtual void onJwksUpdated() PURE;
+};
+
+// Per-worker set of streams waiting on a kid-miss refetch.
+struct KidMissWaiters : public ThreadLocal::ThreadLocalObject {
+  std::unordered_set<KidMissWaiter*> waiters_;
+};
+
+// State handed from a provider to its replacement for the same source, so that rebuilding the
+// filter chain on a config update neither starts from an empty key set nor refetches early, nor
+// builds its keys again: an eager key set carries its built keys and tables, and for a lazy one the
+// kids its workers were using are built into the replacement's key caches up front.
+struct RetainedJwks {
+  JWKSConstSharedPtr jwks_;
+  MonotonicTime next_refresh_;
+  // Lazy key sets only, see KeyWorkingSet.
+  std::vector<std::string> warm_kids_;
+  // When the registry retained it, see JwksProviderRegistry::RetainedMaxAgeS.
+  MonotonicTime retained_at_;
+};
+
+class JwksProvider;
+typedef std::shared_ptr<JwksProvider> JwksProviderSharedPtr;
+
+// Owns a single JWKS source: the key set itself and, for upstream sources, the refresh timer and
+// fetch. Providers for the same upstream source are shared between every filter config that
+// references it via JwksProviderRegistry.
+//
+// Fetched bodies are parsed on the shared JwksParseThread, and the resulting key set is published
+// with a single atomic snapshot swap that workers pick up without locks (see AtomicSnapshot).
+//
+// TODO(morgabra) RestApiFetcher doesn't seem to wait until the configured
+// cluster is up, so it fails to fetch the first loop. Might just need to use
+// AsyncClient directly - which is nice anyway because you don't have to specify
+// a cluster.
+class JwksProvider : public Http::AsyncClient::Callbacks,
+                     public Logger::Loggable<Logger::Id::http>,
+                     public std::enable_shared_from_this<JwksProvider> {
+public:
+  // Provider for a statically configured key set, never refreshed. `static_jwks` must be lazy iff
+  // `key_cache_size` is non-zero.
+  JwksProvider(JWKSConstSharedPtr static_jwks, size_t key_cache_size,
+               ThreadLocal::SlotAllocator& tls, Event::Dispatcher& dispatcher,
+               Stats::Scope& scope);
+  // Provider polling `path` on `cluster`. If `retained` holds a key set from a previous provider
+  // for the same source it is published immediately and polling resumes on its schedule. A
+  // non-zero `key_cache_size` loads the key set lazily, see JWKS.
+  JwksProvider(const std::string& cluster, const std::string& path,
+               std::chrono::milliseconds refresh_interval,
+               std::chrono::milliseconds refetch_min_interval, size_t key_cache_size,
+               ThreadLocal::SlotAllocator& tls, Upstream::ClusterManager& cm,
+               Event::Dispatcher& dispatcher, Stats::Scope& scope,
+               Runtime::RandomGenerator& random, JwksParseThreadSharedPtr parse_thread,
+               const RetainedJwks& retained);
+  ~JwksProvider();
+
+  // Key used to share providers between filter configs.
+  static std::string sourceKey(const std::string& cluster, const std::string& path);
+
+  // The key set as currently seen by the calling worker.
+  const JWKS& jwks();
+  // The key for `kid` from the calling worker's view of the key set, materializing it in the
+  // worker's key cache first for lazy key sets. Returns nullptr if the kid is unknown. If
+  // `cache_result` is set it receives how the key cache served the lookup.
+  std::shared_ptr<evp_pkey> getKey(const std::string& kid, KeyCacheResult* cache_result = nullptr);
+
+  const JwksProviderStats& stats() { return stats_; }
+  static JwksProviderStats generateStats(const std::string& prefix, Stats::Scope& scope);
+  static KeyCacheStats generateKeyCacheStats(const std::string& prefix, Stats::Scope& scope);
+
+  // Called from a worker when a token references a kid we don't have. Returns true if a JWKS
+  // refetch is (now) in flight and the caller should wait on it via addKidMissWaiter(), false if
+  // the token should be rejected. Refetches are coalesced across all workers and rate limited to
+  // one per `jwks_refetch_min_interval_ms`.
+  bool onKidMiss();
+  void addKidMissWaiter(KidMissWaiter& waiter);
+  void removeKidMissWaiter(KidMissWaiter& waiter);
+
+  // The last successfully fetched key set, when it is next due to be refreshed and the key cache
+  // working set.
+  RetainedJwks retained() const;
+
+  // Writes the provider's fetch state, key inventory (at most `max_kids` kids) and key cache
+  // efficiency as a JSON object. Main thread only, and never touches worker state.
+  void dumpState(AdminWriter& writer, uint64_t max_kids) const;
+
+private:
+  // Http::AsyncClient::Callbacks
+  void onSuccess(Http::MessagePtr&& response) override;
+  void onFailure(Http::AsyncClient::FailureReason reason) override;
+
+  // Workers of a lazy key set build the keys of `warm_kids` in the current key set when they start.
+  void initThreadLocal(const std::vector<std::string>& warm_kids);
+  // getKey() minus its probes.
+  std::shared_ptr<evp_pkey> lookupKey(const std::string& kid, KeyCacheResult* cache_result);
+  void refresh();
+  void refetch();
+  // Called as a fetch completes. If it was sent before a pending kid miss, sends another one for the
+  // waiters instead of waking them, and returns true.
+  bool fetchAfterMiss();
+  void requestComplete(std::chrono::milliseconds interval);
+  void requestFailed(Http::AsyncClient::FailureReason reason);
+  void onParsed(JWKSSharedPtr jwks);
+  void notifyKidMissWaiters();
+  void publish(JWKSConstSharedPtr jwks);
+  // Has every worker replicate the published key set's keys, see KeyReplicas. Workers that start
+  // later replicate it in initThreadLocal().
+  void replicate();
+  void recordFetch(const std::string& status);
+
+  const bool static_jwks_;
+  const std::string remote_cluster_name_;
+  const std::string jwks_api_path_;
+  Upstream::ClusterManager* cm_{};
+  Runtime::RandomGenerator* random_{};
+
+  int retry_count_{};
+  const std::chrono::milliseconds refresh_interval_;
+  Event::TimerPtr refresh_timer_;
+  Http::AsyncClient::Request* active_request_{};
+  JwksParseThreadSharedPtr parse_thread_;
+  bool parse_pending_{};
+  // Main thread copies of the published key set and refresh deadline, handed to our replacement.
+  JWKSConstSharedPtr current_;
+  MonotonicTime next_refresh_;
+
+  // Fetch state for the admin endpoint, main thread only.
+  MonotonicTime fetch_started_;
+  SystemTime last_fetch_time_;
+  std::chrono::milliseconds last_fetch_latency_{};
+  std::string last_fetch_status_{"none"};
+
+  // Kid-miss refetch state, shared between the main thread and all workers.
+  Event::Dispatcher& dispatcher_;
+  const std::chrono::milliseconds refetch_min_interval_;
+  std::atomic<bool> refetch_pending_{false};
+  std::atomic<int64_t> last_refetch_ms_{0};
+  // Set if the fetch in flight was sent while a kid-miss refetch was pending, main thread only.
+  bool fetch_covers_miss_{};
+
+  const JwksProviderStats stats_;
+  const size_t key_cache_size_{};
+  KeyCacheStats key_cache_stats_;
+  KeyCacheCountersSharedPtr key_cache_counters_;
+  KeyWorkingSetSharedPtr key_working_set_;
+  AtomicSnapshot<JWKS> snapshot_;
+  ThreadLocal::SlotPtr tls_;
+  ThreadLocal::SlotPtr waiters_tls_;
+};
+
+// Process wide registry of upstream JWKS providers, keyed by source (cluster and path) and key
+// cache size. Lives in the singleton manager and is looked up on the main thread while building
+// filter configs.
+//
+// A shared provider outlives the listener whose config created it, so provider stats live in a
+// scope owned by the registry rather than in that listener's.
+//
+// When the last config using a provider goes away its key set and refresh schedule are retained
+// here, and handed to the next provider created for the same source. Listener updates that replace
+// the filter chain therefore keep serving with the previous keys instead of rejecting traffic until
+// the first fetch completes. Retained state that no provider picked up within RetainedMaxAgeS (the
+// source was dropped from the config) is released.
+class JwksProviderRegistry : public Singleton::Instance,
+                             public Logger::Loggable<Logger::Id::http>,
+                             public std::enable_shared_from_this<JwksProviderRegistry> {
+public:
+  // Provider stats go in a scope created in `scope`, which must be the server's.
+  JwksProviderRegistry(Stats::Scope& scope);
+
+  // Envoy's default drain time: a replacement config is in place well before then.
+  static const uint64_t RetainedMaxAgeS = 600;
+
+  // Returns the provider for the JWKS source described by the filter config, creating it if this
+  // is the first config to reference it. Statically configured keys always get their own provider.
+  JwksProviderSharedPtr get(const Json::Object& config, ThreadLocal::SlotAllocator& tls,
+                            Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
+                            Runtime::RandomGenerator& random);
+
+  // The process wide background thread for JWKS parsing (and other large builds), created on first
+  // use. Main thread only.
+  JwksParseThreadSharedPtr parseThread();
+
+private:
+  // Providers may be released from any thread (the last reference can be held by a filter), so
+  // retained state is guarded separately from the main thread only provider map.
+  void retain(const std::string& key, const RetainedJwks& retained);
+  RetainedJwks takeRetained(const std::string& key);
+  // Releases retained state older than RetainedMaxAgeS, on a main thread timer started by the first
+  // get().
+  void expireRetained();
+
+  Stats::ScopePtr scope_;
+  Event::TimerPtr expire_timer_;
+  std::unordered_map<std::string, std::weak_ptr<JwksProvider>> providers_;
+  JwksParseThreadSharedPtr parse_thread_;
+  std::mutex retained_lock_;
+  std::unordered_map<std::string, RetainedJwks> retained_;
+};
+
+typedef std::shared_ptr<JwksProviderRegistry> JwksProviderRegistrySharedPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -2,15 +2,24 @@
 
 #include "common/common/assert.h"
 #include "common/common/base64.h"
+#include "common/common/hash.h"
 #include "common/common/utility.h"
 #include "common/json/json_loader.h"
 #include "envoy/json/json_object.h"
 #include "openssl/bn.h"
 #include "openssl/evp.h"
 #include "openssl/rsa.h"
+#include "openssl/sha.h"
+
+#include "probes.h"
+
+#include "rapidjson/reader.h"
+#include "rapidjson/stream.h"
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <string>
@@ -69,6 +78,167 @@ static std::string urlsafeBase64Decode(const std::string& base64) {
   return Base64::decode(input);
 }
 
+namespace {
+
+// Nesting accepted in a header or payload. Deeper segments are rejected before they cost more.
+const int MaxSegmentDepth = 32;
+
+// SAX handler checking that a header or payload segment is a JSON object, without building it.
+// For a header it also picks out the top level `kid` and `alg`, which must be strings, and for a
+// payload the JwtClaims, which are recorded whatever their type. Depth counts open objects and
+// arrays, the root object is depth 1.
+class SegmentSaxHandler
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, SegmentSaxHandler> {
+public:
+  // `kid` and `alg` are null for a payload, `claims` for a header.
+  SegmentSaxHandler(std::string* kid, std::string* alg, JwtClaims* claims)
+      : kid_(kid), alg_(alg), claims_(claims) {}
+
+  bool Default() { return value(); }
+
+  bool Int(int i) { return integer(i); }
+  bool Uint(unsigned u) { return integer(u); }
+  bool Int64(int64_t i) { return integer(i); }
+  bool Uint64(uint64_t u) {
+    const bool fits = u <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    return integer(fits ? static_cast<int64_t>(u) : -1);
+  }
+
+  bool String(const char* str, rapidjson::SizeType length, bool) {
+    if (depth_ == 1 && field_) {
+      field_->assign(str, length);
+      field_ = nullptr;
+      return true;
+    }
+    if (depth_ == 1 && extra_claim_) {
+      extra_claim_->value_.assign(str, length);
+    }
+    if (depth_ == 1 && claim_ == Claim::AUD) {
+      claims_->aud_.emplace_back(str, length);
+    } else if (depth_ == 1 && claim_string_) {
+      claim_string_->assign(str, length);
+    } else if (depth_ == 2 && aud_array_) {
+      claims_->aud_.emplace_back(str, length);
+    }
+    return value();
+  }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    if (depth_ == 1) {
+      field_ = nullptr;
+      if (length == 3 && kid_ && memcmp(str, "kid", 3) == 0) {
+        field_ = kid_;
+      } else if (length == 3 && alg_ && memcmp(str, "alg", 3) == 0) {
+        field_ = alg_;
+      } else if (claims_) {
+        return claimKey(str, length);
+      }
+    }
+    return true;
+  }
+
+  bool StartObject() { return (depth_ == 0 || value()) && ++depth_ <= MaxSegmentDepth; }
+
+  bool EndObject(rapidjson::SizeType) {
+    depth_--;
+    return true;
+  }
+
+  bool StartArray() {
+    if (depth_ == 1) {
+      aud_array_ = claim_ == Claim::AUD;
+    }
+    return value() && ++depth_ <= MaxSegmentDepth;
+  }
+
+  bool EndArray(rapidjson::SizeType) {
+    if (--depth_ == 1) {
+      aud_array_ = false;
+    }
+    return true;
+  }
+
+private:
+  // Bits in seen_.
+  enum Claim { NONE = 0, ISS = 1, SUB = 2, JTI = 4, AUD = 8, NBF = 16, EXP = 32 };
+
+  // Whether a value other than a string, or a string that isn't kid or alg, can go where the
+  // parser is: not at the top level, where only the root object goes, and not as kid or alg.
+  bool value() const { return depth_ > 0 && !(depth_ == 1 && field_); }
+
+  bool integer(int64_t i) {
+    if (depth_ == 1 && (claim_ == Claim::NBF || claim_ == Claim::EXP)) {
+      (claim_ == Claim::NBF ? claims_->nbf_ : claims_->exp_) = i < 0 ? -1 : i;
+    }
+    return value();
+  }
+
+  // Tracks which of the JwtClaims the next value is, an extra claim can also be a registered one.
+  // A payload with one of them twice is rejected, it can't be told which one the issuer meant.
+  bool claimKey(const char* str, rapidjson::SizeType length) {
+    const std::string key(str, length);
+    claim_ = Claim::NONE;
+    claim_string_ = nullptr;
+    extra_claim_ = nullptr;
+    for (JwtClaims::Extra& extra : claims_->extra_) {
+      if (extra.name_ == key) {
+        if (extra.present_) {
+          return false;
+        }
+        extra.present_ = true;
+        extra_claim_ = &extra;
+        break;
+      }
+    }
+    if (key == "iss") {
+      claim_ = Claim::ISS;
+      claim_string_ = &claims_->iss_;
+    } else if (key == "sub") {
+      claim_ = Claim::SUB;
+      claim_string_ = &claims_->sub_;
+    } else if (key == "jti") {
+      claim_ = Claim::JTI;
+      claim_string_ = &claims_->jti_;
+    } else if (key == "aud") {
+      claim_ = Claim::AUD;
+    } else if (key == "nbf") {
+      claim_ = Claim::NBF;
+      claims_->has_nbf_ = true;
+    } else if (key == "exp") {
+      claim_ = Claim::EXP;
+      claims_->has_exp_ = true;
+    }
+    if (seen_ & claim_) {
+      return false;
+    }
+    seen_ |= claim_;
+    return true;
+  }
+
+  std::string* kid_;
+  std::string* alg_;
+  JwtClaims* claims_;
+  std::string* field_{};
+  Claim claim_{Claim::NONE};
+  std::string* claim_string_{};
+  JwtClaims::Extra* extra_claim_{};
+  bool aud_array_{};
+  int seen_{};
+  int depth_{};
+};
+
+// Checks that `json` is an object, filling in the header fields or the claims if they are given.
+// Uses the iterative parser, so nesting costs heap rather than stack.
+bool parseSegment(const std::string& json, std::string* kid, std::string* alg,
+                  JwtClaims* claims) {
+  SegmentSaxHandler handler(kid, alg, claims);
+  rapidjson::Reader reader;
+  rapidjson::StringStream stream(json.c_str());
+  return !reader.Parse<rapidjson::kParseIterativeFlag>(stream, handler).IsError();
+}
+
+} // namespace
+
 // Signature block is 2 numbers url safe base64 encoded, the first half is
 // R, the latter half S. We pass that with the relevant public key X and Y
 // initialized with the correct sha/curve functions to do the verification.
@@ -93,29 +263,50 @@ static inline std::string signatureToASN(const std::string& signature) {
 // TODO(morgabra) Support RSA?
 // TODO(morgabra) Proper error handling, surface useful errors.
 const std::shared_ptr<evp_pkey> ParseECPublicKey(const Json::ObjectSharedPtr& jwk) {
-  std::string crv_s = jwk->getString("crv", "");
-  int crv = curveTypeToNID(crv_s);
-  if (crv == -1) {
+  return ParseECPublicKey(jwk->getString("crv", ""), jwk->getString("x", ""),
+                          jwk->getString("y", ""));
+}
+
+const std::shared_ptr<evp_pkey> ParseECPublicKey(const std::string& crv, const std::string& x,
+                                                 const std::string& y) {
+  CompactECKey compact;
+  if (!DecodeECPublicKey(crv, x, y, compact)) {
     return nullptr;
   }
+  return BuildECPublicKey(compact);
+}
+
+bool DecodeECPublicKey(const std::string& crv_s, const std::string& x_b64,
+                       const std::string& y_b64, CompactECKey& out) {
+  std::string crv_name = crv_s;
+  int crv = curveTypeToNID(crv_name);
+  if (crv == -1) {
+    return false;
+  }
 
-  std::string x = urlsafeBase64Decode(jwk->getString("x", ""));
-  std::string y = urlsafeBase64Decode(jwk->getString("y", ""));
+  std::string x = urlsafeBase64Decode(x_b64);
+  std::string y = urlsafeBase64Decode(y_b64);
 
-  if (x == "" || y == "") {
-    return nullptr;
+  if (x == "" || y == "" || x.size() != y.size()) {
+    return false;
   }
 
+  out.nid_ = crv;
+  out.point_ = x + y;
+  return true;
+}
+
+const std::shared_ptr<evp_pkey> BuildECPublicKey(const CompactECKey& compact, bool precompute) {
   // New EC_KEY
-  ec key(crv);
+  ec key(compact.nid_);
   if (!key) {
     ERR_print_errors_fp(stderr);
     return nullptr;
   }
 
   // Set key params
-  bn bx(x);
-  bn by(y);
+  bn bx(compact.x());
+  bn by(compact.y());
   if (EC_KEY_set_public_key_affine_coordinates(key, bx, by) != 1) {
     ERR_print_errors_fp(stderr);
     return nullptr;
@@ -128,89 +319,198 @@ const std::shared_ptr<evp_pkey> ParseECPublicKey(const Json::ObjectSharedPtr& jw
     return nullptr;
   }
 
+  pkey->fingerprint_ = HashUtil::xxHash64(std::to_string(compact.nid_) + ":" + compact.point_);
+  if (precompute && compact.nid_ == NID_X9_62_prime256v1 && compact.point_.size() == 64) {
+    pkey->table_ = P256Table::build(castToUChar(compact.point_), castToUChar(compact.point_) + 32);
+  }
+
   return pkey;
 }
 
+VerifyStatus JwtStatusToVerifyStatus(JwtStatus status) {
+  switch (status) {
+  case JwtStatus::OK:
+    return VerifyStatus::JWT_VERIFY_SUCCESS;
+  case JwtStatus::MALFORMED:
+  case JwtStatus::BAD_HEADER:
+  case JwtStatus::BAD_PAYLOAD:
+    return VerifyStatus::JWT_VERIFY_FAIL_MALFORMED;
+  case JwtStatus::NO_KID:
+    return VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS;
+  case JwtStatus::UNSUPPORTED_ALG:
+    return VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE;
+  }
+  NOT_REACHED;
+}
+
+VerifyStatus CheckClaims(const JwtClaims& claims, int64_t now, const std::string* issuer,
+                         const std::vector<std::string>* audiences) {
+  VerifyStatus status = VerifyStatus::JWT_VERIFY_SUCCESS;
+  if (issuer) {
+    status = ProbeClaimCheck("iss", [&claims, issuer]() -> VerifyStatus {
+      if (claims.iss_.empty() || *issuer != claims.iss_) {
+        return VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH;
+      }
+      return VerifyStatus::JWT_VERIFY_SUCCESS;
+    });
+    if (status != VerifyStatus::JWT_VERIFY_SUCCESS) {
+      return status;
+    }
+  }
+
+  if (audiences) {
+    status = ProbeClaimCheck("aud", [&claims, audiences]() -> VerifyStatus {
+      for (const std::string& allowed : *audiences) {
+        if (std::find(claims.aud_.begin(), claims.aud_.end(), allowed) != claims.aud_.end()) {
+          return VerifyStatus::JWT_VERIFY_SUCCESS;
+        }
+      }
+      return VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH;
+    });
+    if (status != VerifyStatus::JWT_VERIFY_SUCCESS) {
+      return status;
+    }
+  }
+
+  status = ProbeClaimCheck("nbf", [&claims, now]() -> VerifyStatus {
+    if (claims.has_nbf_ && (claims.nbf_ < 0 || now < claims.nbf_)) {
+      return VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE;
+    }
+    return VerifyStatus::JWT_VERIFY_SUCCESS;
+  });
+  if (status != VerifyStatus::JWT_VERIFY_SUCCESS) {
+    return status;
+  }
+
+  return ProbeClaimCheck("exp", [&claims, now]() -> VerifyStatus {
+    if (claims.has_exp_ && (claims.exp_ < 0 || now > claims.exp_)) {
+      return VerifyStatus::JWT_VERIFY_FAIL_EXPIRED;
+    }
+    return VerifyStatus::JWT_VERIFY_SUCCESS;
+  });
+}
+
+const JwtClaims::Extra* JwtClaims::extra(const std::string& name) const {
+  for (const Extra& claim : extra_) {
+    if (claim.name_ == name) {
+      return &claim;
+    }
+  }
+  return nullptr;
+}
+
+Jwt::Jwt(const std::string& jwt, const std::vector<std::string>& extra_claims) {
+  for (const std::string& name : extra_claims) {
+    claims_.extra_.emplace_back();
+    claims_.extra_.back().name_ = name;
+  }
+  const uint64_t start = SFT_PROBE_ENABLED(jwt_parse_done) ? ProbeNowNs() : 0;
+  SFT_PROBE1(jwt_parse_start, jwt.size());
+  status_ = parse(jwt);
+  SFT_PROBE3(jwt_parse_done, jwt.size(), IsParsed(), ProbeElapsedNs(start));
+}
+
 // TODO(morgabra) Support RSA?
-// TODO(morgabra) Should we do verification of claims here?
-// TODO(morgabra) Proper error handling, surface useful errors.
-Jwt::Jwt(const std::string& jwt) {
-  std::vector<std::string> jwt_split = StringUtil::split(jwt, '.');
-  if (jwt_split.size() != 3) {
-    parsed_ = false;
-    return;
+JwtStatus Jwt::parse(const std::string& jwt) {
+  const size_t header_end = jwt.find('.');
+  const size_t payload_end =
+      header_end == std::string::npos ? std::string::npos : jwt.find('.', header_end + 1);
+  if (payload_end == std::string::npos || jwt.find('.', payload_end + 1) != std::string::npos) {
+    return JwtStatus::MALFORMED;
   }
 
   // Parse header json
-  header_raw_ = jwt_split[0];
-  try {
-    header_ = Json::Factory::loadFromString(urlsafeBase64Decode(header_raw_));
-  } catch (...) {
-    parsed_ = false;
-    return;
+  const std::string header = urlsafeBase64Decode(jwt.substr(0, header_end));
+  if (header.empty()) {
+    return JwtStatus::MALFORMED;
+  }
+  if (!parseSegment(header, &kid_, &alg_, nullptr)) {
+    return JwtStatus::BAD_HEADER;
+  }
+  if (kid_.empty()) {
+    return JwtStatus::NO_KID;
+  }
+  md_ = hashFuncToEVP(alg_);
+  if (!md_) {
+    return JwtStatus::UNSUPPORTED_ALG;
   }
 
-  // Parse payload json
-  payload_raw_ = jwt_split[1];
-  try {
-    payload_ = Json::Factory::loadFromString(urlsafeBase64Decode(payload_raw_));
-  } catch (...) {
-    parsed_ = false;
-    return;
+  // Check the payload json and pick out its claims, it is never built.
+  payload_json_ = urlsafeBase64Decode(jwt.substr(header_end + 1, payload_end - header_end - 1));
+  if (payload_json_.empty()) {
+    return JwtStatus::MALFORMED;
+  }
+  if (!parseSegment(payload_json_, nullptr, nullptr, &claims_)) {
+    return JwtStatus::BAD_PAYLOAD;
   }
 
   // Set up signature
-  signature_raw_ = jwt_split[2];
-  signature_ = urlsafeBase64Decode(jwt_split[2]);
-  if (signature_ == "") {
-    parsed_ = false;
-    return;
+  signature_ = urlsafeBase64Decode(jwt.substr(payload_end + 1));
+  if (signature_.empty()) {
+    return JwtStatus::MALFORMED;
   }
 
-  parsed_ = true;
+  signed_data_ = jwt.substr(0, payload_end);
+  return JwtStatus::OK;
+}
+
+bool Jwt::VerifySignature(const std::shared_ptr<evp_pkey> pkey) {
+  const uint64_t start = SFT_PROBE_ENABLED(jwt_verify_done) ? ProbeNowNs() : 0;
+  SFT_PROBE1(jwt_verify_start, signature_.size());
+  const bool verified = verifySignature(pkey);
+  SFT_PROBE2(jwt_verify_done, verified, ProbeElapsedNs(start));
+  return verified;
 }
 
 // TODO(morgabra) Support RSA?
 // TODO(morgabra) Should we do verification of claims here?
 // TODO(morgabra) Proper error handling, surface useful errors.
-bool Jwt::VerifySignature(const std::shared_ptr<evp_pkey> pkey) {
-  if (!parsed_) {
+bool Jwt::verifySignature(const std::shared_ptr<evp_pkey>& pkey) {
+  if (!IsParsed()) {
     return false;
   }
 
-  std::string signed_data = header_raw_ + '.' + payload_raw_;
-
-  std::string alg = header_->getString("alg");
-  const EVP_MD* md = hashFuncToEVP(alg);
-  if (!md) {
-    return false;
+  if (usesTable(*pkey)) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(castToUChar(signed_data_), signed_data_.size(), digest);
+    return pkey->table_->verify(digest, castToUChar(signature_), signature_.size());
   }
 
   evp_md_ctx evp_ctx;
-  if (EVP_DigestVerifyInit(evp_ctx, nullptr, md, nullptr, *pkey) != 1) {
+  if (EVP_DigestVerifyInit(evp_ctx, nullptr, md_, nullptr, *pkey) != 1) {
     fprintf(stderr, "JWT: EVP_DigestVerifyInit failed\n");
     ERR_print_errors_fp(stderr);
     return false;
   }
-  if (EVP_DigestVerifyUpdate(evp_ctx, castToUChar(signed_data), signed_data.size()) != 1) {
+  if (EVP_DigestVerifyUpdate(evp_ctx, castToUChar(signed_data_), signed_data_.size()) != 1) {
     fprintf(stderr, "JWT: EVP_DigestVerifyUpdate failed\n");
     ERR_print_errors_fp(stderr);
     return false;
   }
   std::string asn = signatureToASN(signature_);
   if (EVP_DigestVerifyFinal(evp_ctx, castToUChar(asn), asn.size()) != 1) {
-    fprintf(stderr, "JWT: EVP_DigestVerifyFinal failed\n");
-    ERR_print_errors_fp(stderr);
+    // A signature that doesn't match (or doesn't decode) is an outcome, not an error, and
+    // printing it would make bad tokens the most expensive ones to reject.
+    ERR_clear_error();
     return false;
   }
   return true;
 }
 
-// Returns the parsed header.
-Json::ObjectSharedPtr Jwt::Header() { return header_; }
+bool Jwt::usesTable(const evp_pkey& pkey) {
+  return IsParsed() && pkey.table_ && signature_.size() == 64 && md_ == EVP_sha256();
+}
 
-// Returns the parsed payload.
-Json::ObjectSharedPtr Jwt::Payload() { return payload_; }
+bool Jwt::PrepareBatchVerify(const evp_pkey& pkey, P256Table::BatchSignature& out) {
+  if (!usesTable(pkey)) {
+    return false;
+  }
+
+  SHA256(castToUChar(signed_data_), signed_data_.size(), out.digest_);
+  std::copy(signature_.begin(), signature_.end(), out.signature_);
+  out.table_ = pkey.table_.get();
+  return true;
+}
 
 } // namespace Sft
 } // namespace Http
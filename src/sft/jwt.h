@@ -3,6 +3,9 @@
 #include "common/common/base64.h"
 #include "envoy/json/json_object.h"
 
+#include "ec_table.h"
+#include "verify_status.h"
+
 #include "openssl/bio.h"
 #include "openssl/ec.h"
 #include "openssl/ecdsa.h"
@@ -58,6 +61,10 @@ struct bio {
 
 struct evp_pkey {
   EVP_PKEY* _;
+  // Set for P-256 keys built with precompute, ES256 signatures are verified with it instead of EVP.
+  P256TableConstSharedPtr table_;
+  // Hash of the curve and point, the same for the same key in any process (see VerifiedCache).
+  uint64_t fingerprint_{};
   evp_pkey() : _(EVP_PKEY_new()) {}
   ~evp_pkey() { EVP_PKEY_free(_); }
   operator EVP_PKEY*() { return _; }
@@ -82,30 +89,126 @@ struct ecdsa_sig {
 
 // TODO(morgabra) Make this a class.
 const std::shared_ptr<evp_pkey> ParseECPublicKey(const Json::ObjectSharedPtr& jwk);
+// Same as above, from the jwk's `crv` and url safe base64 encoded `x` and `y` members.
+const std::shared_ptr<evp_pkey> ParseECPublicKey(const std::string& crv, const std::string& x,
+                                                 const std::string& y);
+
+// An EC public key that has been decoded but not materialized: just the curve and the raw affine
+// coordinates, with no OpenSSL objects attached.
+struct CompactECKey {
+  int nid_{-1};
+  std::string point_; // x || y, both halves the same length.
+
+  std::string x() const { return point_.substr(0, point_.size() / 2); }
+  std::string y() const { return point_.substr(point_.size() / 2); }
+  bool operator==(const CompactECKey& rhs) const {
+    return nid_ == rhs.nid_ && point_ == rhs.point_;
+  }
+  bool operator!=(const CompactECKey& rhs) const { return !(*this == rhs); }
+};
 
-class Jwt;
+// Decodes (but does not validate) the jwk members into `out`. Returns false on an unknown curve or
+// bad encoding.
+bool DecodeECPublicKey(const std::string& crv, const std::string& x, const std::string& y,
+                       CompactECKey& out);
+// Builds the OpenSSL key for a decoded jwk, this is the expensive part of loading a key. With
+// `precompute`, P-256 keys also get a P256Table (510KB, a few milliseconds to build).
+const std::shared_ptr<evp_pkey> BuildECPublicKey(const CompactECKey& key, bool precompute = false);
+
+// Why a token couldn't be parsed. Parsing never throws: a malformed token costs about as much to
+// reject as it took to read it.
+enum class JwtStatus {
+  OK,
+  // Not three dot separated segments, or a segment isn't url safe base64.
+  MALFORMED,
+  // The header or payload isn't a JSON object, the header's kid or alg isn't a string, or the
+  // payload has one of the JwtClaims (extra claims included) more than once.
+  BAD_HEADER,
+  BAD_PAYLOAD,
+  // The header has no kid, or an empty one.
+  NO_KID,
+  // The header has no alg, or one that isn't supported.
+  UNSUPPORTED_ALG,
+};
+
+// The verification outcome of a token that failed to parse with `status`.
+VerifyStatus JwtStatusToVerifyStatus(JwtStatus status);
+
+// The registered claims the filter checks, picked out of the payload while it is parsed, so that
+// reading them neither builds the payload's JSON object nor throws. A claim of the wrong type reads
+// as missing (or invalid, for the times), and fails the check that needs it.
+struct JwtClaims {
+  // Empty if missing or not a string.
+  std::string iss_;
+  std::string sub_;
+  std::string jti_;
+  // A string `aud`, or the strings in an array one.
+  std::vector<std::string> aud_;
+  // Set if the payload has the claim. The value is -1 if it isn't a non-negative integer.
+  bool has_nbf_{};
+  int64_t nbf_{-1};
+  bool has_exp_{};
+  int64_t exp_{-1};
+
+  // Claims the filter config reads besides the registered ones, picked out the same way when the
+  // token is parsed with their names (see Jwt()).
+  struct Extra {
+    std::string name_;
+    // Set if the payload has the claim.
+    bool present_{};
+    // Empty if it isn't a string.
+    std::string value_;
+  };
+  std::vector<Extra> extra_;
+
+  // The extra claim named `name`, nullptr if the token wasn't parsed for it.
+  const Extra* extra(const std::string& name) const;
+};
+
+// Checks the registered claims of a token whose signature was verified: iss against `issuer`, aud
+// against any of `audiences`, then nbf and exp against `now` (seconds since the epoch). Returns the
+// first failure, or JWT_VERIFY_SUCCESS. A null `issuer` or `audiences` skips that check, only the
+// tools do that. Each check runs between the claim_check probes.
+VerifyStatus CheckClaims(const JwtClaims& claims, int64_t now, const std::string* issuer,
+                         const std::vector<std::string>* audiences);
 
 class Jwt {
 public:
-  Jwt(const std::string& jwt);
-  bool IsParsed() { return parsed_; };
+  // `extra_claims` names the claims other than the registered ones to pick out of the payload, see
+  // JwtClaims::extra_.
+  Jwt(const std::string& jwt, const std::vector<std::string>& extra_claims = {});
+  JwtStatus Status() const { return status_; }
+  bool IsParsed() const { return status_ == JwtStatus::OK; }
   bool VerifySignature(const std::shared_ptr<evp_pkey> pkey);
-
-  // It returns a pointer to a JSON object of the header of the given JWT.
-  // When the given JWT has a format error, it returns nullptr.
-  // It returns the header JSON even if the signature is invalid.
-  Json::ObjectSharedPtr Header();
-  Json::ObjectSharedPtr Payload();
+  // Returns true and fills in `out` if the signature would be checked with `pkey`'s P256Table, to
+  // verify it in a batch instead (see BatchVerifier).
+  bool PrepareBatchVerify(const evp_pkey& pkey, P256Table::BatchSignature& out);
+
+  // The header's kid and alg, set once the token is parsed.
+  const std::string& Kid() const { return kid_; }
+  const std::string& Alg() const { return alg_; }
+  // The payload's registered and extra claims, set once the token is parsed.
+  const JwtClaims& Claims() const { return claims_; }
+  // The payload's JSON text, as decoded from the token.
+  const std::string& PayloadJson() { return payload_json_; }
 
 private:
-  Json::ObjectSharedPtr header_;
-  std::string header_raw_;
-  Json::ObjectSharedPtr payload_;
-  std::string payload_raw_;
+  // The constructor and VerifySignature() minus their probes.
+  JwtStatus parse(const std::string& jwt);
+  bool verifySignature(const std::shared_ptr<evp_pkey>& pkey);
+  // True if the signature is checked with `pkey`'s P256Table rather than EVP.
+  bool usesTable(const evp_pkey& pkey);
+
+  // header.payload, what the signature covers.
+  std::string signed_data_;
+  std::string kid_;
+  std::string alg_;
+  const EVP_MD* md_{};
+  JwtClaims claims_;
+  std::string payload_json_;
   std::string signature_;
-  std::string signature_raw_;
 
-  bool parsed_;
+  JwtStatus status_;
 };
 
 } // namespace Sft
@@ -0,0 +1,158 @@
+#include "key_cache.h"
+
+#include "common/common/utility.h"
+
+#include <chrono>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+KeyCache::~KeyCache() {
+  flushHits();
+  stats_.jwks_key_cache_size_.sub(index_.size());
+  counters_->size_ -= index_.size();
+}
+
+void KeyCache::flushHits() {
+  if (pending_hits_ > 0) {
+    stats_.jwks_key_cache_hit_.add(pending_hits_);
+    counters_->hits_ += pending_hits_;
+    pending_hits_ = 0;
+  }
+}
+
+std::shared_ptr<evp_pkey> KeyCache::get(const std::string& kid, const CompactECKey& compact,
+                                        KeyCacheResult* result) {
+  auto it = index_.find(kid);
+  if (it != index_.end()) {
+    EntryList::iterator entry = it->second;
+    if (entry->compact_ == compact) {
+      if (++pending_hits_ >= HitFlushInterval) {
+        flushHits();
+      }
+      lru_.splice(lru_.begin(), lru_, entry);
+      if (result) {
+        *result = KeyCacheResult::HIT;
+      }
+      return entry->key_;
+    }
+
+    // Same kid, different key: the IdP reused a kid across a rotation.
+    lru_.erase(entry);
+    index_.erase(it);
+    stats_.jwks_key_cache_size_.dec();
+    counters_->size_--;
+  }
+
+  flushHits();
+  stats_.jwks_key_cache_miss_.inc();
+  counters_->misses_++;
+  if (result) {
+    *result = KeyCacheResult::MISS;
+  }
+  std::shared_ptr<evp_pkey> key = build(kid, compact, true);
+  if (key && working_set_) {
+    working_set_->add(kid);
+  }
+  return key;
+}
+
+void KeyCache::prime(const std::string& kid, const CompactECKey& compact) {
+  if (index_.count(kid) > 0 || index_.size() >= max_size_) {
+    return;
+  }
+  if (build(kid, compact, false) && working_set_) {
+    working_set_->add(kid);
+  }
+}
+
+std::shared_ptr<evp_pkey> KeyCache::build(const std::string& kid, const CompactECKey& compact,
+                                          bool miss) {
+  const MonotonicTime start = ProdMonotonicTimeSource::instance_.currentTime();
+  std::shared_ptr<evp_pkey> key = BuildECPublicKey(compact);
+  const uint64_t build_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                ProdMonotonicTimeSource::instance_.currentTime() - start)
+                                .count();
+  stats_.jwks_key_build_us_.recordValue(build_us);
+  if (miss) {
+    counters_->build_us_ += build_us;
+  }
+  if (!key) {
+    stats_.jwks_key_build_failed_.inc();
+    return nullptr;
+  }
+
+  if (index_.size() >= max_size_) {
+    index_.erase(lru_.back().kid_);
+    lru_.pop_back();
+    stats_.jwks_key_cache_evicted_.inc();
+    stats_.jwks_key_cache_size_.dec();
+    counters_->size_--;
+  }
+
+  lru_.push_front({kid, compact, key});
+  index_[kid] = lru_.begin();
+  stats_.jwks_key_cache_size_.inc();
+  counters_->size_++;
+  return key;
+}
+
+void KeyWorkingSet::add(const std::string& kid) {
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = index_.find(kid);
+  if (it != index_.end()) {
+    kids_.splice(kids_.begin(), kids_, it->second);
+    return;
+  }
+
+  if (index_.size() >= max_size_) {
+    index_.erase(kids_.back());
+    kids_.pop_back();
+  }
+  kids_.push_front(kid);
+  index_[kid] = kids_.begin();
+}
+
+std::vector<std::string> KeyWorkingSet::kids() const {
+  std::unique_lock<std::mutex> lock(lock_);
+  return std::vector<std::string>(kids_.begin(), kids_.end());
+}
+
+void KeyReplicas::update(JWKSConstSharedPtr jwks) {
+  std::unordered_map<std::string, Replica> replicas;
+  jwks->iterate([this, &jwks, &replicas](const std::string& kid, const std::string&, int,
+                                         SystemTime) -> void {
+    const CompactECKey& compact = *jwks->getCompact(kid);
+    auto it = replicas_.find(kid);
+    if (it != replicas_.end() && it->second.compact_ == compact) {
+      replicas.emplace(kid, std::move(it->second));
+      return;
+    }
+
+    std::shared_ptr<evp_pkey> shared = jwks->get(kid);
+    std::shared_ptr<evp_pkey> replica = shared ? BuildECPublicKey(compact) : nullptr;
+    if (!replica) {
+      // Can't happen, the shared key was built from the same point. get() falls back to it.
+      return;
+    }
+    replica->table_ = shared->table_;
+    replicas.emplace(kid, Replica{compact, replica});
+  });
+  replicas_.swap(replicas);
+  jwks_ = jwks;
+}
+
+std::shared_ptr<evp_pkey> KeyReplicas::get(const JWKS& jwks, const std::string& kid) const {
+  if (&jwks == jwks_.get()) {
+    auto it = replicas_.find(kid);
+    if (it != replicas_.end()) {
+      return it->second.key_;
+    }
+  }
+  return jwks.get(kid);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "envoy/stats/stats_macros.h"
+
+#include "jwks.h"
+#include "jwt.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// clang-format off
+#define ALL_KEY_CACHE_STATS(COUNTER, GAUGE, HISTOGRAM)                                      \
+  COUNTER(jwks_key_cache_hit)                                                               \
+  COUNTER(jwks_key_cache_miss)                                                              \
+  COUNTER(jwks_key_cache_evicted)                                                           \
+  COUNTER(jwks_key_build_failed)                                                            \
+  GAUGE(jwks_key_cache_size)                                                                \
+  HISTOGRAM(jwks_key_build_us)
+// clang-format on
+
+struct KeyCacheStats {
+  ALL_KEY_CACHE_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+// Cache efficiency of a single provider, summed over every worker's cache. The stats above are
+// shared by all providers; these are reported per source by the admin endpoint.
+struct KeyCacheCounters {
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> size_{0};
+  std::atomic<uint64_t> build_us_{0};
+};
+
+typedef std::shared_ptr<KeyCacheCounters> KeyCacheCountersSharedPtr;
+
+// The kids a provider's workers most recently had to build keys for, shared by all of them and
+// bounded to the key cache size. Handed to the provider's replacement (see RetainedJwks) so that
+// its workers build that working set when they start instead of on the first request for each
+// kid. Only written on a key cache miss.
+class KeyWorkingSet {
+public:
+  KeyWorkingSet(size_t max_size) : max_size_(max_size) {}
+
+  void add(const std::string& kid);
+  // Most recently added first.
+  std::vector<std::string> kids() const;
+
+private:
+  const size_t max_size_;
+  mutable std::mutex lock_;
+  std::list<std::string> kids_; // Most recently added at the front.
+  std::unordered_map<std::string, std::list<std::string>::iterator> index_;
+};
+
+typedef std::shared_ptr<KeyWorkingSet> KeyWorkingSetSharedPtr;
+
+// How a key lookup was served, reported on the verify tracing span.
+enum class KeyCacheResult { NOT_CACHED, HIT, MISS };
+
+// Bounded LRU of materialized keys for a lazy JWKS, owned by a single worker (not thread safe).
+//
+// Entries are keyed by kid and remember the point they were built from, so a refreshed key set
+// that still carries the same key keeps hitting, while a rotated key under a reused kid is rebuilt.
+// Hits are added to the shared stats in bulk (every HitFlushInterval hits, on a miss, and when
+// the cache goes away) so that a hit only writes the worker's own memory. Kids built on a miss are
+// added to `working_set`, if set.
+class KeyCache {
+public:
+  KeyCache(size_t max_size, const KeyCacheStats& stats, KeyCacheCountersSharedPtr counters,
+           KeyWorkingSetSharedPtr working_set = nullptr)
+      : max_size_(max_size), stats_(stats), counters_(counters), working_set_(working_set) {}
+  ~KeyCache();
+
+  // Returns the key for `kid`, building it from `compact` on a miss. Returns nullptr if the key
+  // can't be built. If `result` is set it receives whether the lookup hit.
+  std::shared_ptr<evp_pkey> get(const std::string& kid, const CompactECKey& compact,
+                                KeyCacheResult* result = nullptr);
+  // Builds the key for `kid` ahead of its first lookup, unless it is cached already or the cache
+  // is full. Not counted as a miss.
+  void prime(const std::string& kid, const CompactECKey& compact);
+
+  size_t size() const { return index_.size(); }
+
+  static const uint64_t HitFlushInterval = 256;
+
+private:
+  struct Entry {
+    std::string kid_;
+    CompactECKey compact_;
+    std::shared_ptr<evp_pkey> key_;
+  };
+  typedef std::list<Entry> EntryList;
+
+  void flushHits();
+  // Builds the key for `kid` and adds it, evicting the least recently used key if full. Only the
+  // build time of misses counts towards the per provider average.
+  std::shared_ptr<evp_pkey> build(const std::string& kid, const CompactECKey& compact, bool miss);
+
+  const size_t max_size_;
+  KeyCacheStats stats_;
+  KeyCacheCountersSharedPtr counters_;
+  KeyWorkingSetSharedPtr working_set_;
+  EntryList lru_; // Most recently used at the front.
+  std::unordered_map<std::string, EntryList::iterator> index_;
+  uint64_t pending_hits_{};
+};
+
+// A worker's own copies of an eager key set's keys. Every worker sees the same published JWKS, and
+// its evp_pkeys are reference counted, by the shared_ptr handed out per lookup and by EVP on every
+// verify, so sharing them bounces their cache lines between the cores verifying with them. With
+// replicas the request path only writes the worker's own memory.
+//
+// Replicas are built when a key set is published, from its decoded points, and share the
+// original's P256Table (read only), so lookups never build a key. A newly published key set keeps
+// the replicas of the kids whose key didn't change. Not thread safe, each worker owns its own.
+class KeyReplicas {
+public:
+  // Replicates every key of the eager key set `jwks`, dropping the replicas of the kids it removed
+  // or rotated.
+  void update(JWKSConstSharedPtr jwks);
+
+  // The key for `kid` in `jwks`: the replica if `jwks` is the key set last replicated, otherwise
+  // the shared key (the worker already reads a key set its replicas haven't caught up with).
+  // Returns nullptr if the kid is unknown.
+  std::shared_ptr<evp_pkey> get(const JWKS& jwks, const std::string& kid) const;
+
+  size_t size() const { return replicas_.size(); }
+
+private:
+  struct Replica {
+    CompactECKey compact_;
+    std::shared_ptr<evp_pkey> key_;
+  };
+
+  JWKSConstSharedPtr jwks_;
+  std::unordered_map<std::string, Replica> replicas_;
+};
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,74 @@
+#include "load_shedder.h"
+
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+
+#include <cmath>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+// Weight of a new measurement in the latency average.
+const double LatencyWeight = 1.0 / 16;
+const double LatencyHalfLifeUs = 1000000;
+} // namespace
+
+LoadShedder::LoadShedder(const Json::Object& config, ThreadLocal::SlotAllocator& tls)
+    : max_in_flight_(config.getInteger("shed_max_in_flight", 0)),
+      max_verify_us_(config.getInteger("shed_max_verify_us", 0)),
+      retry_after_(std::to_string(config.getInteger("shed_retry_after_s", 1))),
+      tls_(tls.allocateSlot()) {
+  if (config.getInteger("shed_max_in_flight", 0) < 0) {
+    throw EnvoyException("invalid 'shed_max_in_flight' in sft filter config");
+  }
+  if (config.getInteger("shed_max_verify_us", 0) < 0) {
+    throw EnvoyException("invalid 'shed_max_verify_us' in sft filter config");
+  }
+  if (config.getInteger("shed_retry_after_s", 1) <= 0) {
+    throw EnvoyException("invalid 'shed_retry_after_s' in sft filter config");
+  }
+
+  tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<ThreadLocalState>();
+  });
+}
+
+bool LoadShedder::configured(const Json::Object& config) {
+  return config.hasObject("shed_max_in_flight") || config.hasObject("shed_max_verify_us");
+}
+
+ShedReason LoadShedder::shed() {
+  const ThreadLocalState& state = tls_->getTyped<ThreadLocalState>();
+  if (max_in_flight_ > 0 && state.in_flight_ >= max_in_flight_) {
+    return ShedReason::IN_FLIGHT;
+  }
+  if (max_verify_us_ > 0 &&
+      state.latencyUs(ProdMonotonicTimeSource::instance_.currentTime()) > max_verify_us_) {
+    return ShedReason::LATENCY;
+  }
+  return ShedReason::NONE;
+}
+
+void LoadShedder::paused() { tls_->getTyped<ThreadLocalState>().in_flight_++; }
+
+void LoadShedder::resumed() { tls_->getTyped<ThreadLocalState>().in_flight_--; }
+
+void LoadShedder::recordLatency(std::chrono::nanoseconds elapsed) {
+  ThreadLocalState& state = tls_->getTyped<ThreadLocalState>();
+  const MonotonicTime now = ProdMonotonicTimeSource::instance_.currentTime();
+  const double average = state.latencyUs(now);
+  state.latency_us_ = average + (elapsed.count() / 1000.0 - average) * LatencyWeight;
+  state.updated_ = now;
+}
+
+double LoadShedder::ThreadLocalState::latencyUs(MonotonicTime now) const {
+  const double idle_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - updated_).count();
+  return latency_us_ * std::exp2(-idle_us / LatencyHalfLifeUs);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "envoy/common/time.h"
+#include "envoy/json/json_object.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+enum class ShedReason { NONE, IN_FLIGHT, LATENCY };
+
+// Rejects cold-token requests, the ones that would need a signature check, while a worker is
+// saturated (`shed_max_in_flight`, `shed_max_verify_us`, `shed_retry_after_s`). Requests that
+// verify without one (whitelisted paths, session cookies, verified cache hits) are never shed.
+//
+// Each worker tracks the verifications it has paused (kid-miss refetches and batched signatures)
+// and an average of its recent cold verification times. The average halves every second nothing
+// is measured, so a worker that sheds everything starts letting requests through again and measures
+// afresh instead of shedding forever.
+class LoadShedder {
+public:
+  LoadShedder(const Json::Object& config, ThreadLocal::SlotAllocator& tls);
+
+  // True if the filter config asks for load shedding.
+  static bool configured(const Json::Object& config);
+
+  // Retry-After value of shed requests.
+  const std::string& retryAfter() const { return retry_after_; }
+
+  // Worker only. Whether to shed a cold-token request now.
+  ShedReason shed();
+  // Worker only. A verification was paused, or a paused one completed or was abandoned.
+  void paused();
+  void resumed();
+  // Worker only. Adds a cold verification's time, queueing included, to the average.
+  void recordLatency(std::chrono::nanoseconds elapsed);
+
+private:
+  struct ThreadLocalState : public ThreadLocal::ThreadLocalObject {
+    // Decays latency_us_ to `now`.
+    double latencyUs(MonotonicTime now) const;
+
+    uint64_t in_flight_{};
+    double latency_us_{};
+    MonotonicTime updated_{};
+  };
+
+  const uint64_t max_in_flight_;
+  const uint64_t max_verify_us_;
+  const std::string retry_after_;
+  ThreadLocal::SlotPtr tls_;
+};
+
+typedef std::unique_ptr<LoadShedder> LoadShedderPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,12 @@
+#include "probes.h"
+
+#ifdef SFT_USDT
+
+// The semaphores live in .probes, where tracers expect to find them.
+#define SFT_DEFINE_PROBE_SEMAPHORE(NAME)                                                         \
+  volatile unsigned short sft_##NAME##_semaphore __attribute__((section(".probes"), used)) = 0;
+extern "C" {
+ALL_SFT_PROBES(SFT_DEFINE_PROBE_SEMAPHORE)
+}
+
+#endif
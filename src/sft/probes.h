@@ -0,0 +1,98 @@
+#pragma once
+
+// USDT probes (provider "sft") on the verification path, for perf and bpftrace on live proxies.
+// See integration_test/bpftrace.md for the probe list and example scripts.
+//
+// A probe site is a single nop until a tracer attaches. Arguments that cost something to compute,
+// such as elapsed times and status names, are only computed while a tracer is attached to that
+// probe: every probe has a semaphore the tracer increments, checked with SFT_PROBE_ENABLED().
+// Tracers that don't maintain semaphores still see every probe, with those arguments zero or
+// empty.
+//
+// Probes are compiled in when <sys/sdt.h> (systemtap-sdt-dev) is available, unless
+// SFT_DISABLE_USDT is defined.
+
+#include "verify_status.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if !defined(SFT_DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define SFT_USDT 1
+#endif
+#endif
+
+// clang-format off
+#define ALL_SFT_PROBES(PROBE)                                                               \
+  PROBE(jwt_parse_start)                                                                    \
+  PROBE(jwt_parse_done)                                                                     \
+  PROBE(jwt_verify_start)                                                                   \
+  PROBE(jwt_verify_done)                                                                    \
+  PROBE(jwks_get_start)                                                                     \
+  PROBE(jwks_get_done)                                                                      \
+  PROBE(claim_check_start)                                                                  \
+  PROBE(claim_check_done)                                                                   \
+  PROBE(verify_done)                                                                        \
+  PROBE(verify_batch_done)                                                                  \
+  PROBE(jwks_refresh_start)                                                                 \
+  PROBE(jwks_refresh_done)
+// clang-format on
+
+#ifdef SFT_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define SFT_DECLARE_PROBE_SEMAPHORE(NAME) extern volatile unsigned short sft_##NAME##_semaphore;
+extern "C" {
+ALL_SFT_PROBES(SFT_DECLARE_PROBE_SEMAPHORE)
+}
+
+#define SFT_PROBE_ENABLED(NAME) __builtin_expect(sft_##NAME##_semaphore != 0, 0)
+#define SFT_PROBE1(NAME, A) STAP_PROBE1(sft, NAME, A)
+#define SFT_PROBE2(NAME, A, B) STAP_PROBE2(sft, NAME, A, B)
+#define SFT_PROBE3(NAME, A, B, C) STAP_PROBE3(sft, NAME, A, B, C)
+#define SFT_PROBE4(NAME, A, B, C, D) STAP_PROBE4(sft, NAME, A, B, C, D)
+
+#else
+
+// Arguments are left unevaluated, but still count as used.
+#define SFT_PROBE_ENABLED(NAME) false
+#define SFT_PROBE1(NAME, A) static_cast<void>(sizeof(A))
+#define SFT_PROBE2(NAME, A, B) static_cast<void>(sizeof(A) + sizeof(B))
+#define SFT_PROBE3(NAME, A, B, C) static_cast<void>(sizeof(A) + sizeof(B) + sizeof(C))
+#define SFT_PROBE4(NAME, A, B, C, D)                                                               \
+  static_cast<void>(sizeof(A) + sizeof(B) + sizeof(C) + sizeof(D))
+
+#endif
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Monotonic timestamp for probe elapsed times.
+inline uint64_t ProbeNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Time since `start`, or 0 if `start` wasn't taken.
+inline uint64_t ProbeElapsedNs(uint64_t start) { return start ? ProbeNowNs() - start : 0; }
+
+// Runs one claim check between the claim_check_start and claim_check_done probes. `check` returns
+// JWT_VERIFY_SUCCESS when the claim passes.
+template <class Check> VerifyStatus ProbeClaimCheck(const char* claim, Check check) {
+  const uint64_t start = SFT_PROBE_ENABLED(claim_check_done) ? ProbeNowNs() : 0;
+  SFT_PROBE1(claim_check_start, claim);
+  const VerifyStatus status = check();
+  const std::string name = start ? VerifyStatusToString(status) : "";
+  SFT_PROBE3(claim_check_done, claim, name.c_str(), ProbeElapsedNs(start));
+  return status;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,108 @@
+#include "rate_limiter.h"
+
+#include "common/common/hash.h"
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+// Keeps thousandths of a token within 32 bits.
+const uint32_t MaxBurst = 1000000;
+} // namespace
+
+RateLimitTable::RateLimitTable(size_t capacity, uint32_t rate_per_s, uint32_t burst)
+    : rate_per_s_(rate_per_s), burst_milli_(burst * 1000),
+      mask_([capacity]() -> size_t {
+        size_t size = ProbeWindow;
+        while (size < capacity) {
+          size <<= 1;
+        }
+        return size - 1;
+      }()),
+      slots_(mask_ + 1, Slot{0, 0, 0}) {}
+
+bool RateLimitTable::consume(uint64_t hash, uint32_t now_ms, bool& evicted) {
+  evicted = false;
+  hash = std::max<uint64_t>(hash, 1);
+
+  Slot* found = nullptr;
+  Slot* victim = nullptr;
+  for (size_t i = 0; i < ProbeWindow; i++) {
+    Slot& slot = slots_[(hash + i) & mask_];
+    if (slot.hash_ == hash) {
+      found = &slot;
+      break;
+    }
+    // Keys are never removed, only replaced, so a key is never past the first empty slot.
+    if (slot.hash_ == 0) {
+      victim = &slot;
+      break;
+    }
+    if (!victim || now_ms - slot.last_ms_ > now_ms - victim->last_ms_) {
+      victim = &slot;
+    }
+  }
+
+  if (!found) {
+    evicted = victim->hash_ != 0;
+    *victim = {hash, burst_milli_, now_ms};
+    found = victim;
+  } else {
+    // rate/s is rate thousandths of a token per ms.
+    const uint64_t refill = static_cast<uint64_t>(now_ms - found->last_ms_) * rate_per_s_;
+    found->tokens_ = std::min<uint64_t>(found->tokens_ + refill, burst_milli_);
+    found->last_ms_ = now_ms;
+  }
+
+  if (found->tokens_ < 1000) {
+    return false;
+  }
+  found->tokens_ -= 1000;
+  return true;
+}
+
+RateLimiter::RateLimiter(const Json::Object& config, ThreadLocal::SlotAllocator& tls)
+    : claim_(config.getString("rate_limit_claim", "sub")), tls_(tls.allocateSlot()) {
+  const int64_t rate_per_s = config.getInteger("rate_limit_per_s");
+  const int64_t burst = config.getInteger("rate_limit_burst", rate_per_s);
+  const int64_t capacity = config.getInteger("rate_limit_table_size", 65536);
+  if (rate_per_s <= 0 || rate_per_s > MaxBurst) {
+    throw EnvoyException("invalid 'rate_limit_per_s' in sft filter config");
+  }
+  if (burst <= 0 || burst > MaxBurst) {
+    throw EnvoyException("invalid 'rate_limit_burst' in sft filter config");
+  }
+  if (capacity <= 0 || capacity > (1 << 24)) {
+    throw EnvoyException("invalid 'rate_limit_table_size' in sft filter config");
+  }
+  if (claim_.empty()) {
+    throw EnvoyException("empty 'rate_limit_claim' in sft filter config");
+  }
+
+  tls_->set([rate_per_s, burst, capacity](Event::Dispatcher&)
+                -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<ThreadLocalTable>(capacity, rate_per_s, burst);
+  });
+}
+
+bool RateLimiter::configured(const Json::Object& config) {
+  return config.hasObject("rate_limit_per_s");
+}
+
+bool RateLimiter::allow(const std::string& value, bool& evicted) {
+  const uint32_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              ProdMonotonicTimeSource::instance_.currentTime().time_since_epoch())
+                              .count();
+  return tls_->getTyped<ThreadLocalTable>().table_.consume(HashUtil::xxHash64(value), now_ms,
+                                                           evicted);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "envoy/json/json_object.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Token buckets for one worker, keyed by the hash of a claim value, in a fixed-size open-addressing
+// table: 16 bytes per bucket and no allocation after construction. A key lives in one of the
+// ProbeWindow slots following its hash. When they are all taken, the least recently used of them
+// is evicted, so memory stays bounded and idle keys age out (an approximate LRU).
+class RateLimitTable {
+public:
+  // Slots in a key's probe window, four per cache line.
+  static const size_t ProbeWindow = 8;
+
+  // `capacity` is rounded up to a power of two. Buckets refill at `rate_per_s` tokens per second
+  // up to `burst` tokens.
+  RateLimitTable(size_t capacity, uint32_t rate_per_s, uint32_t burst);
+
+  // Takes a token from `hash`'s bucket, starting a new key with a full bucket. Returns false if the
+  // bucket is empty. `evicted` is set if another key was evicted to make room. Times only need to
+  // be consistent modulo 2^32 ms.
+  bool consume(uint64_t hash, uint32_t now_ms, bool& evicted);
+
+  size_t capacity() const { return slots_.size(); }
+
+private:
+  struct Slot {
+    uint64_t hash_;    // 0 for an empty slot.
+    uint32_t tokens_;  // Thousandths of a token.
+    uint32_t last_ms_; // Last refill, wraps every ~49 days.
+  };
+
+  const uint32_t rate_per_s_;
+  const uint32_t burst_milli_;
+  const size_t mask_;
+  std::vector<Slot> slots_;
+};
+
+// Per-subject rate limiting after verification (`rate_limit_per_s`, `rate_limit_burst`,
+// `rate_limit_claim`, `rate_limit_table_size`). Every worker has its own table and limits are
+// applied per worker, with no coordination between them.
+class RateLimiter {
+public:
+  RateLimiter(const Json::Object& config, ThreadLocal::SlotAllocator& tls);
+
+  // True if the filter config asks for rate limiting.
+  static bool configured(const Json::Object& config);
+
+  // The claim requests are keyed on.
+  const std::string& claim() const { return claim_; }
+
+  // Worker only. Takes a token for `value`, returns false if it is over its limit.
+  bool allow(const std::string& value, bool& evicted);
+
+private:
+  struct ThreadLocalTable : public ThreadLocal::ThreadLocalObject {
+    ThreadLocalTable(size_t capacity, uint32_t rate_per_s, uint32_t burst)
+        : table_(capacity, rate_per_s, burst) {}
+    RateLimitTable table_;
+  };
+
+  const std::string claim_;
+  ThreadLocal::SlotPtr tls_;
+};
+
+typedef std::unique_ptr<RateLimiter> RateLimiterPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
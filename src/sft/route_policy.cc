@@ -0,0 +1,138 @@
+#include "route_policy.h"
+
+#include "common/common/hash.h"
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const std::string OpaqueAuth = "scaleft.accessfabric.auth";
+const std::string OpaqueIssuer = "scaleft.accessfabric.iss";
+const std::string OpaqueAudience = "scaleft.accessfabric.aud";
+
+// Cached routes beyond this trigger a sweep of routes that have since been freed.
+const size_t CacheSweepSize = 1024;
+
+bool parseAuth(const std::string& value, RoutePolicy::Auth& auth) {
+  if (value == "required") {
+    auth = RoutePolicy::Auth::REQUIRED;
+  } else if (value == "optional") {
+    auth = RoutePolicy::Auth::OPTIONAL;
+  } else if (value == "disabled") {
+    auth = RoutePolicy::Auth::DISABLED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+RoutePolicy RoutePolicy::fromJson(const Json::Object& json, const RoutePolicy& base) {
+  RoutePolicy policy = base;
+  const std::string auth = json.getString("auth", "");
+  if (!auth.empty() && !parseAuth(auth, policy.auth_)) {
+    throw EnvoyException(fmt::format("invalid 'auth' '{}' in sft virtual host policy", auth));
+  }
+  policy.issuer_ = json.getString("iss", policy.issuer_);
+  if (json.hasObject("aud")) {
+    policy.audiences_ = json.getStringArray("aud");
+  }
+  return policy;
+}
+
+bool RoutePolicy::fromOpaqueConfig(const std::multimap<std::string, std::string>& opaque,
+                                   const RoutePolicy& base, RoutePolicy& out) {
+  auto auth = opaque.find(OpaqueAuth);
+  auto issuer = opaque.find(OpaqueIssuer);
+  auto audience = opaque.find(OpaqueAudience);
+  if (auth == opaque.end() && issuer == opaque.end() && audience == opaque.end()) {
+    return false;
+  }
+
+  out = base;
+  // An unknown value fails closed, auth stays required.
+  if (auth != opaque.end() && !parseAuth(auth->second, out.auth_)) {
+    out.auth_ = Auth::REQUIRED;
+  }
+  if (issuer != opaque.end()) {
+    out.issuer_ = issuer->second;
+  }
+  if (audience != opaque.end()) {
+    out.audiences_ = StringUtil::split(audience->second, ',');
+  }
+  return true;
+}
+
+uint64_t RoutePolicy::claimsHash() const {
+  // Length prefixed, so no two policies serialize the same.
+  std::string claims = fmt::format("{}:{}", issuer_.size(), issuer_);
+  for (const std::string& audience : audiences_) {
+    claims += fmt::format("{}:{}", audience.size(), audience);
+  }
+  return HashUtil::xxHash64(claims);
+}
+
+RoutePolicyResolver::RoutePolicyResolver(
+    const RoutePolicy& default_policy,
+    std::unordered_map<std::string, RoutePolicyConstSharedPtr>&& vhost_policies,
+    ThreadLocal::SlotAllocator& tls)
+    : default_policy_(std::make_shared<const RoutePolicy>(default_policy)),
+      vhost_policies_(std::move(vhost_policies)), tls_(tls.allocateSlot()) {
+  tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<ThreadLocalCache>();
+  });
+}
+
+RoutePolicyConstSharedPtr RoutePolicyResolver::resolve(const Router::RouteConstSharedPtr& route) {
+  if (!route || !route->routeEntry()) {
+    return default_policy_;
+  }
+
+  std::unordered_map<const Router::Route*, CachedPolicy>& policies =
+      tls_->getTyped<ThreadLocalCache>().policies_;
+  auto it = policies.find(route.get());
+  if (it != policies.end() && !it->second.route_.expired()) {
+    return it->second.policy_;
+  }
+
+  if (it == policies.end() && policies.size() >= CacheSweepSize) {
+    for (auto entry = policies.begin(); entry != policies.end();) {
+      if (entry->second.route_.expired()) {
+        entry = policies.erase(entry);
+      } else {
+        ++entry;
+      }
+    }
+  }
+
+  RoutePolicyConstSharedPtr policy = compile(*route->routeEntry());
+  policies[route.get()] = {route, policy};
+  return policy;
+}
+
+RoutePolicyConstSharedPtr RoutePolicyResolver::compile(const Router::RouteEntry& entry) const {
+  RoutePolicyConstSharedPtr base = default_policy_;
+  auto vhost = vhost_policies_.find(entry.virtualHost().name());
+  if (vhost != vhost_policies_.end()) {
+    base = vhost->second;
+  }
+
+  RoutePolicy route_policy;
+  if (!RoutePolicy::fromOpaqueConfig(entry.opaqueConfig(), *base, route_policy)) {
+    return base;
+  }
+  ENVOY_LOG(debug, "RoutePolicyResolver::{}: route overrides policy for virtual host {}", __func__,
+            entry.virtualHost().name());
+  return std::make_shared<const RoutePolicy>(route_policy);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
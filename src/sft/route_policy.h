@@ -0,0 +1,81 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "envoy/json/json_object.h"
+#include "envoy/router/router.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// How requests on a route are authenticated. The filter config's `iss` and `aud` are the default
+// policy; a virtual host can override it through the filter's `virtual_host_policies`, and a route
+// through its `opaque_config`:
+//
+//   "scaleft.accessfabric.auth": "required" | "optional" | "disabled"
+//   "scaleft.accessfabric.iss": "<issuer>"
+//   "scaleft.accessfabric.aud": "<audience>[,<audience>...]"
+struct RoutePolicy {
+  enum class Auth { REQUIRED, OPTIONAL, DISABLED };
+
+  Auth auth_{Auth::REQUIRED};
+  std::string issuer_;
+  std::vector<std::string> audiences_;
+
+  // Identifies the issuer and audiences tokens are checked against, so that a session cookie issued
+  // under one policy isn't accepted under another.
+  uint64_t claimsHash() const;
+
+  // `base` with the overrides of a `virtual_host_policies` entry applied. Throws EnvoyException on
+  // an invalid entry.
+  static RoutePolicy fromJson(const Json::Object& json, const RoutePolicy& base);
+  // `base` with a route's opaque_config overrides applied. Returns false (leaving `out` unset) if
+  // the route doesn't override anything.
+  static bool fromOpaqueConfig(const std::multimap<std::string, std::string>& opaque,
+                               const RoutePolicy& base, RoutePolicy& out);
+};
+
+typedef std::shared_ptr<const RoutePolicy> RoutePolicyConstSharedPtr;
+
+// Resolves the policy for a route. Compiled policies are cached per worker by route, so after the
+// first request on a route resolving is a single hash lookup. Entries remember the route through a
+// weak_ptr, so a route freed by a route table update (whose address may be reused) is never
+// mistaken for a live one.
+class RoutePolicyResolver : public Logger::Loggable<Logger::Id::http> {
+public:
+  RoutePolicyResolver(const RoutePolicy& default_policy,
+                      std::unordered_map<std::string, RoutePolicyConstSharedPtr>&& vhost_policies,
+                      ThreadLocal::SlotAllocator& tls);
+
+  // Worker only. `route` may be null.
+  RoutePolicyConstSharedPtr resolve(const Router::RouteConstSharedPtr& route);
+
+private:
+  struct CachedPolicy {
+    std::weak_ptr<const Router::Route> route_;
+    RoutePolicyConstSharedPtr policy_;
+  };
+
+  struct ThreadLocalCache : public ThreadLocal::ThreadLocalObject {
+    std::unordered_map<const Router::Route*, CachedPolicy> policies_;
+  };
+
+  RoutePolicyConstSharedPtr compile(const Router::RouteEntry& entry) const;
+
+  const RoutePolicyConstSharedPtr default_policy_;
+  const std::unordered_map<std::string, RoutePolicyConstSharedPtr> vhost_policies_;
+  ThreadLocal::SlotPtr tls_;
+};
+
+typedef std::unique_ptr<RoutePolicyResolver> RoutePolicyResolverPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,136 @@
+#include "session_cookie.h"
+
+#include "common/common/base64.h"
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+
+#include "openssl/hmac.h"
+#include "openssl/mem.h"
+#include "openssl/sha.h"
+
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+const LowerCaseString CookieHeader("cookie");
+// Truncated SHA-256 of the JWT, enough to tie a cookie to a single token.
+const size_t TokenHashSize = 16;
+
+// Unlike StringUtil::split keeps empty fields, e.g. the jti of a token without one.
+std::vector<std::string> splitFields(const std::string& value) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (size_t end = value.find('.'); end != std::string::npos; end = value.find('.', start)) {
+    fields.push_back(value.substr(start, end - start));
+    start = end + 1;
+  }
+  fields.push_back(value.substr(start));
+  return fields;
+}
+} // namespace
+
+SessionCookie::SessionCookie(const std::string& name, const std::string& secret,
+                             std::chrono::seconds max_age)
+    : name_(name), secret_(secret), max_age_(max_age) {
+  if (secret_.size() < 32) {
+    throw EnvoyException("'session_cookie_secret' must be at least 32 bytes in sft filter config");
+  }
+  if (max_age_.count() <= 0) {
+    throw EnvoyException("invalid 'session_cookie_max_age_s' in sft filter config");
+  }
+}
+
+std::string SessionCookie::tokenHash(const char* jwt, size_t size) const {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const uint8_t*>(jwt), size, digest);
+  return Base64::encode(reinterpret_cast<const char*>(digest), TokenHashSize);
+}
+
+std::string SessionCookie::mac(const std::string& data) const {
+  uint8_t digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  HMAC(EVP_sha256(), secret_.data(), secret_.size(), reinterpret_cast<const uint8_t*>(data.data()),
+       data.size(), digest, &digest_len);
+  return Base64::encode(reinterpret_cast<const char*>(digest), digest_len);
+}
+
+std::string SessionCookie::issue(const std::string& jwt, const Session& session, uint64_t scope,
+                                 int64_t token_exp, int64_t now) const {
+  int64_t exp = now + max_age_.count();
+  if (token_exp > 0 && token_exp < exp) {
+    exp = token_exp;
+  }
+
+  const std::string payload =
+      fmt::format("{}.{}.{}.{}.{}.{}", exp, scope,
+                  Base64::encode(session.sub_.data(), session.sub_.size()),
+                  Base64::encode(session.jti_.data(), session.jti_.size()),
+                  Base64::encode(session.rate_limit_key_.data(), session.rate_limit_key_.size()),
+                  tokenHash(jwt.data(), jwt.size()));
+  return fmt::format("{}={}.{}; Path=/; Max-Age={}; Secure; HttpOnly; SameSite=Lax", name_,
+                     payload, mac(payload), exp - now);
+}
+
+std::string SessionCookie::cookieValue(const HeaderMap& headers) const {
+  const HeaderEntry* cookie = headers.get(CookieHeader);
+  if (!cookie) {
+    return "";
+  }
+
+  for (const std::string& pair : StringUtil::split(cookie->value().c_str(), ';')) {
+    const size_t start = pair.find_first_not_of(' ');
+    if (start == std::string::npos) {
+      continue;
+    }
+    if (pair.compare(start, name_.size(), name_) == 0 && pair.size() > start + name_.size() &&
+        pair[start + name_.size()] == '=') {
+      return pair.substr(start + name_.size() + 1);
+    }
+  }
+  return "";
+}
+
+bool SessionCookie::validate(const HeaderMap& headers, const HeaderEntry* jwt, uint64_t scope,
+                             int64_t now, Session& session) const {
+  const std::string value = cookieValue(headers);
+  const size_t mac_start = value.rfind('.');
+  if (mac_start == std::string::npos) {
+    return false;
+  }
+
+  const std::string payload = value.substr(0, mac_start);
+  const std::string expected = mac(payload);
+  if (value.size() - mac_start - 1 != expected.size() ||
+      CRYPTO_memcmp(value.data() + mac_start + 1, expected.data(), expected.size()) != 0) {
+    return false;
+  }
+
+  const std::vector<std::string> parts = splitFields(payload);
+  if (parts.size() != 6) {
+    return false;
+  }
+  uint64_t exp = 0;
+  if (!StringUtil::atoul(parts[0].c_str(), exp) || static_cast<int64_t>(exp) <= now) {
+    return false;
+  }
+  uint64_t issued_scope = 0;
+  if (!StringUtil::atoul(parts[1].c_str(), issued_scope) || issued_scope != scope) {
+    return false;
+  }
+  if (jwt && parts[5] != tokenHash(jwt->value().c_str(), jwt->value().size())) {
+    return false;
+  }
+
+  session.sub_ = Base64::decode(parts[2]);
+  session.jti_ = Base64::decode(parts[3]);
+  session.rate_limit_key_ = Base64::decode(parts[4]);
+  return true;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
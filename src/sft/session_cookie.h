@@ -0,0 +1,65 @@
+#pragma once
+
+#include "envoy/http/header_map.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Stateless session cookie handed out after a full JWT verification, so that follow up requests
+// (e.g. a browser loading assets) are accepted with a single HMAC instead of an ECDSA verify.
+//
+// The cookie value is
+//
+//   <exp>.<scope>.<b64 sub>.<b64 jti>.<b64 rate limit key>.<b64 token hash>.<b64 hmac>
+//
+// where the HMAC-SHA256 covers everything before it, `exp` is the earlier of the token's own expiry
+// and `max_age` from issue and `scope` identifies the checks the token passed (see
+// SftJwtDecoderFilter::cookieScope()). Every node configured with the same secret accepts every
+// other node's cookies.
+class SessionCookie {
+public:
+  // The claims of the token a cookie was issued for that requests carrying it are checked against.
+  struct Session {
+    std::string sub_;
+    // Empty if the token had none.
+    std::string jti_;
+    // The value of the token's `rate_limit_claim`, empty if it had none or isn't rate limited.
+    std::string rate_limit_key_;
+  };
+
+  // Throws EnvoyException if `secret` is too short to be a useful HMAC key.
+  SessionCookie(const std::string& name, const std::string& secret, std::chrono::seconds max_age);
+
+  // The Set-Cookie header value for a `jwt` verified under `scope`. `token_exp` is the token's
+  // `exp` claim, or 0 if it has none. Times are in seconds since the epoch.
+  std::string issue(const std::string& jwt, const Session& session, uint64_t scope,
+                    int64_t token_exp, int64_t now) const;
+
+  // Returns true if `headers` carry a valid, unexpired session cookie issued under `scope`, storing
+  // what it was issued for in `session`. If the request also carries a JWT (`jwt` is non-null) the
+  // cookie must have been issued for that same token.
+  bool validate(const HeaderMap& headers, const HeaderEntry* jwt, uint64_t scope, int64_t now,
+                Session& session) const;
+
+private:
+  std::string tokenHash(const char* jwt, size_t size) const;
+  std::string mac(const std::string& data) const;
+  // The value of our cookie in the request's Cookie header, or empty.
+  std::string cookieValue(const HeaderMap& headers) const;
+
+  const std::string name_;
+  const std::string secret_;
+  const std::chrono::seconds max_age_;
+};
+
+typedef std::unique_ptr<SessionCookie> SessionCookiePtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
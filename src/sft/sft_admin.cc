@@ -0,0 +1,67 @@
+#include "sft_admin.h"
+
+#include "common/common/utility.h"
+#include "common/http/utility.h"
+
+#include <algorithm>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+const std::string AdminPrefix = "/accessfabric";
+const uint64_t DefaultMaxKids = 100;
+} // namespace
+
+SftAdmin::SftAdmin(Server::Admin& admin) : admin_(admin) {
+  admin_.addHandler(AdminPrefix, "scaleft accessfabric verify, jwks and key cache state",
+                    [this](const std::string& url, Buffer::Instance& response) -> Http::Code {
+                      return handler(url, response);
+                    },
+                    true);
+}
+
+SftAdmin::~SftAdmin() { admin_.removeHandler(AdminPrefix); }
+
+void SftAdmin::addConfig(SFTConfigSharedPtr config) { configs_.push_back(config); }
+
+Http::Code SftAdmin::handler(const std::string& url, Buffer::Instance& response) {
+  uint64_t max_kids = DefaultMaxKids;
+  Http::Utility::QueryParams params = Http::Utility::parseQueryString(url);
+  if (params.find("kids") != params.end() &&
+      !StringUtil::atoul(params["kids"].c_str(), max_kids)) {
+    response.add("invalid 'kids' parameter\n");
+    return Http::Code::BadRequest;
+  }
+
+  // Drop configs torn down since the last scrape.
+  configs_.erase(std::remove_if(configs_.begin(), configs_.end(),
+                                [](const std::weak_ptr<SFTConfig>& config) -> bool {
+                                  return config.expired();
+                                }),
+                 configs_.end());
+
+  rapidjson::StringBuffer buffer;
+  AdminWriter writer(buffer);
+  writer.StartObject();
+  writer.Key("configs");
+  writer.StartArray();
+  for (const std::weak_ptr<SFTConfig>& weak_config : configs_) {
+    SFTConfigSharedPtr config = weak_config.lock();
+    if (config) {
+      config->dumpState(writer, max_kids);
+    }
+  }
+  writer.EndArray();
+  writer.EndObject();
+
+  response.add(buffer.GetString(), buffer.GetSize());
+  response.add("\n");
+  return Http::Code::OK;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "envoy/server/admin.h"
+#include "envoy/singleton/instance.h"
+
+#include "sft_config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Serves /accessfabric on the admin listener: per filter config verify outcomes, JWKS fetch state,
+// key inventory and key cache efficiency, as JSON. Lives in the singleton manager so that every
+// filter config in the process is listed by a single handler.
+//
+// The optional `kids` query parameter caps the number of keys listed per config (default 100).
+class SftAdmin : public Singleton::Instance, public Logger::Loggable<Logger::Id::http> {
+public:
+  SftAdmin(Server::Admin& admin);
+  ~SftAdmin();
+
+  // Lists `config` until it is destroyed. Main thread only.
+  void addConfig(SFTConfigSharedPtr config);
+
+private:
+  Http::Code handler(const std::string& url, Buffer::Instance& response);
+
+  Server::Admin& admin_;
+  std::vector<std::weak_ptr<SFTConfig>> configs_;
+};
+
+typedef std::shared_ptr<SftAdmin> SftAdminSharedPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
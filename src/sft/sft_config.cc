@@ -3,10 +3,8 @@
 #include "common/filesystem/filesystem_impl.h"
 #include "common/json/json_loader.h"
 #include "envoy/json/json_object.h"
-#include "common/http/message_impl.h"
 #include "envoy/upstream/cluster_manager.h"
 #include "common/http/utility.h"
-#include "common/common/enum_to_int.h"
 
 #include <algorithm>
 #include <chrono>
@@ -20,97 +18,125 @@ namespace Envoy {
 namespace Http {
 namespace Sft {
 
-std::shared_ptr<evp_pkey> JWKS::get(const std::string& kid) const {
-  auto it = keys_.find(kid);
-  if (it != keys_.end()) {
-    return it->second;
-  }
-
-  ENVOY_LOG(debug, "unable to find jwk with kid {}", kid);
-  return nullptr;
-}
+SFTConfig::SFTConfig(const std::string& name, const Json::Object& json_config,
+                     JwksProviderRegistrySharedPtr registry, ThreadLocal::SlotAllocator& tls,
+                     Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
+                     Stats::Scope& scope, Runtime::RandomGenerator& random,
+                     AccessLog::AccessLogManager& log_manager, SystemTimeSource& system_time)
+    : name_(name), stats_(generateStats("scaleft.accessfabric.", scope)),
+      system_time_(system_time),
+      worker_stats_(new SftWorkerStats(
+          stats_, tls, dispatcher,
+          std::chrono::milliseconds(json_config.getInteger("stats_flush_interval_ms", 5000)))),
+      registry_(registry) {
 
-bool JWKS::add(const Json::ObjectSharedPtr jwk) {
-  std::string kid = jwk->getString("kid", "");
-  if (kid == "") {
-    ENVOY_LOG(warn, "jwk missing required key `kid`");
-    return false;
+  allowed_issuer_ = json_config.getString("iss", "");
+  if (allowed_issuer_ == "") {
+    throw EnvoyException(fmt::format("invalid 'iss' '{}' in sft filter config", allowed_issuer_));
   }
 
-  auto key = ParseECPublicKey(jwk);
-  if (!key) {
-    ENVOY_LOG(warn, "jwk parse error");
-    return false;
+  allowed_audiences_ = json_config.getStringArray("aud", false);
+  whitelisted_paths_ = json_config.getStringArray("whitelisted_paths", true);
+
+  RoutePolicy default_policy;
+  default_policy.issuer_ = allowed_issuer_;
+  default_policy.audiences_ = allowed_audiences_;
+  std::unordered_map<std::string, RoutePolicyConstSharedPtr> vhost_policies;
+  if (json_config.hasObject("virtual_host_policies")) {
+    json_config.getObject("virtual_host_policies")
+        ->iterate([&](const std::string& vhost, const Json::Object& policy) -> bool {
+          vhost_policies[vhost] =
+              std::make_shared<const RoutePolicy>(RoutePolicy::fromJson(policy, default_policy));
+          return true;
+        });
   }
+  route_policies_.reset(new RoutePolicyResolver(default_policy, std::move(vhost_policies), tls));
 
-  ENVOY_LOG(debug, "parsed jwk {}", kid);
-  keys_[kid] = key;
-  return true;
-}
+  // Static keys or a (possibly shared) upstream source.
+  jwks_provider_ = registry_->get(json_config, tls, cm, dispatcher, random);
 
-SFTConfig::SFTConfig(const Json::Object& json_config, ThreadLocal::SlotAllocator& tls,
-                     Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
-                     Stats::Scope& scope, Runtime::RandomGenerator& random)
-    : remote_cluster_name_(json_config.getString("jwks_api_cluster", "")), cm_(cm), random_(random),
-      refresh_interval_(
-          std::chrono::milliseconds(json_config.getInteger("jwks_refresh_delay_ms", 60000))),
-      refresh_timer_(dispatcher.createTimer([this]() -> void { refresh(); })),
-      stats_(generateStats("scaleft.accessfabric.", scope)), tls_(tls.allocateSlot()) {
+  if (DenylistProvider::configured(json_config)) {
+    denylist_ = std::make_shared<DenylistProvider>(json_config, registry_->parseThread(), tls, cm,
+                                                   dispatcher, scope, random);
+  }
 
-  retry_count_ = int(0);
+  const std::string session_cookie_name = json_config.getString("session_cookie_name", "");
+  if (!session_cookie_name.empty()) {
+    session_cookie_.reset(new SessionCookie(
+        session_cookie_name, json_config.getString("session_cookie_secret", ""),
+        std::chrono::seconds(json_config.getInteger("session_cookie_max_age_s", 300))));
+  }
 
-  allowed_issuer_ = json_config.getString("iss", "");
-  if (allowed_issuer_ == "") {
-    throw EnvoyException(fmt::format("invalid 'iss' '{}' in sft filter config", allowed_issuer_));
+  if (RateLimiter::configured(json_config)) {
+    rate_limiter_.reset(new RateLimiter(json_config, tls));
+    extra_claims_.push_back(rate_limiter_->claim());
   }
 
-  allowed_audiences_ = json_config.getStringArray("aud", false);
-  whitelisted_paths_ = json_config.getStringArray("whitelisted_paths", true);
+  if (BatchVerifier::configured(json_config)) {
+    batch_verifier_.reset(new BatchVerifier(tls, *worker_stats_));
+  }
 
-  JWKSSharedPtr empty(new JWKS());
+  if (VerifiedCache::configured(json_config)) {
+    verified_cache_.reset(new VerifiedCache(json_config));
+  }
 
-  // Check if we have any static keys, if any fail to parse bail out.
-  std::vector<Json::ObjectSharedPtr> static_keys_ = json_config.getObjectArray("keys", true);
-  if (static_keys_.size() != 0) {
-    ENVOY_LOG(debug, "SFTConfig::{}: Using statically configued jwks", __func__);
-    for (auto& key : static_keys_) {
-      if (!empty->add(key)) {
-        throw EnvoyException(fmt::format("invalid static key in config"));
-      }
-    }
+  if (LoadShedder::configured(json_config)) {
+    load_shedder_.reset(new LoadShedder(json_config, tls));
   }
 
-  tls_->set(
-      [empty](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr { return empty; });
+  if (ClaimsMetadata::configured(json_config)) {
+    claims_metadata_.reset(new ClaimsMetadata(json_config));
+  }
 
-  // If we don't have any statically configured keys, ensure we can fetch them.
-  if (static_keys_.size() == 0) {
-    ENVOY_LOG(debug, "SFTConfig::{}: Using jwks from upstream", __func__);
-    if (!cm.get(remote_cluster_name_)) {
-      throw EnvoyException(
-          fmt::format("unknown cluster '{}' in sft filter config", remote_cluster_name_));
+  if (BodyDigest::configured(json_config)) {
+    body_digest_.reset(new BodyDigest(json_config));
+    if (extra_claims_.empty() || extra_claims_[0] != body_digest_->claim()) {
+      extra_claims_.push_back(body_digest_->claim());
     }
-    jwks_api_path_ = json_config.getString("jwks_api_path", "");
-    if (jwks_api_path_ == "") {
-      throw EnvoyException(fmt::format("empty 'jwks_api_path' in sft jwt auth config"));
-    }
-
-    // Start polling.
-    refresh();
   }
-} // namespace Sft
 
-SFTConfig::~SFTConfig() {
-  if (active_request_) {
-    active_request_->cancel();
+  const std::string capture_path = json_config.getString("capture_path", "");
+  if (!capture_path.empty()) {
+    capture_.reset(new CaptureWriter(log_manager.createAccessLog(capture_path)));
   }
 }
 
 SftStats SFTConfig::generateStats(const std::string& prefix, Stats::Scope& scope) {
-  return {ALL_SFT_STATS(POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix))};
+  return {ALL_SFT_STATS(POOL_COUNTER_PREFIX(scope, prefix), POOL_GAUGE_PREFIX(scope, prefix),
+                        POOL_HISTOGRAM_PREFIX(scope, prefix))};
 }
 
-const JWKS& SFTConfig::jwks() { return tls_->getTyped<JWKS>(); }
+void SFTConfig::dumpState(AdminWriter& writer, uint64_t max_kids) const {
+  // Scrapes only read the flush samples, so any number of them see the same rates.
+  double window_s;
+  const std::array<double, VerifyStatusCount> rates = worker_stats_->verifyRates(window_s);
+
+  writer.StartObject();
+  writer.Key("name");
+  writer.String(name_.c_str());
+  writer.Key("iss");
+  writer.String(allowed_issuer_.c_str());
+
+  writer.Key("verify");
+  writer.StartObject();
+  writer.Key("interval_s");
+  writer.Double(window_s);
+  for (size_t i = 0; i < VerifyStatusCount; i++) {
+    const uint64_t count = verifyCount(static_cast<VerifyStatus>(i));
+    writer.Key(VerifyStatusToString(static_cast<VerifyStatus>(i)).c_str());
+    writer.StartObject();
+    writer.Key("total");
+    writer.Uint64(count);
+    writer.Key("per_second");
+    writer.Double(rates[i]);
+    writer.EndObject();
+  }
+  writer.EndObject();
+
+  writer.Key("jwks");
+  jwks_provider_->dumpState(writer, max_kids);
+  writer.EndObject();
+}
 
 bool SFTConfig::whitelistMatch(const Http::HeaderMap& headers) {
   const Http::HeaderString& path = headers.Path()->value();
@@ -130,79 +156,6 @@ bool SFTConfig::whitelistMatch(const Http::HeaderMap& headers) {
   return false;
 }
 
-void SFTConfig::refresh() {
-  ENVOY_LOG(debug, "SFTConfig::{}", __func__);
-  MessagePtr message(new RequestMessageImpl());
-  message->headers().insertMethod().value().setReference(Http::Headers::get().MethodValues.Get);
-  message->headers().insertPath().value(jwks_api_path_);
-  message->headers().insertHost().value(remote_cluster_name_);
-  active_request_ = cm_.httpAsyncClientForCluster(remote_cluster_name_)
-                        .send(std::move(message), *this,
-                              Optional<std::chrono::milliseconds>(std::chrono::milliseconds(5000)));
-}
-
-void SFTConfig::requestFailed(Http::AsyncClient::FailureReason) {
-  ENVOY_LOG(debug, "SFTConfig::{} retry count: {}", __func__, retry_count_);
-  stats().jwks_fetch_failed_.inc();
-
-  if (retry_count_ < 30) {
-    retry_count_++;
-    requestComplete(std::chrono::milliseconds((retry_count_ * retry_count_) * 1000));
-  } else {
-    requestComplete(refresh_interval_); // Poll normally
-  }
-}
-
-void SFTConfig::onFailure(Http::AsyncClient::FailureReason reason) {
-  requestFailed(reason);
-  return;
-}
-
-void SFTConfig::requestComplete(std::chrono::milliseconds interval) {
-  ENVOY_LOG(debug, "SFTConfig::{}", __func__);
-  active_request_ = nullptr;
-
-  // Add refresh jitter based on the configured interval.
-  std::chrono::milliseconds final_delay =
-      interval + std::chrono::milliseconds(random_.random() % interval.count());
-
-  ENVOY_LOG(debug, "SFTConfig::{} setting refresh timer: {} ms", __func__, final_delay.count());
-  refresh_timer_->enableTimer(final_delay);
-}
-
-void SFTConfig::onSuccess(Http::MessagePtr&& response) {
-  uint64_t response_code = Http::Utility::getResponseStatus(response->headers());
-  if (response_code != enumToInt(Http::Code::OK)) {
-    ENVOY_LOG(warn, "SFTConfig::{}: failed request: response {} != 200", __func__, response_code);
-    requestFailed(Http::AsyncClient::FailureReason::Reset);
-    return;
-  }
-
-  try {
-    ENVOY_LOG(debug, "SFTConfig::{}: success: {}", __func__, response->bodyAsString());
-
-    JWKSSharedPtr new_jwks(new JWKS());
-    Json::ObjectSharedPtr loader = Json::Factory::loadFromString(response->bodyAsString());
-    for (const Json::ObjectSharedPtr& jwk : loader->getObjectArray("keys")) {
-      new_jwks->add(jwk);
-    }
-
-    tls_->set([new_jwks](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
-      return new_jwks;
-    });
-
-    retry_count_ = 0;
-    stats().jwks_fetch_success_.inc();
-    requestComplete(refresh_interval_);
-    return;
-
-  } catch (...) {
-    ENVOY_LOG(warn, "SFTConfig::{}: failed request: parse failure", __func__);
-    requestFailed(Http::AsyncClient::FailureReason::Reset);
-    return;
-  }
-}
-
 } // namespace Sft
 } // namespace Http
 } // namespace Envoy
\ No newline at end of file
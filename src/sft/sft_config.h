@@ -2,90 +2,112 @@
 
 #include "common/common/logger.h"
 #include "common/http/rest_api_fetcher.h"
+#include "envoy/access_log/access_log.h"
+#include "envoy/common/time.h"
 #include "envoy/json/json_object.h"
 #include "server/config/network/http_connection_manager.h"
 #include "envoy/stats/stats_macros.h"
 
-#include "jwt.h"
-
+#include "batch_verifier.h"
+#include "body_digest.h"
+#include "capture.h"
+#include "claims_metadata.h"
+#include "denylist_provider.h"
+#include "jwks_provider.h"
+#include "load_shedder.h"
+#include "rate_limiter.h"
+#include "route_policy.h"
+#include "session_cookie.h"
+#include "sft_stats.h"
+#include "verified_cache.h"
+#include "verify_status.h"
+
+#include <array>
 #include <map>
 
 namespace Envoy {
 namespace Http {
 namespace Sft {
 
-// clang-format off
-#define ALL_SFT_STATS(COUNTER, GAUGE)                                                       \
-  COUNTER(jwks_fetch_failed)                                                                \
-  COUNTER(jwks_fetch_success)                                                               \
-  COUNTER(jwt_rejected)                                                                     \
-  COUNTER(jwt_accepted)                                                                     \
-  COUNTER(whitelist_accepted)
-// clang-format on
-
-struct SftStats {
-  ALL_SFT_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
-};
-
-// Struct to hold a JSON Web Key Set.
-class JWKS : public Logger::Loggable<Logger::Id::http>, public ThreadLocal::ThreadLocalObject {
-public:
-  bool add(const Json::ObjectSharedPtr jwk);
-  std::shared_ptr<evp_pkey> get(const std::string& kid) const;
-
-private:
-  std::map<std::string, std::shared_ptr<evp_pkey>> keys_;
-};
-
-typedef std::shared_ptr<JWKS> JWKSSharedPtr;
-
 class SFTConfig;
 typedef std::shared_ptr<SFTConfig> SFTConfigSharedPtr;
 
-// TODO(morgabra) RestApiFetcher doesn't seem to wait until the configured
-// cluster is up, so it fails to fetch the first loop. Might just need to use
-// AsyncClient directly - which is nice anyway because you don't have to specify
-// a cluster.
-class SFTConfig : public Http::AsyncClient::Callbacks, public Logger::Loggable<Logger::Id::http> {
+class SFTConfig : public Logger::Loggable<Logger::Id::http> {
 public:
-  SFTConfig(const Json::Object& config, ThreadLocal::SlotAllocator& tls,
+  // `system_time` is the clock tokens and session cookies are checked against.
+  SFTConfig(const std::string& name, const Json::Object& config,
+            JwksProviderRegistrySharedPtr registry, ThreadLocal::SlotAllocator& tls,
             Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher, Stats::Scope& scope,
-            Runtime::RandomGenerator& random);
-  ~SFTConfig();
-  const JWKS& jwks();
+            Runtime::RandomGenerator& random, AccessLog::AccessLogManager& log_manager,
+            SystemTimeSource& system_time);
+  const JWKS& jwks() { return jwks_provider_->jwks(); }
+  JwksProvider& jwksProvider() { return *jwks_provider_; }
+  // nullptr unless a revocation denylist is configured.
+  DenylistProvider* denylist() { return denylist_.get(); }
+  // nullptr unless session cookies are enabled.
+  const SessionCookie* sessionCookie() const { return session_cookie_.get(); }
+  // nullptr unless traffic capture is enabled.
+  CaptureWriter* capture() { return capture_.get(); }
+  // nullptr unless rate limiting is enabled.
+  RateLimiter* rateLimiter() { return rate_limiter_.get(); }
+  // nullptr unless batched signature verification is enabled.
+  BatchVerifier* batchVerifier() { return batch_verifier_.get(); }
+  // nullptr unless the shared verified token cache is enabled.
+  VerifiedCache* verifiedCache() { return verified_cache_.get(); }
+  // nullptr unless load shedding is enabled.
+  LoadShedder* loadShedder() { return load_shedder_.get(); }
+  // nullptr unless request bodies are bound to tokens.
+  const BodyDigest* bodyDigest() const { return body_digest_.get(); }
+  // nullptr unless verification results are published as dynamic metadata.
+  const ClaimsMetadata* claimsMetadata() const { return claims_metadata_.get(); }
+  // The claims other than the registered ones that the rate limiter and body digest read, picked
+  // out of the payload as the token is parsed.
+  const std::vector<std::string>& extraClaims() const { return extra_claims_; }
+  SystemTimeSource& systemTime() { return system_time_; }
+  // Auth policy for a request's route, from its opaque_config, its virtual host's entry in
+  // `virtual_host_policies`, or this config's `iss`/`aud`, in that order. Worker only.
+  RoutePolicyConstSharedPtr routePolicy(const Router::RouteConstSharedPtr& route) {
+    return route_policies_->resolve(route);
+  }
   const LowerCaseString headerKey = LowerCaseString("authenticated-user-jwt");
 
   const SftStats& stats() { return stats_; }
   static SftStats generateStats(const std::string& prefix, Stats::Scope& scope);
+  // Request path counters, see SftWorkerStats.
+  SftWorkerStats& workerStats() { return *worker_stats_; }
 
   bool whitelistMatch(const Http::HeaderMap& headers);
 
-  std::string jwks_api_path_;
+  uint64_t verifyCount(VerifyStatus status) const { return worker_stats_->verifyCount(status); }
+  // Writes this config's verify outcomes (totals, and rates over the recent stats flushes, see
+  // SftWorkerStats) and its JWKS provider state as a JSON object. Main thread only.
+  void dumpState(AdminWriter& writer, uint64_t max_kids) const;
+
+  const std::string name_;
   std::string allowed_issuer_;
   std::vector<std::string> allowed_audiences_;
   std::vector<std::string> whitelisted_paths_;
 
-protected:
-  const std::string remote_cluster_name_;
-  Upstream::ClusterManager& cm_;
-
 private:
-  // Http::AsyncClient::Callbacks
-  void onSuccess(Http::MessagePtr&& response) override;
-  void onFailure(Http::AsyncClient::FailureReason reason) override;
-
-  void refresh();
-  void requestComplete(std::chrono::milliseconds interval);
-  void requestFailed(Http::AsyncClient::FailureReason reason);
-
-  int retry_count_;
-  Runtime::RandomGenerator& random_;
-  const std::chrono::milliseconds refresh_interval_;
-  Event::TimerPtr refresh_timer_;
-  Http::AsyncClient::Request* active_request_{};
-
   const SftStats stats_;
-  ThreadLocal::SlotPtr tls_;
+  SystemTimeSource& system_time_;
+
+  SftWorkerStatsPtr worker_stats_;
+
+  // Held so the registry outlives every config that may share a provider through it.
+  JwksProviderRegistrySharedPtr registry_;
+  JwksProviderSharedPtr jwks_provider_;
+  DenylistProviderSharedPtr denylist_;
+  SessionCookiePtr session_cookie_;
+  CaptureWriterPtr capture_;
+  RateLimiterPtr rate_limiter_;
+  BatchVerifierPtr batch_verifier_;
+  VerifiedCachePtr verified_cache_;
+  LoadShedderPtr load_shedder_;
+  ClaimsMetadataPtr claims_metadata_;
+  BodyDigestPtr body_digest_;
+  std::vector<std::string> extra_claims_;
+  RoutePolicyResolverPtr route_policies_;
 };
 
 } // namespace Sft
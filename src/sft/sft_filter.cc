@@ -1,164 +1,552 @@
+#include <algorithm>
 #include <string>
 
 #include "sft_filter.h"
 
+#include "common/common/assert.h"
+#include "common/common/enum_to_int.h"
+#include "common/common/hash.h"
 #include "common/common/logger.h"
 #include "common/http/utility.h"
+#include "common/http/header_map_impl.h"
 #include "common/http/headers.h"
+#include "common/tracing/http_tracer_impl.h"
 #include "server/config/network/http_connection_manager.h"
 
+#include "probes.h"
+
 namespace Envoy {
 namespace Http {
 namespace Sft {
 
-std::string VerifyStatusToString(VerifyStatus status) {
-  static std::map<VerifyStatus, std::string> table = {
-      {VerifyStatus::WHITELISTED_PATH, "WHITELISTED_PATH"},
-      {VerifyStatus::JWT_VERIFY_SUCCESS, "JWT_VERIFY_SUCCESS"},
-      {VerifyStatus::JWT_VERIFY_FAIL_UNKNOWN, "JWT_VERIFY_FAIL_UNKNOWN"},
-      {VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT, "JWT_VERIFY_FAIL_NOT_PRESENT"},
-      {VerifyStatus::JWT_VERIFY_FAIL_EXPIRED, "JWT_VERIFY_FAIL_EXPIRED"},
-      {VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE, "JWT_VERIFY_FAIL_NOT_BEFORE"},
-      {VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE, "JWT_VERIFY_FAIL_INVALID_SIGNATURE"},
-      {VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS, "JWT_VERIFY_FAIL_NO_VALIDATORS"},
-      {VerifyStatus::JWT_VERIFY_FAIL_MALFORMED, "JWT_VERIFY_FAIL_MALFORMED"},
-      {VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH, "JWT_VERIFY_FAIL_ISSUER_MISMATCH"},
-      {VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH, "JWT_VERIFY_FAIL_AUDIENCE_MISMATCH"}};
-  return table[status];
-}
-
-SftJwtDecoderFilter::SftJwtDecoderFilter(Http::Sft::SFTConfigSharedPtr config) { config_ = config; }
+SftJwtDecoderFilter::SftJwtDecoderFilter(Http::Sft::SFTConfigSharedPtr config)
+    : config_(config), stats_(config->workerStats().local()) {}
 
 SftJwtDecoderFilter::~SftJwtDecoderFilter() {}
 
 void SftJwtDecoderFilter::sendUnauthorized(VerifyStatus status) {
-  config_->stats().jwt_rejected_.inc();
+  stats_.inc(SftCounter::jwt_rejected);
   std::string statusStr = VerifyStatusToString(status);
   ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: Unauthorized : {}", __func__, statusStr);
-  Code code = Code(401);
-  Utility::sendLocalReply(*decoder_callbacks_, false, code, statusStr);
-  return;
+  sendLocalReply(Code::Unauthorized, statusStr);
+}
+
+void SftJwtDecoderFilter::sendLocalReply(Code code, const std::string& body) {
+  set_cookie_.clear();
+  Utility::sendLocalReply(*decoder_callbacks_, false, code, body);
+}
+
+bool SftJwtDecoderFilter::rateLimited() {
+  RateLimiter* rate_limiter = config_->rateLimiter();
+  if (!rate_limiter || rate_limit_key_.empty()) {
+    return false;
+  }
+
+  bool evicted;
+  const bool allowed = rate_limiter->allow(rate_limit_key_, evicted);
+  if (evicted) {
+    stats_.inc(SftCounter::rate_limit_evicted);
+  }
+  if (allowed) {
+    return false;
+  }
+
+  stats_.inc(SftCounter::rate_limited);
+  ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: {} over its limit", __func__, rate_limit_key_);
+  sendLocalReply(Code::TooManyRequests, "rate limited");
+  return true;
+}
+
+uint64_t SftJwtDecoderFilter::cookieScope() const {
+  const RateLimiter* rate_limiter = config_->rateLimiter();
+  if (!rate_limiter) {
+    return policy_->claimsHash();
+  }
+  return HashUtil::xxHash64(fmt::format("{}:{}", policy_->claimsHash(), rate_limiter->claim()));
+}
+
+bool SftJwtDecoderFilter::bodyDigestMatches() {
+  const BodyDigest::Digest digest = body_hasher_->finish();
+  body_hasher_.reset();
+  if (digest == expected_digest_) {
+    stats_.inc(SftCounter::body_digest_verified);
+    return true;
+  }
+
+  stats_.inc(SftCounter::body_digest_mismatch);
+  if (config_->claimsMetadata()) {
+    publishMetadata(VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST);
+  }
+  const std::string statusStr = VerifyStatusToString(VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST);
+  ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: Unauthorized : {}", __func__, statusStr);
+  sendLocalReply(Code::Unauthorized, statusStr);
+  return false;
+}
+
+namespace {
+
+const LowerCaseString SetCookieHeader("set-cookie");
+const LowerCaseString RetryAfterHeader("retry-after");
+
+// Returns the time elapsed since `start` and moves `start` to now.
+std::chrono::microseconds lap(MonotonicTime& start) {
+  const MonotonicTime now = ProdMonotonicTimeSource::instance_.currentTime();
+  std::chrono::microseconds elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+  start = now;
+  return elapsed;
+}
+
+int64_t epochSeconds(SystemTimeSource& time) {
+  return std::chrono::duration_cast<std::chrono::seconds>(time.currentTime().time_since_epoch())
+      .count();
+}
+
+std::string keyCacheResultToString(KeyCacheResult result) {
+  switch (result) {
+  case KeyCacheResult::HIT:
+    return "hit";
+  case KeyCacheResult::MISS:
+    return "miss";
+  case KeyCacheResult::NOT_CACHED:
+    return "not_cached";
+  }
+  NOT_REACHED;
+}
+
+ProtobufWkt::Value& field(ProtobufWkt::Struct& metadata, const std::string& name) {
+  return (*metadata.mutable_fields())[name];
+}
+
+void probeVerifyDone(VerifyStatus status, std::chrono::nanoseconds elapsed) {
+  const std::string name = SFT_PROBE_ENABLED(verify_done) ? VerifyStatusToString(status) : "";
+  SFT_PROBE2(verify_done, name.c_str(), elapsed.count());
+}
+
+} // namespace
+
+void SftJwtDecoderFilter::sendOverloaded() {
+  ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: shedding", __func__);
+  set_cookie_.clear();
+  HeaderMapPtr response_headers{new HeaderMapImpl{
+      {Headers::get().Status, std::to_string(enumToInt(Code::ServiceUnavailable))},
+      {RetryAfterHeader, config_->loadShedder()->retryAfter()}}};
+  decoder_callbacks_->encodeHeaders(std::move(response_headers), true);
+}
+
+void SftJwtDecoderFilter::wait(HeaderMap& headers) {
+  waiting_headers_ = &headers;
+  LoadShedder* load_shedder = config_->loadShedder();
+  if (load_shedder) {
+    load_shedder->paused();
+  }
+}
+
+HeaderMap& SftJwtDecoderFilter::stopWaiting() {
+  HeaderMap& headers = *waiting_headers_;
+  waiting_headers_ = nullptr;
+  LoadShedder* load_shedder = config_->loadShedder();
+  if (load_shedder) {
+    load_shedder->resumed();
+  }
+  return headers;
+}
+
+VerifyStatus SftJwtDecoderFilter::verifyAndRecord(HeaderMap& headers, bool allow_refetch) {
+  // Untraced requests only pay for the sampling decision, which reads x-request-id.
+  const bool tracing =
+      Tracing::HttpTracerUtility::isTracing(decoder_callbacks_->requestInfo(), headers).is_tracing;
+  if (tracing) {
+    span_ = decoder_callbacks_->activeSpan().spawnChild(
+        decoder_callbacks_->tracingConfig(), "scaleft.accessfabric verify",
+        ProdSystemTimeSource::instance_.currentTime());
+  }
+  record_trace_ = tracing || config_->capture();
+  cold_ = false;
+  if (record_trace_) {
+    trace_ = VerifyTrace();
+  }
+  if (config_->claimsMetadata()) {
+    metadata_.Clear();
+  }
+
+  verify_start_ = ProdMonotonicTimeSource::instance_.currentTime();
+  VerifyStatus status = verify(headers, allow_refetch, record_trace_ ? &trace_ : nullptr);
+  if (status == VerifyStatus::JWT_VERIFY_PENDING_SIGNATURE) {
+    // Recorded once the signature comes back, in onSignatureVerified().
+    return status;
+  }
+  return record(headers, status);
 }
 
-VerifyStatus SftJwtDecoderFilter::verify(HeaderMap& headers) {
+VerifyStatus SftJwtDecoderFilter::record(const HeaderMap& headers, VerifyStatus status) {
+  const std::chrono::nanoseconds elapsed =
+      ProdMonotonicTimeSource::instance_.currentTime() - verify_start_;
+  stats_.recordVerify(status, elapsed);
+  probeVerifyDone(status, elapsed);
+  LoadShedder* load_shedder = config_->loadShedder();
+  if (load_shedder && cold_) {
+    load_shedder->recordLatency(elapsed);
+  }
+  // A kid miss is published once the refetch settles it.
+  if (config_->claimsMetadata() && status != VerifyStatus::JWT_VERIFY_PENDING_JWKS_REFRESH) {
+    publishMetadata(status);
+  }
+  if (!record_trace_) {
+    return status;
+  }
+
+  if (span_) {
+    span_->setTag("sft.status", VerifyStatusToString(status));
+    if (!trace_.kid_.empty()) {
+      span_->setTag("sft.kid", trace_.kid_);
+      span_->setTag("sft.alg", trace_.alg_);
+      span_->setTag("sft.key_cache", keyCacheResultToString(trace_.cache_result_));
+    }
+    if (!trace_.issuer_.empty()) {
+      span_->setTag("sft.iss", trace_.issuer_);
+    }
+    if (trace_.batched_) {
+      span_->setTag("sft.batched", "true");
+    }
+    span_->setTag("sft.parse_us", std::to_string(trace_.parse_.count()));
+    span_->setTag("sft.key_lookup_us", std::to_string(trace_.key_lookup_.count()));
+    span_->setTag("sft.signature_us", std::to_string(trace_.signature_.count()));
+    if (!VerifyStatusAllowed(status) && status != VerifyStatus::JWT_VERIFY_PENDING_JWKS_REFRESH) {
+      span_->setTag(Tracing::Tags::get().ERROR, Tracing::Tags::get().TRUE);
+    }
+    span_->finishSpan();
+    span_.reset();
+  }
+
+  CaptureWriter* capture = config_->capture();
+  if (capture) {
+    capture->write(captureRecord(*capture, headers, status, trace_, elapsed));
+  }
+  return status;
+}
+
+void SftJwtDecoderFilter::publishMetadata(VerifyStatus status) {
+  field(metadata_, "status").set_string_value(VerifyStatusToString(status));
+  decoder_callbacks_->requestInfo().setDynamicMetadata(config_->claimsMetadata()->name(),
+                                                       metadata_);
+}
+
+CaptureRecord SftJwtDecoderFilter::captureRecord(const CaptureWriter& capture,
+                                                 const HeaderMap& headers, VerifyStatus status,
+                                                 const VerifyTrace& trace,
+                                                 std::chrono::nanoseconds elapsed) {
+  CaptureRecord record;
+  record.time_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                        config_->systemTime().currentTime().time_since_epoch())
+                        .count();
+
+  if (headers.Path()) {
+    const HeaderString& path = headers.Path()->value();
+    const char* query_string_start = Http::Utility::findQueryStringStart(path);
+    record.path_hash_ = capture.hash(path.c_str(), query_string_start != nullptr
+                                                       ? query_string_start - path.c_str()
+                                                       : path.size());
+  }
+
+  const HeaderEntry* entry = headers.get(config_->headerKey);
+  if (entry) {
+    record.token_hash_ = capture.hash(entry->value().c_str(), entry->value().size());
+    record.token_size_ = std::min<size_t>(entry->value().size(), UINT16_MAX);
+  }
+  if (!trace.kid_.empty()) {
+    record.kid_hash_ = capture.hash(trace.kid_.data(), trace.kid_.size());
+  }
+
+  record.status_ = static_cast<uint8_t>(status);
+  record.verify_ns_ = std::min<uint64_t>(elapsed.count(), UINT32_MAX);
+  return record;
+}
+
+VerifyStatus SftJwtDecoderFilter::verify(HeaderMap& headers, bool allow_refetch,
+                                         VerifyTrace* trace) {
   ENVOY_LOG(debug, "SftJwtDecoderFilter::{}", __func__);
 
   // Check if the request path is on the whitelist
   if (config_->whitelistMatch(headers)) {
-    config_->stats().whitelist_accepted_.inc();
+    stats_.inc(SftCounter::whitelist_accepted);
     return VerifyStatus::WHITELISTED_PATH;
   }
 
-  // Check if header key/jwt exists.
+  const int64_t now = epochSeconds(config_->systemTime());
   const HeaderEntry* entry = headers.get(config_->headerKey);
+
+  // A session cookie issued for this client (and this token, if it sent one) under the same
+  // cookieScope() stands in for a full verification. It carries the token's subject and id, so
+  // revoking either still applies.
+  const SessionCookie* session_cookie = config_->sessionCookie();
+  SessionCookie::Session session;
+  if (session_cookie && session_cookie->validate(headers, entry, cookieScope(), now, session)) {
+    DenylistProvider* denylist = config_->denylist();
+    if (denylist && denylist->isRevoked(session.jti_, session.sub_)) {
+      return VerifyStatus::JWT_VERIFY_FAIL_REVOKED;
+    }
+    stats_.inc(SftCounter::session_cookie_accepted);
+    rate_limit_key_ = session.rate_limit_key_;
+    // The subject is the only claim cookie requests publish.
+    if (config_->claimsMetadata()) {
+      field(*field(metadata_, "claims").mutable_struct_value(), "sub")
+          .set_string_value(session.sub_);
+    }
+    return VerifyStatus::SESSION_COOKIE_VALID;
+  }
+
+  // Check if header key/jwt exists. Routes with optional auth let anonymous requests through, but
+  // a token that is presented must still verify.
   if (!entry) {
-    return VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT;
+    return policy_->auth_ == RoutePolicy::Auth::OPTIONAL
+               ? VerifyStatus::OPTIONAL_NOT_PRESENT
+               : VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT;
+  }
+
+  MonotonicTime stage_start;
+  if (trace) {
+    stage_start = ProdMonotonicTimeSource::instance_.currentTime();
   }
 
   // Check if jwt can be parsed.
-  Http::Sft::Jwt jwt = Http::Sft::Jwt(entry->value().c_str());
+  Http::Sft::Jwt jwt = Http::Sft::Jwt(entry->value().c_str(), config_->extraClaims());
+  if (trace) {
+    trace->parse_ = lap(stage_start);
+  }
 
+  // Malformed tokens, and ones without a kid or a supported alg, are rejected here at the cost of
+  // reading them, nothing on the way throws.
   if (!jwt.IsParsed()) {
-    return VerifyStatus::JWT_VERIFY_FAIL_MALFORMED;
+    return JwtStatusToVerifyStatus(jwt.Status());
   }
 
   // Verify signature
-  const std::string kid = jwt.Header()->getString("kid", "");
-  if (kid == "") {
-    return VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS;
+  const std::string& kid = jwt.Kid();
+  if (trace) {
+    trace->kid_ = kid;
+    trace->alg_ = jwt.Alg();
+    lap(stage_start);
+  }
+  if (config_->claimsMetadata()) {
+    field(metadata_, "kid").set_string_value(kid);
+  }
+  std::shared_ptr<Http::Sft::evp_pkey> pkey =
+      config_->jwksProvider().getKey(kid, trace ? &trace->cache_result_ : nullptr);
+  if (trace) {
+    trace->key_lookup_ = lap(stage_start);
   }
-
-  const Http::Sft::JWKS jwks = config_->jwks();
-  std::shared_ptr<Http::Sft::evp_pkey> pkey = jwks.get(kid);
   if (!pkey) {
+    // The IdP may have rotated keys since our last refresh, wait on a refetch if one is allowed.
+    if (allow_refetch && config_->jwksProvider().onKidMiss()) {
+      return VerifyStatus::JWT_VERIFY_PENDING_JWKS_REFRESH;
+    }
     return VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS;
   }
 
-  if (!jwt.VerifySignature(pkey)) {
-    return VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE;
+  VerifiedCache* verified_cache = config_->verifiedCache();
+  if (verified_cache) {
+    cache_key_ =
+        VerifiedCache::key(entry->value().c_str(), entry->value().size(), pkey->fingerprint_);
+    bool signature_valid;
+    if (verified_cache->lookup(cache_key_, now, signature_valid)) {
+      stats_.inc(SftCounter::verified_cache_hit);
+      if (trace) {
+        trace->signature_ = lap(stage_start);
+      }
+      return verifyClaims(jwt, signature_valid, *entry, trace);
+    }
+    stats_.inc(SftCounter::verified_cache_miss);
   }
 
-  // TODO(morgabra) Move claim validation elsewhere
-  // Validate issuer (iss)
-  std::string issuer = jwt.Payload()->getString("iss", "");
-  if (issuer == "") {
-    return VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH;
-  }
-  if (config_->allowed_issuer_ != issuer) {
-    return VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH;
+  // Everything from here on costs a signature check, which is what saturated workers shed.
+  LoadShedder* load_shedder = config_->loadShedder();
+  if (load_shedder) {
+    const ShedReason reason = load_shedder->shed();
+    if (reason != ShedReason::NONE) {
+      stats_.inc(reason == ShedReason::IN_FLIGHT ? SftCounter::shed_in_flight
+                                                 : SftCounter::shed_latency);
+      return VerifyStatus::JWT_VERIFY_SHED;
+    }
   }
+  cold_ = true;
 
-  // Validate audience (aud) - can be an array or string.
-  std::vector<std::string> audience = jwt.Payload()->getStringArray("aud", true);
-  if (audience.size() == 0) {
-    std::string aud = jwt.Payload()->getString("aud", "");
-    if (aud == "") {
-      return VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH;
+  BatchVerifier* batch_verifier = config_->batchVerifier();
+  if (batch_verifier && batch_verifier->add(jwt, pkey, *this)) {
+    if (trace) {
+      trace->batched_ = true;
+      trace->batch_queued_ = stage_start;
     }
-    audience.push_back(aud);
+    batched_jwt_.reset(new Jwt(std::move(jwt)));
+    return VerifyStatus::JWT_VERIFY_PENDING_SIGNATURE;
   }
 
-  bool aud_found = false;
-  for (auto& allowed : config_->allowed_audiences_) {
-    if (std::find(audience.begin(), audience.end(), allowed) != audience.end()) {
-      aud_found = true;
-    }
-    if (aud_found) {
-      break;
-    }
+  const bool signature_valid = jwt.VerifySignature(pkey);
+  if (trace) {
+    trace->signature_ = lap(stage_start);
   }
+  cacheVerdict(jwt, signature_valid);
+  return verifyClaims(jwt, signature_valid, *entry, trace);
+}
 
-  if (!aud_found) {
-    return VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH;
+void SftJwtDecoderFilter::cacheVerdict(Jwt& jwt, bool valid) {
+  VerifiedCache* verified_cache = config_->verifiedCache();
+  if (!verified_cache) {
+    return;
   }
+  // An invalid exp reads as none, the exp check rejects the token anyway.
+  verified_cache->insert(cache_key_, std::max<int64_t>(jwt.Claims().exp_, 0),
+                         epochSeconds(config_->systemTime()), valid);
+}
 
-  // Verify expiration/not-before (exp/nbf)
-  auto now = std::chrono::duration_cast<std::chrono::seconds>(
-                 ProdSystemTimeSource::instance_.currentTime().time_since_epoch())
-                 .count();
+VerifyStatus SftJwtDecoderFilter::verifyClaims(Jwt& jwt, bool signature_valid,
+                                               const HeaderEntry& entry, VerifyTrace* trace) {
+  if (!signature_valid) {
+    return VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE;
+  }
+  const int64_t now = epochSeconds(config_->systemTime());
 
-  if (jwt.Payload()->hasObject("nbf")) {
-    int64_t nbf = jwt.Payload()->getInteger("nbf", -1);
-    if (nbf < 0) {
-      return VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE;
-    }
+  // The registered claims were typed while the token was parsed, one of the wrong type fails its
+  // check.
+  const JwtClaims& claims = jwt.Claims();
 
-    if (now < nbf) {
-      return VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE;
+  // Check revocation before trusting any claims.
+  VerifyStatus status = ProbeClaimCheck("revoked", [this, &claims]() -> VerifyStatus {
+    DenylistProvider* denylist = config_->denylist();
+    if (denylist && denylist->isRevoked(claims.jti_, claims.sub_)) {
+      return VerifyStatus::JWT_VERIFY_FAIL_REVOKED;
     }
+    return VerifyStatus::JWT_VERIFY_SUCCESS;
+  });
+  if (status != VerifyStatus::JWT_VERIFY_SUCCESS) {
+    return status;
   }
 
-  if (jwt.Payload()->hasObject("exp")) {
-    int64_t exp = jwt.Payload()->getInteger("exp", -1);
-    if (exp < 0) {
-      return VerifyStatus::JWT_VERIFY_FAIL_EXPIRED;
+  // Then issuer, audience and lifetime, under the route's policy.
+  if (trace) {
+    trace->issuer_ = claims.iss_;
+  }
+  status = CheckClaims(claims, now, &policy_->issuer_, &policy_->audiences_);
+  if (status != VerifyStatus::JWT_VERIFY_SUCCESS) {
+    return status;
+  }
+
+  // The body is checked as it streams through, once the rest of the token has passed.
+  const BodyDigest* body_digest = config_->bodyDigest();
+  if (body_digest) {
+    status = ProbeClaimCheck("body_digest", [this, &claims, body_digest]() -> VerifyStatus {
+      // The claim is read with the registered ones, so any token that parsed has it if it is there.
+      // One whose payload wasn't read for it can't be told apart from a bound one and is rejected.
+      const JwtClaims::Extra* claim = claims.extra(body_digest->claim());
+      if (!claim) {
+        return VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST;
+      }
+      if (!claim->present_) {
+        return VerifyStatus::JWT_VERIFY_SUCCESS;
+      }
+      // One that isn't a string isn't a digest either.
+      if (!BodyDigest::parse(claim->value_, expected_digest_)) {
+        return VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST;
+      }
+      body_hasher_.reset(new BodyHasher());
+      return VerifyStatus::JWT_VERIFY_SUCCESS;
+    });
+    if (status != VerifyStatus::JWT_VERIFY_SUCCESS) {
+      return status;
     }
+  }
+
+  // A claim that is missing or isn't a string leaves the request unlimited.
+  RateLimiter* rate_limiter = config_->rateLimiter();
+  if (rate_limiter) {
+    rate_limit_key_ = claims.extra(rate_limiter->claim())->value_;
+  }
 
-    if (now > exp) {
-      return VerifyStatus::JWT_VERIFY_FAIL_EXPIRED;
+  // Cookies are bound to a subject, so tokens without one (as a string) don't get one. Neither do
+  // tokens bound to a body, the cookie would let later requests skip the check. Cookie requests are
+  // limited on the same claim value as the token they were issued for.
+  const SessionCookie* session_cookie = config_->sessionCookie();
+  if (session_cookie && !body_hasher_) {
+    SessionCookie::Session session;
+    session.sub_ = claims.sub_;
+    session.jti_ = claims.jti_;
+    session.rate_limit_key_ = rate_limit_key_;
+    if (!session.sub_.empty()) {
+      set_cookie_ = session_cookie->issue(entry.value().c_str(), session, cookieScope(),
+                                          std::max<int64_t>(claims.exp_, 0), now);
     }
   }
 
-  config_->stats().jwt_accepted_.inc();
+  const ClaimsMetadata* claims_metadata = config_->claimsMetadata();
+  if (claims_metadata) {
+    claims_metadata->claims(jwt.PayloadJson(), *field(metadata_, "claims").mutable_struct_value());
+  }
+
+  stats_.inc(SftCounter::jwt_accepted);
   return VerifyStatus::JWT_VERIFY_SUCCESS;
 }
 
-FilterHeadersStatus SftJwtDecoderFilter::decodeHeaders(HeaderMap& headers, bool) {
-  VerifyStatus status = verify(headers);
-  if (status != VerifyStatus::JWT_VERIFY_SUCCESS && status != VerifyStatus::WHITELISTED_PATH) {
+FilterHeadersStatus SftJwtDecoderFilter::decodeHeaders(HeaderMap& headers, bool end_stream) {
+  policy_ = config_->routePolicy(decoder_callbacks_->route());
+  if (policy_->auth_ == RoutePolicy::Auth::DISABLED) {
+    return FilterHeadersStatus::Continue;
+  }
+
+  body_complete_ = end_stream;
+  VerifyStatus status = verifyAndRecord(headers, true);
+  if (status == VerifyStatus::JWT_VERIFY_PENDING_JWKS_REFRESH) {
+    ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: waiting on jwks refresh", __func__);
+    wait(headers);
+    config_->jwksProvider().addKidMissWaiter(*this);
+    return FilterHeadersStatus::StopIteration;
+  }
+  if (status == VerifyStatus::JWT_VERIFY_PENDING_SIGNATURE) {
+    wait(headers);
+    return FilterHeadersStatus::StopIteration;
+  }
+  if (status == VerifyStatus::JWT_VERIFY_SHED) {
+    sendOverloaded();
+    return FilterHeadersStatus::StopIteration;
+  }
+  if (!VerifyStatusAllowed(status)) {
     sendUnauthorized(status);
     return FilterHeadersStatus::StopIteration;
   }
+  if (rateLimited()) {
+    return FilterHeadersStatus::StopIteration;
+  }
+  if (body_hasher_ && end_stream && !bodyDigestMatches()) {
+    return FilterHeadersStatus::StopIteration;
+  }
   std::string statusStr = VerifyStatusToString(status);
   ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: Authorized ({})", __func__, statusStr);
   return FilterHeadersStatus::Continue;
 }
 
-FilterDataStatus SftJwtDecoderFilter::decodeData(Buffer::Instance&, bool) {
+FilterDataStatus SftJwtDecoderFilter::decodeData(Buffer::Instance& data, bool end_stream) {
+  if (waiting_headers_) {
+    // Hashed from the decoding buffer once verification completes, see resume().
+    body_complete_ = end_stream;
+    return FilterDataStatus::StopIterationAndBuffer;
+  }
+  if (body_hasher_) {
+    // Frames are passed on as soon as they are hashed, only the last one waits on the comparison.
+    body_hasher_->update(data);
+    if (end_stream && !bodyDigestMatches()) {
+      return FilterDataStatus::StopIterationNoBuffer;
+    }
+  }
   return FilterDataStatus::Continue;
 }
 
 FilterTrailersStatus SftJwtDecoderFilter::decodeTrailers(HeaderMap&) {
+  if (waiting_headers_) {
+    body_complete_ = true;
+    return FilterTrailersStatus::StopIteration;
+  }
+  if (body_hasher_ && !bodyDigestMatches()) {
+    return FilterTrailersStatus::StopIteration;
+  }
   return FilterTrailersStatus::Continue;
 }
 
@@ -166,7 +554,86 @@ void SftJwtDecoderFilter::setDecoderFilterCallbacks(StreamDecoderFilterCallbacks
   decoder_callbacks_ = &callbacks;
 }
 
-void SftJwtDecoderFilter::onDestroy() {}
+FilterHeadersStatus SftJwtDecoderFilter::encodeHeaders(HeaderMap& headers, bool) {
+  // Local replies clear the cookie, so it is only counted once it reaches the client.
+  if (!set_cookie_.empty()) {
+    headers.addCopy(SetCookieHeader, set_cookie_);
+    stats_.inc(SftCounter::session_cookie_issued);
+  }
+  return FilterHeadersStatus::Continue;
+}
+
+FilterDataStatus SftJwtDecoderFilter::encodeData(Buffer::Instance&, bool) {
+  return FilterDataStatus::Continue;
+}
+
+FilterTrailersStatus SftJwtDecoderFilter::encodeTrailers(HeaderMap&) {
+  return FilterTrailersStatus::Continue;
+}
+
+void SftJwtDecoderFilter::setEncoderFilterCallbacks(StreamEncoderFilterCallbacks&) {}
+
+void SftJwtDecoderFilter::onJwksUpdated() {
+  HeaderMap& headers = stopWaiting();
+
+  // Only one refetch per stream, if the kid is still unknown the token is rejected.
+  VerifyStatus status = verifyAndRecord(headers, false);
+  if (status == VerifyStatus::JWT_VERIFY_PENDING_SIGNATURE) {
+    wait(headers);
+    return;
+  }
+  resume(status);
+}
+
+void SftJwtDecoderFilter::onSignatureVerified(bool valid) {
+  HeaderMap& headers = stopWaiting();
+  std::unique_ptr<Jwt> jwt = std::move(batched_jwt_);
+
+  VerifyTrace* trace = record_trace_ ? &trace_ : nullptr;
+  if (trace) {
+    trace->signature_ = lap(trace->batch_queued_);
+  }
+  cacheVerdict(*jwt, valid);
+  resume(record(headers, verifyClaims(*jwt, valid, *headers.get(config_->headerKey), trace)));
+}
+
+void SftJwtDecoderFilter::resume(VerifyStatus status) {
+  if (status == VerifyStatus::JWT_VERIFY_SHED) {
+    sendOverloaded();
+    return;
+  }
+  if (!VerifyStatusAllowed(status)) {
+    sendUnauthorized(status);
+    return;
+  }
+  if (rateLimited()) {
+    return;
+  }
+  if (body_hasher_) {
+    // The body that arrived while verification was paused is in the decoding buffer.
+    const Buffer::Instance* buffered = decoder_callbacks_->decodingBuffer();
+    if (buffered) {
+      body_hasher_->update(*buffered);
+    }
+    if (body_complete_ && !bodyDigestMatches()) {
+      return;
+    }
+  }
+  std::string statusStr = VerifyStatusToString(status);
+  ENVOY_LOG(debug, "SftJwtDecoderFilter::{}: Authorized ({})", __func__, statusStr);
+  decoder_callbacks_->continueDecoding();
+}
+
+void SftJwtDecoderFilter::onDestroy() {
+  if (waiting_headers_ && batched_jwt_) {
+    config_->batchVerifier()->remove(*this);
+    batched_jwt_.reset();
+    stopWaiting();
+  } else if (waiting_headers_) {
+    config_->jwksProvider().removeKidMissWaiter(*this);
+    stopWaiting();
+  }
+}
 
 } // namespace Sft
 } // namespace Http
@@ -3,31 +3,38 @@
 #include "sft_config.h"
 
 #include "common/common/logger.h"
+#include "envoy/http/codes.h"
 #include "server/config/network/http_connection_manager.h"
 
+#include <chrono>
+#include <memory>
 #include <string>
 
 namespace Envoy {
 namespace Http {
 namespace Sft {
 
-enum class VerifyStatus {
-  WHITELISTED_PATH,
-  JWT_VERIFY_SUCCESS,
-  JWT_VERIFY_FAIL_UNKNOWN,
-  JWT_VERIFY_FAIL_NOT_PRESENT,
-  JWT_VERIFY_FAIL_EXPIRED,
-  JWT_VERIFY_FAIL_NOT_BEFORE,
-  JWT_VERIFY_FAIL_INVALID_SIGNATURE,
-  JWT_VERIFY_FAIL_NO_VALIDATORS,
-  JWT_VERIFY_FAIL_MALFORMED,
-  JWT_VERIFY_FAIL_ISSUER_MISMATCH,
-  JWT_VERIFY_FAIL_AUDIENCE_MISMATCH
+// Per-stage timings and token details collected by verify() for the tracing span. Only filled in
+// when the request is traced or captured.
+struct VerifyTrace {
+  std::chrono::microseconds parse_{};
+  std::chrono::microseconds key_lookup_{};
+  std::chrono::microseconds signature_{};
+  std::string kid_;
+  std::string alg_;
+  std::string issuer_;
+  KeyCacheResult cache_result_{KeyCacheResult::NOT_CACHED};
+  // Set if the signature went through the BatchVerifier, signature_ then includes the queueing.
+  bool batched_{};
+  MonotonicTime batch_queued_{};
 };
 
-std::string VerifyStatusToString(VerifyStatus status);
-
-class SftJwtDecoderFilter : public StreamDecoderFilter, public Logger::Loggable<Logger::Id::http> {
+// Verifies the request's JWT on decode. When session cookies are enabled the filter also encodes,
+// to hand a session cookie to clients that presented a fully verified JWT.
+class SftJwtDecoderFilter : public StreamFilter,
+                            public KidMissWaiter,
+                            public SignatureWaiter,
+                            public Logger::Loggable<Logger::Id::http> {
 public:
   SftJwtDecoderFilter(Http::Sft::SFTConfigSharedPtr config);
   ~SftJwtDecoderFilter();
@@ -36,18 +43,91 @@ public:
   void onDestroy() override;
 
   // Http::StreamDecoderFilter
-  FilterHeadersStatus decodeHeaders(HeaderMap& headers, bool) override;
-  FilterDataStatus decodeData(Buffer::Instance&, bool) override;
+  FilterHeadersStatus decodeHeaders(HeaderMap& headers, bool end_stream) override;
+  FilterDataStatus decodeData(Buffer::Instance& data, bool end_stream) override;
   FilterTrailersStatus decodeTrailers(HeaderMap&) override;
   void setDecoderFilterCallbacks(StreamDecoderFilterCallbacks& callbacks) override;
 
+  // Http::StreamEncoderFilter
+  FilterHeadersStatus encodeHeaders(HeaderMap& headers, bool) override;
+  FilterDataStatus encodeData(Buffer::Instance&, bool) override;
+  FilterTrailersStatus encodeTrailers(HeaderMap&) override;
+  void setEncoderFilterCallbacks(StreamEncoderFilterCallbacks& callbacks) override;
+
+  // Http::Sft::KidMissWaiter
+  void onJwksUpdated() override;
+
+  // Http::Sft::SignatureWaiter
+  void onSignatureVerified(bool valid) override;
+
 private:
   StreamDecoderFilterCallbacks* decoder_callbacks_;
   Http::Sft::SFTConfigSharedPtr config_;
+  // This worker's counters.
+  WorkerStats& stats_;
+  // Policy of the route the request matched, resolved in decodeHeaders().
+  RoutePolicyConstSharedPtr policy_;
+
+  // Set while the stream is paused waiting on a kid-miss JWKS refetch or a batched signature.
+  HeaderMap* waiting_headers_{};
+  // The token whose signature is queued on the BatchVerifier.
+  std::unique_ptr<Jwt> batched_jwt_;
+  // The token's VerifiedCache key, set when the cache is enabled and the token's key is known.
+  VerifiedCache::Key cache_key_{};
+  // Verification in progress, kept across a batched signature check.
+  MonotonicTime verify_start_{};
+  Tracing::SpanPtr span_;
+  bool record_trace_{};
+  VerifyTrace trace_;
+  // Set once verification gets past the point where it could be shed, see LoadShedder.
+  bool cold_{};
+  // Set-Cookie value to add to the response, if a session cookie was issued. Dropped by local
+  // replies, a rejected request doesn't get one.
+  std::string set_cookie_;
+  // Value of the rate limited claim of a verified request, empty if it isn't limited.
+  std::string rate_limit_key_;
+  // Set while the body is hashed for a token bound to it, see BodyDigest.
+  BodyHasherPtr body_hasher_;
+  BodyDigest::Digest expected_digest_;
+  // Set once the whole request has been received.
+  bool body_complete_{};
+  // Dynamic metadata of the request, filled in during verification when enabled, see
+  // ClaimsMetadata.
+  ProtobufWkt::Struct metadata_;
 
   // helpers
   void sendUnauthorized(VerifyStatus status);
-  VerifyStatus verify(HeaderMap& headers);
+  // Replies locally without the session cookie.
+  void sendLocalReply(Code code, const std::string& body);
+  // Replies 503 with Retry-After to a shed request.
+  void sendOverloaded();
+  // Pauses the stream until verification completes, counted as in flight by the LoadShedder.
+  void wait(HeaderMap& headers);
+  HeaderMap& stopWaiting();
+  // Takes a token from the verified subject's bucket, replying 429 if it is empty.
+  bool rateLimited();
+  // What session cookies are issued and accepted under: the route's issuer and audiences and the
+  // claim requests are rate limited on, which the cookie carries the value of.
+  uint64_t cookieScope() const;
+  // Compares the hashed body with the token's digest, replying 401 if they differ.
+  bool bodyDigestMatches();
+  // Continues or rejects the paused stream once verification completed.
+  void resume(VerifyStatus status);
+  // Runs verify() and counts the outcome. Traced requests get a child span around it, the outcome
+  // is written to the capture trace when capture is enabled and published as dynamic metadata when
+  // that is. A batched signature leaves the recording to onSignatureVerified().
+  VerifyStatus verifyAndRecord(HeaderMap& headers, bool allow_refetch);
+  VerifyStatus record(const HeaderMap& headers, VerifyStatus status);
+  void publishMetadata(VerifyStatus status);
+  CaptureRecord captureRecord(const CaptureWriter& capture, const HeaderMap& headers,
+                              VerifyStatus status, const VerifyTrace& trace,
+                              std::chrono::nanoseconds elapsed);
+  VerifyStatus verify(HeaderMap& headers, bool allow_refetch, VerifyTrace* trace);
+  // Records a signature verdict in the VerifiedCache, if enabled.
+  void cacheVerdict(Jwt& jwt, bool valid);
+  // The rest of verify() once the signature has been checked.
+  VerifyStatus verifyClaims(Jwt& jwt, bool signature_valid, const HeaderEntry& entry,
+                            VerifyTrace* trace);
 };
 
 } // namespace Sft
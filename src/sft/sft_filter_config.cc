@@ -1,24 +1,46 @@
 #include <string>
 
+#include "sft_admin.h"
 #include "sft_config.h"
 #include "sft_filter.h"
 #include "sft_filter_config.h"
 
+#include "common/common/utility.h"
 #include "envoy/registry/registry.h"
+#include "envoy/singleton/manager.h"
 
 namespace Envoy {
 namespace Server {
 namespace Configuration {
 
+// Shares JWKS providers between every instance of the filter in the process.
+SINGLETON_MANAGER_REGISTRATION(sft_jwks_provider_registry);
+// Single /accessfabric admin handler listing every filter config in the process.
+SINGLETON_MANAGER_REGISTRATION(sft_admin);
+
 HttpFilterFactoryCb SftJwtDecoderFilterConfig::createFilterFactory(const Json::Object& json_config,
-                                                                   const std::string&,
+                                                                   const std::string& stat_prefix,
                                                                    FactoryContext& context) {
-  Http::Sft::SFTConfigSharedPtr config(
-      new Http::Sft::SFTConfig(json_config, context.threadLocal(), context.clusterManager(),
-                               context.dispatcher(), context.scope(), context.random()));
-  return [config](Http::FilterChainFactoryCallbacks& callbacks) -> void {
-    callbacks.addStreamDecoderFilter(
-        Http::StreamDecoderFilterSharedPtr{new Http::Sft::SftJwtDecoderFilter(config)});
+  Http::Sft::JwksProviderRegistrySharedPtr registry =
+      context.singletonManager().getTyped<Http::Sft::JwksProviderRegistry>(
+          SINGLETON_MANAGER_REGISTERED_NAME(sft_jwks_provider_registry),
+          [&context] {
+            return std::make_shared<Http::Sft::JwksProviderRegistry>(context.scope());
+          });
+  Http::Sft::SFTConfigSharedPtr config(new Http::Sft::SFTConfig(
+      stat_prefix, json_config, registry, context.threadLocal(), context.clusterManager(),
+      context.dispatcher(), context.scope(), context.random(), context.accessLogManager(),
+      ProdSystemTimeSource::instance_));
+
+  Http::Sft::SftAdminSharedPtr admin = context.singletonManager().getTyped<Http::Sft::SftAdmin>(
+      SINGLETON_MANAGER_REGISTERED_NAME(sft_admin),
+      [&context] { return std::make_shared<Http::Sft::SftAdmin>(context.admin()); });
+  admin->addConfig(config);
+
+  // The singleton manager only holds weak references, keep the admin handler alive with the filter.
+  return [config, admin](Http::FilterChainFactoryCallbacks& callbacks) -> void {
+    callbacks.addStreamFilter(
+        Http::StreamFilterSharedPtr{new Http::Sft::SftJwtDecoderFilter(config)});
   };
 };
 
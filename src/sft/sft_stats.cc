@@ -0,0 +1,165 @@
+#include "sft_stats.h"
+
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+#define GENERATE_SFT_COUNTER_POINTER(NAME) &stats_.NAME##_,
+
+namespace {
+
+typedef std::array<uint64_t, LatencyBucketCount> Histogram;
+
+// What `current` gained since `flushed`, which is then moved up to it. Returns the number of
+// values added.
+uint64_t interval(const Histogram& current, Histogram& flushed, Histogram& out) {
+  uint64_t samples = 0;
+  for (size_t i = 0; i < LatencyBucketCount; i++) {
+    out[i] = current[i] - flushed[i];
+    samples += out[i];
+  }
+  flushed = current;
+  return samples;
+}
+
+// Records every value counted in `buckets` into `histogram`, as the upper bound of its bucket.
+void replay(const Histogram& buckets, Stats::Histogram& histogram) {
+  for (size_t i = 0; i < LatencyBucketCount; i++) {
+    const uint64_t value = (1ULL << i) - 1;
+    for (uint64_t n = 0; n < buckets[i]; n++) {
+      histogram.recordValue(value);
+    }
+  }
+}
+
+} // namespace
+
+void WorkerStats::recordVerify(VerifyStatus status, std::chrono::nanoseconds elapsed) {
+  bump(verify_counts_[static_cast<size_t>(status)]);
+  bump(latency_us_[log2Bucket(
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count())]);
+}
+
+void WorkerStats::recordBatch(size_t size, std::chrono::nanoseconds elapsed) {
+  bump(counters_[static_cast<size_t>(SftCounter::verify_batches)]);
+  bump(counters_[static_cast<size_t>(SftCounter::verify_batched_signatures)], size);
+  bump(batch_sizes_[log2Bucket(size)]);
+  bump(batch_ns_, elapsed.count());
+}
+
+SftWorkerStats::SftWorkerStats(const SftStats& stats, ThreadLocal::SlotAllocator& tls,
+                               Event::Dispatcher& dispatcher,
+                               std::chrono::milliseconds flush_interval)
+    : stats_(stats), counters_{{ALL_SFT_STATS(GENERATE_SFT_COUNTER_POINTER, IGNORE_SFT_STAT,
+                                                   IGNORE_SFT_STAT)}},
+      registry_(std::make_shared<Registry>()), flush_interval_(flush_interval),
+      flush_timer_(dispatcher.createTimer([this]() -> void {
+        flush();
+        flush_timer_->enableTimer(flush_interval_);
+      })),
+      tls_(tls.allocateSlot()) {
+  if (flush_interval_.count() <= 0) {
+    throw EnvoyException("invalid 'stats_flush_interval_ms' in sft filter config");
+  }
+
+  std::shared_ptr<Registry> registry = registry_;
+  tls_->set([registry](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    auto local = std::make_shared<ThreadLocalWorkerStats>();
+    local->stats_ = std::make_shared<WorkerStats>();
+    std::lock_guard<std::mutex> guard(registry->lock_);
+    registry->workers_.push_back(local->stats_);
+    return local;
+  });
+  flush_timer_->enableTimer(flush_interval_);
+
+  // Rates over the first interval start from here.
+  rate_samples_[0].time_ = ProdMonotonicTimeSource::instance_.currentTime();
+  rate_next_ = rate_size_ = 1;
+}
+
+SftWorkerStats::~SftWorkerStats() { flush(); }
+
+uint64_t SftWorkerStats::verifyCount(VerifyStatus status) const {
+  uint64_t count = 0;
+  std::lock_guard<std::mutex> guard(registry_->lock_);
+  for (const WorkerStatsSharedPtr& worker : registry_->workers_) {
+    count += worker->verify_counts_[static_cast<size_t>(status)].load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+std::array<double, VerifyStatusCount> SftWorkerStats::verifyRates(double& window_s) const {
+  std::array<double, VerifyStatusCount> rates{};
+  const RateSample& latest = rate_samples_[(rate_next_ + RateSamples - 1) % RateSamples];
+  const RateSample& oldest = rate_samples_[rate_size_ < RateSamples ? 0 : rate_next_];
+  window_s = std::chrono::duration_cast<std::chrono::duration<double>>(latest.time_ - oldest.time_)
+                 .count();
+  if (window_s <= 0) {
+    window_s = 0;
+    return rates;
+  }
+
+  for (size_t i = 0; i < VerifyStatusCount; i++) {
+    rates[i] = (latest.verify_counts_[i] - oldest.verify_counts_[i]) / window_s;
+  }
+  return rates;
+}
+
+void SftWorkerStats::flush() {
+  std::array<uint64_t, SftCounterCount> counters{};
+  Histogram latency_us{};
+  Histogram batch_sizes{};
+  uint64_t batch_ns = 0;
+  RateSample& sample = rate_samples_[rate_next_];
+  sample.verify_counts_ = {};
+  {
+    std::lock_guard<std::mutex> guard(registry_->lock_);
+    for (const WorkerStatsSharedPtr& worker : registry_->workers_) {
+      for (size_t i = 0; i < SftCounterCount; i++) {
+        counters[i] += worker->counters_[i].load(std::memory_order_relaxed);
+      }
+      for (size_t i = 0; i < LatencyBucketCount; i++) {
+        latency_us[i] += worker->latency_us_[i].load(std::memory_order_relaxed);
+        batch_sizes[i] += worker->batch_sizes_[i].load(std::memory_order_relaxed);
+      }
+      batch_ns += worker->batch_ns_.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < VerifyStatusCount; i++) {
+        sample.verify_counts_[i] += worker->verify_counts_[i].load(std::memory_order_relaxed);
+      }
+    }
+  }
+  sample.time_ = ProdMonotonicTimeSource::instance_.currentTime();
+  rate_next_ = (rate_next_ + 1) % RateSamples;
+  if (rate_size_ < RateSamples) {
+    rate_size_++;
+  }
+
+  // The batch gauge only moves in intervals that had batches.
+  const size_t batched = static_cast<size_t>(SftCounter::verify_batched_signatures);
+  const uint64_t batched_signatures = counters[batched] - flushed_counters_[batched];
+  Histogram batch_interval;
+  const uint64_t batches = interval(batch_sizes, flushed_batch_sizes_, batch_interval);
+  replay(batch_interval, stats_.verify_batch_size_);
+  if (batches > 0 && batched_signatures > 0) {
+    stats_.verify_batch_signature_ns_.set((batch_ns - flushed_batch_ns_) / batched_signatures);
+  }
+  flushed_batch_ns_ = batch_ns;
+
+  for (size_t i = 0; i < SftCounterCount; i++) {
+    if (counters[i] != flushed_counters_[i]) {
+      counters_[i]->add(counters[i] - flushed_counters_[i]);
+      flushed_counters_[i] = counters[i];
+    }
+  }
+
+  Histogram latency_interval;
+  interval(latency_us, flushed_latency_us_, latency_interval);
+  replay(latency_interval, stats_.jwt_verify_us_);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "common/common/logger.h"
+#include "envoy/common/time.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "verify_status.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// clang-format off
+#define ALL_SFT_STATS(COUNTER, GAUGE, HISTOGRAM)                                            \
+  COUNTER(jwt_rejected)                                                                     \
+  COUNTER(jwt_accepted)                                                                     \
+  COUNTER(whitelist_accepted)                                                               \
+  COUNTER(session_cookie_accepted)                                                          \
+  COUNTER(session_cookie_issued)                                                            \
+  COUNTER(rate_limited)                                                                     \
+  COUNTER(rate_limit_evicted)                                                               \
+  COUNTER(verify_batches)                                                                   \
+  COUNTER(verify_batched_signatures)                                                        \
+  COUNTER(verified_cache_hit)                                                               \
+  COUNTER(verified_cache_miss)                                                              \
+  COUNTER(shed_in_flight)                                                                   \
+  COUNTER(shed_latency)                                                                     \
+  COUNTER(body_digest_verified)                                                             \
+  COUNTER(body_digest_mismatch)                                                             \
+  GAUGE(verify_batch_signature_ns)                                                          \
+  HISTOGRAM(jwt_verify_us)                                                                  \
+  HISTOGRAM(verify_batch_size)
+// clang-format on
+
+struct SftStats {
+  ALL_SFT_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+#define GENERATE_SFT_COUNTER_ENUM(NAME) NAME,
+#define COUNT_SFT_COUNTER(NAME) +1
+#define IGNORE_SFT_STAT(NAME)
+
+// The ALL_SFT_STATS counters, in declaration order.
+enum class SftCounter {
+  ALL_SFT_STATS(GENERATE_SFT_COUNTER_ENUM, IGNORE_SFT_STAT, IGNORE_SFT_STAT)
+};
+const size_t SftCounterCount = 0 ALL_SFT_STATS(COUNT_SFT_COUNTER, IGNORE_SFT_STAT, IGNORE_SFT_STAT);
+
+// Verify latency is bucketed by powers of two microseconds, the last bucket holds everything from
+// ~4s up. Batch sizes use the same buckets.
+const size_t LatencyBucketCount = 24;
+
+// One worker's share of the filter's counters. Only the owning worker writes them, with a plain
+// load and store instead of a locked read-modify-write, so the request path never waits on another
+// core for a cache line. The main thread reads them when flushing.
+class WorkerStats {
+public:
+  void inc(SftCounter counter) { bump(counters_[static_cast<size_t>(counter)]); }
+  void add(SftCounter counter, uint64_t amount) {
+    bump(counters_[static_cast<size_t>(counter)], amount);
+  }
+  void recordVerify(VerifyStatus status, std::chrono::nanoseconds elapsed);
+  // A BatchVerifier batch of `size` signatures, checked in `elapsed`.
+  void recordBatch(size_t size, std::chrono::nanoseconds elapsed);
+
+private:
+  friend class SftWorkerStats;
+
+  static void bump(std::atomic<uint64_t>& value, uint64_t amount = 1) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+  static size_t log2Bucket(uint64_t value) {
+    return value == 0 ? 0 : std::min<size_t>(64 - __builtin_clzll(value), LatencyBucketCount - 1);
+  }
+
+  // Keeps neighbouring allocations, such as another worker's counters, off these cache lines.
+  char pad_before_[64];
+  std::array<std::atomic<uint64_t>, SftCounterCount> counters_{};
+  std::array<std::atomic<uint64_t>, VerifyStatusCount> verify_counts_{};
+  std::array<std::atomic<uint64_t>, LatencyBucketCount> latency_us_{};
+  std::array<std::atomic<uint64_t>, LatencyBucketCount> batch_sizes_{};
+  std::atomic<uint64_t> batch_ns_{};
+  char pad_after_[64];
+};
+
+typedef std::shared_ptr<WorkerStats> WorkerStatsSharedPtr;
+
+// Per-worker WorkerStats, merged into the shared SftStats every `flush_interval` (and when
+// destroyed), so each shared counter sees one add per worker per interval instead of one per
+// request. The interval's verify latencies and batch sizes are replayed into the jwt_verify_us and
+// verify_batch_size histograms, one value per verification or batch at the upper bound of its
+// bucket, and the batch gauge reports the batches' time per signature.
+// Each flush also records the verify totals in a ring of the last RateSamples flushes, which rates
+// are derived from.
+class SftWorkerStats : public Logger::Loggable<Logger::Id::http> {
+public:
+  // A minute at the default flush interval.
+  static const size_t RateSamples = 13;
+
+  SftWorkerStats(const SftStats& stats, ThreadLocal::SlotAllocator& tls,
+                 Event::Dispatcher& dispatcher, std::chrono::milliseconds flush_interval);
+  ~SftWorkerStats();
+
+  // The calling worker's stats.
+  WorkerStats& local() { return *tls_->getTyped<ThreadLocalWorkerStats>().stats_; }
+
+  // Totals across workers, current rather than as of the last flush.
+  uint64_t verifyCount(VerifyStatus status) const;
+  // Verify outcomes per second between the oldest and the latest flush still in the ring, and the
+  // length of that window in seconds (0, and no rates, until the first flush). Main thread only.
+  std::array<double, VerifyStatusCount> verifyRates(double& window_s) const;
+
+  // Main thread only.
+  void flush();
+
+private:
+  struct ThreadLocalWorkerStats : public ThreadLocal::ThreadLocalObject {
+    WorkerStatsSharedPtr stats_;
+  };
+
+  // Every worker's stats, registered from the workers as they pick up the slot. Stats outlive
+  // their worker, so counts are never lost.
+  struct Registry {
+    mutable std::mutex lock_;
+    std::vector<WorkerStatsSharedPtr> workers_;
+  };
+
+  struct RateSample {
+    MonotonicTime time_;
+    std::array<uint64_t, VerifyStatusCount> verify_counts_{};
+  };
+
+  SftStats stats_;
+  std::array<Stats::Counter*, SftCounterCount> counters_;
+  std::shared_ptr<Registry> registry_;
+  // Sums as of the previous flush.
+  std::array<uint64_t, SftCounterCount> flushed_counters_{};
+  std::array<uint64_t, LatencyBucketCount> flushed_latency_us_{};
+  std::array<uint64_t, LatencyBucketCount> flushed_batch_sizes_{};
+  uint64_t flushed_batch_ns_{};
+  // Verify totals as of the last RateSamples flushes (and construction), oldest at
+  // `rate_next_` once full.
+  std::array<RateSample, RateSamples> rate_samples_;
+  size_t rate_next_{};
+  size_t rate_size_{};
+  const std::chrono::milliseconds flush_interval_;
+  Event::TimerPtr flush_timer_;
+  ThreadLocal::SlotPtr tls_;
+};
+
+typedef std::unique_ptr<SftWorkerStats> SftWorkerStatsPtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
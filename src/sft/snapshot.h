@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// A read-mostly value published by one writer (the main thread) and read by every worker.
+//
+// Publishing stores the new snapshot and then bumps a generation counter. Readers keep their own
+// SnapshotReader and only compare the generation on the hot path (a single acquire load); the
+// shared_ptr itself is only loaded when the generation changes. The previous snapshot is freed
+// once the last reader that still holds it picks up the new generation.
+template <class T> class AtomicSnapshot {
+public:
+  typedef std::shared_ptr<const T> SnapshotSharedPtr;
+
+  void publish(SnapshotSharedPtr snapshot) {
+    std::atomic_store(&snapshot_, std::move(snapshot));
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+
+  SnapshotSharedPtr load() const { return std::atomic_load(&snapshot_); }
+  uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+private:
+  SnapshotSharedPtr snapshot_;
+  std::atomic<uint64_t> generation_{0};
+};
+
+// Per-thread view of an AtomicSnapshot. Not thread safe, each worker owns its own.
+template <class T> class SnapshotReader {
+public:
+  const T* get(const AtomicSnapshot<T>& source) {
+    const uint64_t generation = source.generation();
+    if (generation != generation_) {
+      current_ = source.load();
+      generation_ = generation;
+    }
+    return current_.get();
+  }
+
+  uint64_t generation() const { return generation_; }
+
+private:
+  typename AtomicSnapshot<T>::SnapshotSharedPtr current_;
+  uint64_t generation_{0};
+};
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,103 @@
+#include "filter_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Signatures are queued by the filter and checked once the dispatcher gets to its timer.
+class BatchVerifierTest : public FilterFixture {
+public:
+  void SetUp() override {
+    makeConfig(R"("verify_batch": true)");
+    ASSERT_NE(nullptr, config_->batchVerifier());
+  }
+
+  TestStreamPtr queue(const std::string& jwt) {
+    TestStreamPtr stream = FilterFixture::stream(jwt);
+    EXPECT_EQ(FilterHeadersStatus::StopIteration, stream->decodeHeaders());
+    return stream;
+  }
+};
+
+// Each stream is resumed with its own outcome, although the batch is checked grouped by key.
+TEST_F(BatchVerifierTest, ResumesEachStream) {
+  std::vector<TestStreamPtr> streams;
+  streams.push_back(queue(token(Kid2, key2_, Claims)));
+  streams.push_back(queue(token(Kid1, key1_, Claims, false)));
+  streams.push_back(queue(token(Kid2, key2_, Claims, false)));
+  streams.push_back(queue(token(Kid1, key1_, Claims)));
+  streams.push_back(queue(token(Kid2, key2_, R"("iss": "iss1", "aud": "aud2")")));
+
+  // Nothing is checked until the current dispatcher iteration is done.
+  for (const TestStreamPtr& stream : streams) {
+    EXPECT_FALSE(stream->continued_);
+    EXPECT_EQ("", stream->status_);
+  }
+  EXPECT_EQ(0U, config_->verifyCount(VerifyStatus::JWT_VERIFY_SUCCESS));
+
+  runDispatcher();
+  EXPECT_TRUE(streams[0]->continued_);
+  EXPECT_EQ("401", streams[1]->status_);
+  EXPECT_EQ("401", streams[2]->status_);
+  EXPECT_TRUE(streams[3]->continued_);
+  EXPECT_EQ("401", streams[4]->status_);
+  for (size_t i : {1, 2, 4}) {
+    EXPECT_FALSE(streams[i]->continued_) << i;
+  }
+  EXPECT_EQ(2U, config_->verifyCount(VerifyStatus::JWT_VERIFY_SUCCESS));
+  EXPECT_EQ(2U, config_->verifyCount(VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE));
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH));
+
+  // Later signatures go into a batch of their own.
+  TestStreamPtr later = queue(token());
+  EXPECT_FALSE(later->continued_);
+  runDispatcher();
+  EXPECT_TRUE(later->continued_);
+  EXPECT_EQ(3U, config_->verifyCount(VerifyStatus::JWT_VERIFY_SUCCESS));
+}
+
+// A stream reset while its signature is queued is never called back, the rest of the batch is.
+TEST_F(BatchVerifierTest, RemovedWhileQueued) {
+  TestStreamPtr reset = queue(token());
+  TestStreamPtr kept = queue(token());
+  reset->filter_.onDestroy();
+  reset.reset();
+
+  runDispatcher();
+  EXPECT_TRUE(kept->continued_);
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_SUCCESS));
+
+  // A batch left empty is dropped.
+  reset = queue(token(Kid2, key2_, Claims));
+  reset->filter_.onDestroy();
+  reset.reset();
+  runDispatcher();
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_SUCCESS));
+}
+
+// Resuming one stream can reset another in the same batch before its callback.
+TEST_F(BatchVerifierTest, RemovedWhileFlushing) {
+  TestStreamPtr first = queue(token());
+  TestStreamPtr second = queue(token());
+  TestStreamPtr third = queue(token(Claims, false));
+  first->on_resume_ = [&second]() -> void {
+    second->filter_.onDestroy();
+    second.reset();
+  };
+
+  runDispatcher();
+  EXPECT_TRUE(first->continued_);
+  EXPECT_EQ(nullptr, second);
+  EXPECT_EQ("401", third->status_);
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_SUCCESS));
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,147 @@
+#include "common/buffer/buffer_impl.h"
+#include "common/common/base64.h"
+
+#include "../body_digest.h"
+#include "filter_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const std::string Body = "{\"amount\":100,\"to\":\"acct-2\"}";
+
+BodyDigest::Digest sha256(const std::string& data) {
+  BodyDigest::Digest digest;
+  SHA256(reinterpret_cast<const uint8_t*>(data.data()), data.size(), digest.data());
+  return digest;
+}
+
+std::string base64(const BodyDigest::Digest& digest) {
+  return Base64::encode(reinterpret_cast<const char*>(digest.data()), digest.size());
+}
+
+} // namespace
+
+TEST(BodyDigestTest, ParseContentDigest) {
+  const BodyDigest::Digest expected = sha256(Body);
+  BodyDigest::Digest digest{};
+  EXPECT_TRUE(BodyDigest::parse("sha-256=:" + base64(expected) + ":", digest));
+  EXPECT_EQ(expected, digest);
+
+  // Other algorithms in the list are skipped, names are case insensitive.
+  digest = {};
+  EXPECT_TRUE(BodyDigest::parse(
+      "sha-512=:" + std::string(88, 'A') + ":, SHA-256=:" + base64(expected) + ": ", digest));
+  EXPECT_EQ(expected, digest);
+}
+
+TEST(BodyDigestTest, ParseDigest) {
+  const BodyDigest::Digest expected = sha256(Body);
+  BodyDigest::Digest digest{};
+  EXPECT_TRUE(BodyDigest::parse("SHA-256=" + base64(expected), digest));
+  EXPECT_EQ(expected, digest);
+
+  digest = {};
+  EXPECT_TRUE(BodyDigest::parse("md5=aGVsbG8=,sha-256=" + base64(expected), digest));
+  EXPECT_EQ(expected, digest);
+}
+
+TEST(BodyDigestTest, ParseRejects) {
+  BodyDigest::Digest digest{};
+  EXPECT_FALSE(BodyDigest::parse("", digest));
+  EXPECT_FALSE(BodyDigest::parse("sha-512=:" + std::string(88, 'A') + ":", digest));
+  EXPECT_FALSE(BodyDigest::parse("sha-256", digest));
+  EXPECT_FALSE(BodyDigest::parse("sha-2567=" + base64(sha256(Body)), digest));
+  // Not 32 bytes.
+  EXPECT_FALSE(BodyDigest::parse("sha-256=:aGVsbG8=:", digest));
+  EXPECT_FALSE(BodyDigest::parse("sha-256=:not base64:", digest));
+}
+
+// A body hashed as it streams, over many slices and frames, has the digest of the whole body.
+TEST(BodyDigestTest, StreamingMatchesBuffered) {
+  std::string body;
+  for (size_t i = 0; i < 2000; i++) {
+    body += Body;
+  }
+
+  BodyHasher buffered;
+  Buffer::OwnedImpl whole(body);
+  buffered.update(whole);
+  const BodyDigest::Digest expected = buffered.finish();
+  EXPECT_EQ(sha256(body), expected);
+
+  BodyHasher streaming;
+  for (size_t offset = 0; offset < body.size(); offset += 9000) {
+    // Each frame is made of several slices.
+    Buffer::OwnedImpl frame;
+    for (size_t slice = offset; slice < std::min(body.size(), offset + 9000); slice += 1000) {
+      Buffer::OwnedImpl part(body.substr(slice, std::min<size_t>(1000, offset + 9000 - slice)));
+      frame.move(part);
+    }
+    streaming.update(frame);
+  }
+  EXPECT_EQ(expected, streaming.finish());
+
+  // Empty frames, e.g. the end of stream flag on its own, don't change the digest.
+  BodyHasher empty;
+  Buffer::OwnedImpl nothing;
+  empty.update(nothing);
+  EXPECT_EQ(sha256(""), empty.finish());
+}
+
+// A token carrying the claim is only let through with the body it holds the digest of.
+class BodyDigestFilterTest : public FilterFixture {
+public:
+  void SetUp() override { makeConfig(R"("body_digest_claim": "body_sha256")"); }
+
+  // Claims that pass the policy and bind the token to Body.
+  std::string boundClaims(const std::string& extra = "") {
+    return Claims + R"(, "body_sha256": "sha-256=:)" + base64(sha256(Body)) + ":\"" + extra;
+  }
+};
+
+TEST_F(BodyDigestFilterTest, Bound) {
+  TestStreamPtr stream = FilterFixture::stream(token(boundClaims()));
+  EXPECT_EQ(FilterHeadersStatus::Continue, stream->filter_.decodeHeaders(stream->headers_, false));
+  Buffer::OwnedImpl body(Body);
+  EXPECT_EQ(FilterDataStatus::Continue, stream->filter_.decodeData(body, true));
+  EXPECT_EQ("", stream->status_);
+
+  stream = FilterFixture::stream(token(boundClaims()));
+  EXPECT_EQ(FilterHeadersStatus::Continue, stream->filter_.decodeHeaders(stream->headers_, false));
+  Buffer::OwnedImpl other("{\"amount\":900,\"to\":\"acct-3\"}");
+  EXPECT_EQ(FilterDataStatus::StopIterationNoBuffer, stream->filter_.decodeData(other, true));
+  EXPECT_EQ("401", stream->status_);
+
+  // One that holds no digest.
+  stream = FilterFixture::stream(token(Claims + R"(, "body_sha256": 5)"));
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, stream->decodeHeaders());
+  EXPECT_EQ("401", stream->status_);
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST));
+}
+
+// Json::Factory can't load a payload with an integer out of int64_t range. The claim is read
+// without it, so such a token is still bound to its body.
+TEST_F(BodyDigestFilterTest, UnloadablePayload) {
+  const std::string claims = boundClaims(R"(, "n": 18446744073709551615)");
+  TestStreamPtr stream = FilterFixture::stream(token(claims));
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, stream->decodeHeaders());
+  EXPECT_EQ("401", stream->status_);
+
+  stream = FilterFixture::stream(token(claims));
+  EXPECT_EQ(FilterHeadersStatus::Continue, stream->filter_.decodeHeaders(stream->headers_, false));
+  Buffer::OwnedImpl body(Body);
+  EXPECT_EQ(FilterDataStatus::Continue, stream->filter_.decodeData(body, true));
+  EXPECT_EQ("", stream->status_);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,70 @@
+#include "test/mocks/filesystem/mocks.h"
+
+#include "../capture.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+
+using testing::NiceMock;
+using testing::SaveArg;
+using testing::_;
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+TEST(CaptureTest, HeaderFrame) {
+  auto file = std::make_shared<NiceMock<Filesystem::MockFile>>();
+  std::string header;
+  EXPECT_CALL(*file, write(_)).WillOnce(SaveArg<0>(&header));
+  CaptureWriter writer(file);
+
+  ASSERT_EQ(CaptureFrameSize, header.size());
+  CaptureRecord record;
+  EXPECT_FALSE(DecodeCaptureRecord(header.data(), record));
+}
+
+TEST(CaptureTest, RecordRoundTrip) {
+  CaptureRecord record;
+  record.time_us_ = 1510989561000001;
+  record.path_hash_ = 0x01020304;
+  record.token_hash_ = 0xfffffffe;
+  record.kid_hash_ = 7;
+  record.token_size_ = 65535;
+  record.status_ = 3;
+  record.verify_ns_ = 123456;
+
+  const std::string frame = EncodeCaptureRecord(record);
+  ASSERT_EQ(CaptureFrameSize, frame.size());
+  CaptureRecord decoded;
+  ASSERT_TRUE(DecodeCaptureRecord(frame.data(), decoded));
+  EXPECT_EQ(record.time_us_, decoded.time_us_);
+  EXPECT_EQ(record.path_hash_, decoded.path_hash_);
+  EXPECT_EQ(record.token_hash_, decoded.token_hash_);
+  EXPECT_EQ(record.kid_hash_, decoded.kid_hash_);
+  EXPECT_EQ(record.token_size_, decoded.token_size_);
+  EXPECT_EQ(record.status_, decoded.status_);
+  EXPECT_EQ(record.verify_ns_, decoded.verify_ns_);
+}
+
+// Hashes group within a trace, but each writer has its own key.
+TEST(CaptureTest, KeyedHash) {
+  const std::string kid = "65289b19-e0c6-4918-8933-7961781adb0d";
+  const std::string other_kid = "eefdf879-c941-4701-bd5d-f357bff7798d";
+  CaptureWriter writer(std::make_shared<NiceMock<Filesystem::MockFile>>());
+  CaptureWriter other_writer(std::make_shared<NiceMock<Filesystem::MockFile>>());
+
+  const uint32_t hash = writer.hash(kid.data(), kid.size());
+  EXPECT_NE(0U, hash);
+  EXPECT_EQ(hash, writer.hash(kid.data(), kid.size()));
+  EXPECT_NE(hash, writer.hash(other_kid.data(), other_kid.size()));
+  EXPECT_NE(hash, other_writer.hash(kid.data(), kid.size()));
+  EXPECT_NE(0U, writer.hash("", 0));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,134 @@
+#include "common/json/json_loader.h"
+
+#include "../claims_metadata.h"
+#include "filter_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+ProtobufWkt::Struct claims(const std::string& config, const std::string& payload) {
+  ProtobufWkt::Struct out;
+  ClaimsMetadata(*Json::Factory::loadFromString(config)).claims(payload, out);
+  return out;
+}
+
+const std::string Payload =
+    R"({"sub": "sub1", "n": 3, "admin": true, "groups": ["a", "b"], "ext": {"team": null}})";
+
+} // namespace
+
+TEST(ClaimsMetadataTest, Claims) {
+  ProtobufWkt::Struct all = claims(R"({"dynamic_metadata": true})", Payload);
+  ASSERT_EQ(5, all.fields_size());
+  EXPECT_EQ("sub1", all.fields().at("sub").string_value());
+  // Numbers are published as doubles.
+  EXPECT_EQ(3.0, all.fields().at("n").number_value());
+  EXPECT_TRUE(all.fields().at("admin").bool_value());
+  const ProtobufWkt::ListValue& groups = all.fields().at("groups").list_value();
+  ASSERT_EQ(2, groups.values_size());
+  EXPECT_EQ("b", groups.values(1).string_value());
+  EXPECT_EQ(ProtobufWkt::NULL_VALUE,
+            all.fields().at("ext").struct_value().fields().at("team").null_value());
+
+  ProtobufWkt::Struct filtered =
+      claims(R"({"dynamic_metadata": true, "metadata_claims": ["sub", "groups", "email"]})",
+             Payload);
+  EXPECT_EQ(2, filtered.fields_size());
+  EXPECT_EQ("sub1", filtered.fields().at("sub").string_value());
+  EXPECT_EQ(2, filtered.fields().at("groups").list_value().values_size());
+}
+
+// Claims nested deeper than the limit are published as null, payloads that aren't an object as
+// nothing.
+TEST(ClaimsMetadataTest, Limits) {
+  const std::string deep = std::string(32, '[') + std::string(32, ']');
+  ProtobufWkt::Struct out = claims(R"({"dynamic_metadata": true})", "{\"deep\": " + deep + "}");
+  const ProtobufWkt::Value* value = &out.fields().at("deep");
+  size_t depth = 1;
+  while (value->kind_case() == ProtobufWkt::Value::kListValue) {
+    ASSERT_EQ(1, value->list_value().values_size());
+    value = &value->list_value().values(0);
+    depth++;
+  }
+  EXPECT_EQ(ProtobufWkt::Value::kNullValue, value->kind_case());
+  EXPECT_EQ(16U, depth);
+
+  for (const char* payload : {"", "[]", "\"sub\"", "{\"sub\": "}) {
+    EXPECT_EQ(0, claims(R"({"dynamic_metadata": true})", payload).fields_size()) << payload;
+  }
+}
+
+// What the filter publishes: the status of every verification, the kid once it is known, and the
+// claims of requests it lets through.
+class ClaimsMetadataFilterTest : public FilterFixture {
+public:
+  void SetUp() override {
+    makeConfig(R"("dynamic_metadata": true, "metadata_claims": ["sub", "groups"],
+                  "session_cookie_name": "sft_session",
+                  "session_cookie_secret": "claims-metadata-test-session-cookie-secret")");
+  }
+
+  const ProtobufWkt::Struct& metadata(const TestStream& stream) {
+    return stream.metadata_.at(config_->claimsMetadata()->name());
+  }
+};
+
+TEST_F(ClaimsMetadataFilterTest, Accepted) {
+  TestStreamPtr stream = FilterFixture::stream(
+      token(Claims + R"(, "groups": ["a", "b"], "email": "sub1@example.com")"));
+  EXPECT_EQ(FilterHeadersStatus::Continue, stream->decodeHeaders());
+
+  const ProtobufWkt::Struct& published = metadata(*stream);
+  EXPECT_EQ("JWT_VERIFY_SUCCESS", published.fields().at("status").string_value());
+  EXPECT_EQ(Kid1, published.fields().at("kid").string_value());
+  const ProtobufWkt::Struct& published_claims = published.fields().at("claims").struct_value();
+  EXPECT_EQ(2, published_claims.fields_size());
+  EXPECT_EQ("sub1", published_claims.fields().at("sub").string_value());
+  EXPECT_EQ(2, published_claims.fields().at("groups").list_value().values_size());
+}
+
+TEST_F(ClaimsMetadataFilterTest, Rejected) {
+  TestStreamPtr stream =
+      FilterFixture::stream(token(R"("iss": "iss1", "aud": "aud2", "sub": "sub1")"));
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, stream->decodeHeaders());
+  EXPECT_EQ("401", stream->status_);
+
+  const ProtobufWkt::Struct& published = metadata(*stream);
+  EXPECT_EQ("JWT_VERIFY_FAIL_AUDIENCE_MISMATCH", published.fields().at("status").string_value());
+  EXPECT_EQ(Kid1, published.fields().at("kid").string_value());
+  EXPECT_EQ(0U, published.fields().count("claims"));
+
+  // A token that doesn't parse has no kid either.
+  stream = FilterFixture::stream("not.a.token");
+  stream->decodeHeaders();
+  EXPECT_EQ(1U, metadata(*stream).fields().count("status"));
+  EXPECT_EQ(0U, metadata(*stream).fields().count("kid"));
+}
+
+// Session cookie requests only publish the subject the cookie was issued for.
+TEST_F(ClaimsMetadataFilterTest, SessionCookie) {
+  TestStreamPtr stream = FilterFixture::stream(token(Claims + R"(, "groups": ["a"])"));
+  EXPECT_EQ(FilterHeadersStatus::Continue, stream->decodeHeaders());
+  const std::string cookie = stream->responseCookie();
+  ASSERT_EQ(0U, cookie.find("sft_session="));
+
+  stream = FilterFixture::stream("", cookie);
+  EXPECT_EQ(FilterHeadersStatus::Continue, stream->decodeHeaders());
+  const ProtobufWkt::Struct& published = metadata(*stream);
+  EXPECT_EQ("SESSION_COOKIE_VALID", published.fields().at("status").string_value());
+  EXPECT_EQ(0U, published.fields().count("kid"));
+  const ProtobufWkt::Struct& published_claims = published.fields().at("claims").struct_value();
+  EXPECT_EQ(1, published_claims.fields_size());
+  EXPECT_EQ("sub1", published_claims.fields().at("sub").string_value());
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,105 @@
+#include "../denylist.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+std::vector<uint64_t> jtiHashes(const std::string& prefix, size_t count) {
+  std::vector<uint64_t> hashes;
+  for (size_t i = 0; i < count; i++) {
+    hashes.push_back(Denylist::hash(DenylistKind::JTI, prefix + std::to_string(i)));
+  }
+  return hashes;
+}
+
+} // namespace
+
+TEST(DenylistTest, Empty) {
+  Denylist denylist;
+  const uint64_t hash = Denylist::hash(DenylistKind::JTI, "id1");
+  EXPECT_FALSE(denylist.mayContain(hash));
+  EXPECT_FALSE(denylist.contains(hash));
+  EXPECT_EQ(0, denylist.size());
+}
+
+TEST(DenylistTest, EveryEntryIsFound) {
+  Denylist denylist(jtiHashes("revoked", 1000), 10);
+  EXPECT_EQ(1000, denylist.size());
+  for (uint64_t hash : jtiHashes("revoked", 1000)) {
+    EXPECT_TRUE(denylist.mayContain(hash));
+    EXPECT_TRUE(denylist.contains(hash));
+  }
+}
+
+TEST(DenylistTest, DuplicatesAreDropped) {
+  std::vector<uint64_t> hashes = jtiHashes("revoked", 10);
+  std::vector<uint64_t> twice = hashes;
+  twice.insert(twice.end(), hashes.begin(), hashes.end());
+  Denylist denylist(std::move(twice), 10);
+  EXPECT_EQ(10, denylist.size());
+}
+
+// The Bloom filter may say yes to a value that was never revoked, the exact set never does.
+TEST(DenylistTest, FalsePositivesAreCaughtByTheExactSet) {
+  Denylist denylist(jtiHashes("revoked", 1000), 10);
+  size_t false_positives = 0;
+  for (uint64_t hash : jtiHashes("valid", 100000)) {
+    if (denylist.mayContain(hash)) {
+      false_positives++;
+    }
+    EXPECT_FALSE(denylist.contains(hash));
+  }
+  // ~1% at 10 bits per entry.
+  EXPECT_LT(false_positives, 2000);
+
+  // At a single bit per entry most lookups pass the filter, and all of them still miss the set.
+  Denylist dense(jtiHashes("revoked", 1000), 1);
+  false_positives = 0;
+  for (uint64_t hash : jtiHashes("valid", 1000)) {
+    if (dense.mayContain(hash)) {
+      false_positives++;
+    }
+    EXPECT_FALSE(dense.contains(hash));
+  }
+  EXPECT_GT(false_positives, 0);
+}
+
+TEST(DenylistTest, KindsAreSeparate) {
+  EXPECT_NE(Denylist::hash(DenylistKind::JTI, "id1"), Denylist::hash(DenylistKind::SUB, "id1"));
+
+  DenylistConstSharedPtr denylist = ParseDenylist("jti id1\n", 10);
+  ASSERT_NE(nullptr, denylist);
+  EXPECT_TRUE(denylist->contains(Denylist::hash(DenylistKind::JTI, "id1")));
+  EXPECT_FALSE(denylist->contains(Denylist::hash(DenylistKind::SUB, "id1")));
+}
+
+TEST(DenylistTest, Parse) {
+  DenylistConstSharedPtr denylist =
+      ParseDenylist("# revoked\r\njti id1\r\n\nsub user with spaces\njti id2", 10);
+  ASSERT_NE(nullptr, denylist);
+  EXPECT_EQ(3, denylist->size());
+  EXPECT_TRUE(denylist->contains(Denylist::hash(DenylistKind::JTI, "id1")));
+  EXPECT_TRUE(denylist->contains(Denylist::hash(DenylistKind::JTI, "id2")));
+  EXPECT_TRUE(denylist->contains(Denylist::hash(DenylistKind::SUB, "user with spaces")));
+
+  ASSERT_NE(nullptr, ParseDenylist("", 10));
+  EXPECT_EQ(0, ParseDenylist("", 10)->size());
+}
+
+TEST(DenylistTest, ParseRejectsMalformedLines) {
+  EXPECT_EQ(nullptr, ParseDenylist("jti id1\nkid id2\n", 10));
+  EXPECT_EQ(nullptr, ParseDenylist("jti\n", 10));
+  EXPECT_EQ(nullptr, ParseDenylist("jti \n", 10));
+  EXPECT_EQ(nullptr, ParseDenylist("jtiid1\n", 10));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,173 @@
+#include "../ec_table.h"
+#include "test_key.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+// The P-256 group order, big endian.
+const uint8_t Order[32] = {0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff,
+                           0xff, 0xff, 0xff, 0xff, 0xff, 0xbc, 0xe6, 0xfa, 0xad, 0xa7, 0x17,
+                           0x9e, 0x84, 0xf3, 0xb9, 0xca, 0xc2, 0xfc, 0x63, 0x25, 0x51};
+
+// A test key with its table.
+class TableKey : public TestKey {
+public:
+  // A random key, or the one with the given private scalar.
+  TableKey(const std::string& private_key = "") : TestKey(private_key) {
+    table_ = P256Table::build(reinterpret_cast<const uint8_t*>(compact().x().data()),
+                              reinterpret_cast<const uint8_t*>(compact().y().data()));
+  }
+
+  bool tableVerify(const std::string& digest, const std::string& signature) const {
+    return table_->verify(reinterpret_cast<const uint8_t*>(digest.data()),
+                          reinterpret_cast<const uint8_t*>(signature.data()), signature.size());
+  }
+
+  P256TableConstSharedPtr table_;
+};
+
+class P256TableTest : public testing::Test {
+public:
+  std::string randomBytes(size_t size) {
+    std::string out(size, '\0');
+    for (char& c : out) {
+      c = static_cast<char>(random_());
+    }
+    return out;
+  }
+
+  // Checks the table against EVP for `count` signatures, a valid one and a few corruptions each.
+  void expectAgreement(const TableKey& key, size_t count) {
+    ASSERT_NE(nullptr, key.table_);
+    for (size_t i = 0; i < count; i++) {
+      const std::string digest = randomBytes(32);
+      const std::string signature = key.signDigest(digest);
+      ASSERT_TRUE(key.verifyDigest(digest, signature));
+      EXPECT_TRUE(key.tableVerify(digest, signature));
+
+      std::vector<std::pair<std::string, std::string>> corrupted;
+      std::string bad = signature;
+      bad[i % 32] ^= 0x01; // r
+      corrupted.emplace_back(digest, bad);
+      bad = signature;
+      bad[32 + i % 32] ^= 0x80; // s
+      corrupted.emplace_back(digest, bad);
+      bad = digest;
+      bad[i % 32] ^= 0x10;
+      corrupted.emplace_back(bad, signature);
+      for (const auto& input : corrupted) {
+        EXPECT_EQ(key.verifyDigest(input.first, input.second),
+                  key.tableVerify(input.first, input.second));
+      }
+    }
+  }
+
+  std::mt19937 random_{42};
+};
+
+} // namespace
+
+TEST_F(P256TableTest, MatchesEvp) {
+  for (size_t i = 0; i < 4; i++) {
+    TableKey key;
+    expectAgreement(key, 64);
+  }
+}
+
+// Q = G and Q = -G make the two table walks add equal and opposite points.
+TEST_F(P256TableTest, MatchesEvpGeneratorMultiples) {
+  std::string one(32, '\0');
+  one[31] = 1;
+  std::string minus_one(reinterpret_cast<const char*>(Order), sizeof(Order));
+  minus_one[31]--;
+
+  expectAgreement(TableKey(one), 64);
+  expectAgreement(TableKey(minus_one), 64);
+}
+
+// Digests of zero (u1 = 0) and at or above the order, which are reduced mod n.
+TEST_F(P256TableTest, MatchesEvpEdgeDigests) {
+  TableKey key;
+  const std::string order(reinterpret_cast<const char*>(Order), sizeof(Order));
+  for (const std::string& digest :
+       {std::string(32, '\0'), std::string(32, '\xff'), order, order.substr(0, 31) + '\x52'}) {
+    const std::string signature = key.signDigest(digest);
+    ASSERT_TRUE(key.verifyDigest(digest, signature));
+    EXPECT_TRUE(key.tableVerify(digest, signature));
+  }
+}
+
+// r and s must be in [1, n).
+TEST_F(P256TableTest, RejectsOutOfRangeSignatures) {
+  TableKey key;
+  const std::string digest = randomBytes(32);
+  const std::string signature = key.signDigest(digest);
+  const std::string r = signature.substr(0, 32);
+  const std::string s = signature.substr(32);
+  const std::string zero(32, '\0');
+  const std::string order(reinterpret_cast<const char*>(Order), sizeof(Order));
+
+  for (const std::string& bad : {zero + s, r + zero, order + s, r + order,
+                                 std::string(32, '\xff') + s, r + std::string(32, '\xff')}) {
+    EXPECT_FALSE(key.verifyDigest(digest, bad));
+    EXPECT_FALSE(key.tableVerify(digest, bad));
+  }
+
+  EXPECT_FALSE(key.tableVerify(digest, signature.substr(0, 63)));
+  EXPECT_FALSE(key.tableVerify(digest, signature + '\0'));
+}
+
+TEST_F(P256TableTest, RejectsPointOffCurve) {
+  TableKey key;
+  const std::string x = key.compact().x();
+  std::string y = key.compact().y();
+  y[31] ^= 0x01;
+  EXPECT_EQ(nullptr, P256Table::build(reinterpret_cast<const uint8_t*>(x.data()),
+                                      reinterpret_cast<const uint8_t*>(y.data())));
+}
+
+// verifyBatch() agrees with verify() for a mix of keys, valid and invalid signatures.
+TEST_F(P256TableTest, BatchMatchesVerify) {
+  TableKey key1;
+  TableKey key2;
+  std::vector<P256Table::BatchSignature> batch;
+  std::vector<bool> expected;
+  for (size_t i = 0; i < 32; i++) {
+    const TableKey& key = i % 3 == 0 ? key2 : key1;
+    const std::string digest = randomBytes(32);
+    std::string signature = key.signDigest(digest);
+    if (i % 4 == 1) {
+      signature[40] ^= 0x04;
+    } else if (i % 8 == 2) {
+      signature.replace(0, 32, std::string(32, '\0'));
+    }
+
+    P256Table::BatchSignature entry;
+    entry.table_ = key.table_.get();
+    memcpy(entry.digest_, digest.data(), sizeof(entry.digest_));
+    memcpy(entry.signature_, signature.data(), sizeof(entry.signature_));
+    entry.valid_ = false;
+    batch.push_back(entry);
+    expected.push_back(key.verifyDigest(digest, signature));
+    EXPECT_EQ(expected.back(), key.tableVerify(digest, signature));
+  }
+
+  P256Table::verifyBatch(batch);
+  for (size_t i = 0; i < batch.size(); i++) {
+    EXPECT_EQ(expected[i], batch[i].valid_) << "signature " << i;
+  }
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
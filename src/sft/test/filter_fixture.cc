@@ -0,0 +1,100 @@
+#include "filter_fixture.h"
+
+#include "common/json/json_loader.h"
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+std::string jwk(const std::string& kid, const TestKey& key) {
+  return fmt::format(
+      R"({{"kty": "EC", "crv": "P-256", "alg": "ES256", "kid": "{}", "x": "{}", "y": "{}"}})", kid,
+      Base64UrlEncode(key.compact().x()), Base64UrlEncode(key.compact().y()));
+}
+
+} // namespace
+
+TestStream::TestStream(SFTConfigSharedPtr config, const TestHeaderMapImpl& headers)
+    : filter_(config), headers_(headers) {
+  filter_.setDecoderFilterCallbacks(callbacks_);
+  ON_CALL(callbacks_, continueDecoding()).WillByDefault(testing::Invoke([this]() -> void {
+    continued_ = true;
+    if (on_resume_) {
+      on_resume_();
+    }
+  }));
+  ON_CALL(callbacks_, encodeHeaders_(testing::_, testing::_))
+      .WillByDefault(testing::Invoke([this](HeaderMap& headers, bool) -> void {
+        status_ = headers.Status()->value().c_str();
+      }));
+  ON_CALL(callbacks_.request_info_, setDynamicMetadata(testing::_, testing::_))
+      .WillByDefault(testing::Invoke(
+          [this](const std::string& name, const ProtobufWkt::Struct& metadata) -> void {
+            metadata_[name] = metadata;
+          }));
+}
+
+std::string TestStream::responseCookie() {
+  TestHeaderMapImpl response{{":status", "200"}};
+  filter_.encodeHeaders(response, true);
+  const std::string set_cookie = response.get_("set-cookie");
+  return set_cookie.substr(0, set_cookie.find(';'));
+}
+
+const std::string FilterFixture::Kid1 = "kid1";
+const std::string FilterFixture::Kid2 = "kid2";
+const std::string FilterFixture::Claims =
+    R"("iss": "iss1", "aud": "aud1", "sub": "sub1", "exp": 4102444800)";
+
+FilterFixture::FilterFixture() { tls_.registerThread(dispatcher_, true); }
+
+FilterFixture::~FilterFixture() {
+  config_.reset();
+  tls_.shutdownGlobalThreading();
+  tls_.shutdownThread();
+}
+
+void FilterFixture::makeConfig(const std::string& extra) {
+  Json::ObjectSharedPtr json = Json::Factory::loadFromString(
+      fmt::format(R"({{"iss": "iss1", "aud": ["aud1"], "keys": [{}, {}]{}{}}})", jwk(Kid1, key1_),
+                  jwk(Kid2, key2_), extra.empty() ? "" : ", ", extra));
+  config_ = std::make_shared<SFTConfig>("test", *json,
+                                        std::make_shared<JwksProviderRegistry>(store_), tls_, cm_,
+                                        dispatcher_, store_, random_, log_manager_,
+                                        ProdSystemTimeSource::instance_);
+}
+
+std::string FilterFixture::token(const std::string& claims, bool valid) {
+  return token(Kid1, key1_, claims, valid);
+}
+
+std::string FilterFixture::token(const std::string& kid, const TestKey& key,
+                                 const std::string& claims, bool valid) {
+  const std::string signing_input =
+      Base64UrlEncode(fmt::format(R"({{"alg":"ES256","kid":"{}"}})", kid)) + "." +
+      Base64UrlEncode("{" + claims + "}");
+  std::string signature = key.sign(signing_input);
+  if (!valid) {
+    signature[signature.size() - 1] ^= 0x01;
+  }
+  return signing_input + "." + Base64UrlEncode(signature);
+}
+
+TestStreamPtr FilterFixture::stream(const std::string& jwt, const std::string& cookie) {
+  TestHeaderMapImpl headers{{":method", "GET"}, {":path", "/"}, {":authority", "host"}};
+  if (!jwt.empty()) {
+    headers.addCopy(config_->headerKey, jwt);
+  }
+  if (!cookie.empty()) {
+    headers.addCopy("cookie", cookie);
+  }
+  return TestStreamPtr(new TestStream(config_, headers));
+}
+
+void FilterFixture::runDispatcher() { dispatcher_.run(Event::Dispatcher::RunType::NonBlock); }
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common/event/dispatcher_impl.h"
+#include "common/stats/stats_impl.h"
+#include "common/thread_local/thread_local_impl.h"
+
+#include "test/mocks/access_log/mocks.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "../sft_filter.h"
+#include "test_key.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// A request through its own SftJwtDecoderFilter, recording how verification ended.
+class TestStream {
+public:
+  TestStream(SFTConfigSharedPtr config, const TestHeaderMapImpl& headers);
+
+  FilterHeadersStatus decodeHeaders() { return filter_.decodeHeaders(headers_, true); }
+  // The session cookie issued with the response, as a request sends it back, empty if none was.
+  std::string responseCookie();
+
+  testing::NiceMock<MockStreamDecoderFilterCallbacks> callbacks_;
+  SftJwtDecoderFilter filter_;
+  TestHeaderMapImpl headers_;
+  // Set once the stream is let through.
+  bool continued_{};
+  // The status of the stream's local reply, if it got one.
+  std::string status_;
+  // Dynamic metadata the filter published, by namespace.
+  std::map<std::string, ProtobufWkt::Struct> metadata_;
+  // Called once the stream is let through.
+  std::function<void()> on_resume_;
+};
+
+typedef std::unique_ptr<TestStream> TestStreamPtr;
+
+// Runs requests through the filter in-process, on a real dispatcher. The filter config's policy
+// is issuer "iss1" and audience "aud1", and its static keys are key1_ (kid "kid1") and key2_
+// (kid "kid2").
+class FilterFixture : public testing::Test {
+public:
+  static const std::string Kid1;
+  static const std::string Kid2;
+  // Claims that pass the policy.
+  static const std::string Claims;
+
+  FilterFixture();
+  ~FilterFixture();
+
+  // Builds config_, with the members in `extra` (a JSON object's members) added.
+  void makeConfig(const std::string& extra);
+  // An ES256 token with the members `claims` in its payload, signed with key1_ or with `key` under
+  // `kid`. Its signature is broken unless `valid`.
+  std::string token(const std::string& claims = Claims, bool valid = true);
+  std::string token(const std::string& kid, const TestKey& key, const std::string& claims,
+                    bool valid = true);
+  // A request to "/" carrying `jwt` unless it is empty, and `cookie` unless it is empty.
+  TestStreamPtr stream(const std::string& jwt, const std::string& cookie = "");
+  // Runs whatever is ready on the dispatcher, without waiting.
+  void runDispatcher();
+
+  Event::DispatcherImpl dispatcher_;
+  ThreadLocal::InstanceImpl tls_;
+  Stats::IsolatedStoreImpl store_;
+  testing::NiceMock<Runtime::MockRandomGenerator> random_;
+  testing::NiceMock<Upstream::MockClusterManager> cm_;
+  testing::NiceMock<AccessLog::MockAccessLogManager> log_manager_;
+  const TestKey key1_;
+  const TestKey key2_;
+  SFTConfigSharedPtr config_;
+};
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,180 @@
+#include "../jwks_parser.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const std::string Kid1 = "65289b19-e0c6-4918-8933-7961781adb0d";
+const std::string Kid2 = "eefdf879-c941-4701-bd5d-f357bff7798d";
+
+// The members of a P-256 jwk other than its kid.
+const std::string Key1 = R"("kty": "EC", "crv": "P-256", "alg": "ES256",
+    "x": "NlKjrC2WShZ1_Vge_NnnlI_AvyS4O8-Fe6FjD4ulZ_8",
+    "y": "dyDmVlk98cXnTnggviphJYDmEQNacdCzcAOoLuUWqGY")";
+const std::string Key2 = R"("kty": "EC", "crv": "P-256", "alg": "ES256",
+    "x": "EawrkuYeV-Bjzab97rDIah46eCiYSJJ0lZIWd74OfJ8",
+    "y": "n6QyeaqQ1VvX6YKlMWTGxRvx_qZ0_mv-n2SFjhoa_Dk")";
+
+std::string jwk(const std::string& kid, const std::string& key, const std::string& extra = "") {
+  return "{\"kid\": \"" + kid + "\", " + key + extra + "}";
+}
+
+std::string keys(const std::string& jwks) { return "{\"keys\": [" + jwks + "]}"; }
+
+} // namespace
+
+TEST(JwksParserTest, Parse) {
+  JWKSSharedPtr jwks = ParseJwks(keys(jwk(Kid1, Key1) + ", " + jwk(Kid2, Key2)), false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(2U, jwks->size());
+  EXPECT_NE(nullptr, jwks->get(Kid1));
+  EXPECT_NE(nullptr, jwks->get(Kid2));
+  EXPECT_NE(*jwks->getCompact(Kid1), *jwks->getCompact(Kid2));
+
+  // A lazy key set only decodes them.
+  jwks = ParseJwks(keys(jwk(Kid1, Key1)), true);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_NE(nullptr, jwks->getCompact(Kid1));
+  EXPECT_EQ(nullptr, jwks->get(Kid1));
+
+  jwks = ParseJwks("{\"keys\": []}", false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(0U, jwks->size());
+}
+
+// Objects and arrays inside a jwk are skipped, even when they hold members named like the jwk's.
+TEST(JwksParserTest, NestedMembers) {
+  const CompactECKey expected = *ParseJwks(keys(jwk(Kid1, Key1)), false)->getCompact(Kid1);
+
+  JWKSSharedPtr jwks = ParseJwks(
+      keys(jwk(Kid1, Key1,
+               R"(, "x5c": ["MIIC+DCCAeCgAwIBAgIJ", "MIIDBTCCAe2gAwIBAgIQ"],
+                  "key_ops": ["verify"],
+                  "ext": {"kid": "other", "x": "AAAA", "nested": [{"y": "AAAA"}, [[]]]})")),
+      false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(1U, jwks->size());
+  ASSERT_NE(nullptr, jwks->getCompact(Kid1));
+  EXPECT_EQ(expected, *jwks->getCompact(Kid1));
+  EXPECT_EQ(nullptr, jwks->getCompact("other"));
+
+  // Nested members before the ones read.
+  jwks = ParseJwks(keys(R"({"x5c": ["a", {"kid": "other"}], "kid": ")" + Kid1 + "\", " + Key1 +
+                        "}"),
+                   false);
+  ASSERT_NE(nullptr, jwks);
+  ASSERT_NE(nullptr, jwks->getCompact(Kid1));
+  EXPECT_EQ(expected, *jwks->getCompact(Kid1));
+
+  // Deep nesting costs heap rather than stack.
+  const std::string deep = std::string(100000, '[') + std::string(100000, ']');
+  jwks = ParseJwks(keys(jwk(Kid1, Key1, ", \"ext\": " + deep)), false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(1U, jwks->size());
+}
+
+// A jwk whose kid, x or y isn't a string is skipped, the rest of the key set is still loaded.
+TEST(JwksParserTest, NonStringMembers) {
+  const std::string key1_xy = R"("kty": "EC", "crv": "P-256", "alg": "ES256")";
+  for (const std::string& bad :
+       {std::string(R"({"kid": 5, )") + Key1 + "}",
+        std::string(R"({"kid": [")") + Kid1 + "\"], " + Key1 + "}",
+        std::string(R"({"kid": {"kid": ")") + Kid1 + "\"}, " + Key1 + "}",
+        jwk(Kid1, key1_xy, R"(, "x": 5, "y": "dyDmVlk98cXnTnggviphJYDmEQNacdCzcAOoLuUWqGY")"),
+        jwk(Kid1, key1_xy,
+            R"(, "x": "NlKjrC2WShZ1_Vge_NnnlI_AvyS4O8-Fe6FjD4ulZ_8", "y": {"y": "AAAA"})"),
+        jwk(Kid1, key1_xy, R"(, "x": null, "y": true)")}) {
+    JWKSSharedPtr jwks = ParseJwks(keys(bad + ", " + jwk(Kid2, Key2)), false);
+    ASSERT_NE(nullptr, jwks) << bad;
+    EXPECT_EQ(1U, jwks->size()) << bad;
+    EXPECT_EQ(nullptr, jwks->getCompact(Kid1)) << bad;
+    EXPECT_NE(nullptr, jwks->get(Kid2)) << bad;
+  }
+
+  // Entries of the keys array that aren't objects are skipped too.
+  JWKSSharedPtr jwks = ParseJwks(keys("1, \"a\", null, [" + jwk(Kid1, Key1) + "], " +
+                                      jwk(Kid2, Key2)),
+                                 false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(1U, jwks->size());
+  EXPECT_NE(nullptr, jwks->get(Kid2));
+}
+
+// Only the top level `keys` array holds the key set.
+TEST(JwksParserTest, TopLevelMembers) {
+  JWKSSharedPtr jwks = ParseJwks("{\"other\": [" + jwk(Kid1, Key1) + "], \"keys\": [" +
+                                     jwk(Kid2, Key2) + "], \"more\": {\"keys\": [" +
+                                     jwk(Kid1, Key1) + "]}}",
+                                 false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(1U, jwks->size());
+  EXPECT_NE(nullptr, jwks->get(Kid2));
+
+  // Without one the document isn't a key set, and doesn't replace the current one.
+  EXPECT_EQ(nullptr, ParseJwks("{}", false));
+  EXPECT_EQ(nullptr, ParseJwks("{\"other\": [" + jwk(Kid1, Key1) + "]}", false));
+  EXPECT_EQ(nullptr, ParseJwks("{\"more\": {\"keys\": [" + jwk(Kid1, Key1) + "]}}", false));
+  EXPECT_EQ(nullptr, ParseJwks("{\"keys\": {\"kid\": \"" + Kid1 + "\"}}", false));
+  EXPECT_EQ(nullptr, ParseJwks("{\"keys\": \"" + Kid1 + "\"}", false));
+  EXPECT_EQ(nullptr, ParseJwks("[" + keys(jwk(Kid1, Key1)) + "]", false));
+}
+
+TEST(JwksParserTest, RepeatedKeys) {
+  EXPECT_EQ(nullptr,
+            ParseJwks("{\"keys\": [" + jwk(Kid1, Key1) + "], \"keys\": [" + jwk(Kid2, Key2) + "]}",
+                      false));
+  EXPECT_EQ(nullptr, ParseJwks("{\"keys\": [], \"keys\": []}", false));
+}
+
+// The first key listed under a kid is used, later ones are neither built nor counted against the
+// precomputed table budget.
+TEST(JwksParserTest, DuplicateKids) {
+  JWKSSharedPtr jwks = ParseJwks(keys(jwk(Kid1, Key1) + ", " + jwk(Kid1, Key2)), false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(1U, jwks->size());
+  EXPECT_EQ(*ParseJwks(keys(jwk(Kid1, Key1)), false)->getCompact(Kid1), *jwks->getCompact(Kid1));
+
+  std::string duplicates = jwk(Kid1, Key1);
+  for (size_t i = 0; i < JWKS::MaxPrecomputedKeys; i++) {
+    duplicates += ", " + jwk(Kid1, Key1);
+  }
+  jwks = ParseJwks(keys(duplicates + ", " + jwk(Kid2, Key2)), false);
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(2U, jwks->size());
+  EXPECT_NE(nullptr, jwks->get(Kid1)->table_);
+  EXPECT_NE(nullptr, jwks->get(Kid2)->table_);
+}
+
+TEST(JwksParserTest, Malformed) {
+  const std::string valid = keys(jwk(Kid1, Key1));
+  for (const std::string& body :
+       {std::string(""), std::string("not json"), valid.substr(0, valid.size() - 1),
+        valid.substr(0, valid.size() / 2), valid + " {}", std::string("{\"keys\": [,]}"),
+        std::string("{\"keys\": [{\"kid\": }]}"), std::string("{\"keys\" [{}]}"),
+        std::string("{\"keys\": [{\"kid\": \"\\uZZZZ\"}]}")}) {
+    EXPECT_EQ(nullptr, ParseJwks(body, false)) << body;
+  }
+}
+
+// Keys the previous key set built for the same kid and point are reused.
+TEST(JwksParserTest, ReusesPreviousKeys) {
+  JWKSSharedPtr previous = ParseJwks(keys(jwk(Kid1, Key1) + ", " + jwk(Kid2, Key1)), false);
+  ASSERT_NE(nullptr, previous);
+
+  JWKSSharedPtr jwks =
+      ParseJwks(keys(jwk(Kid1, Key1) + ", " + jwk(Kid2, Key2)), false, previous.get());
+  ASSERT_NE(nullptr, jwks);
+  EXPECT_EQ(previous->get(Kid1), jwks->get(Kid1));
+  // Same kid, rotated key.
+  EXPECT_NE(previous->get(Kid2), jwks->get(Kid2));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,178 @@
+#include "common/buffer/buffer_impl.h"
+#include "common/http/message_impl.h"
+#include "common/json/json_loader.h"
+#include "common/stats/stats_impl.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "../jwks_provider.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+using testing::Invoke;
+using testing::NiceMock;
+using testing::_;
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const std::string Kid = "65289b19-e0c6-4918-8933-7961781adb0d";
+const std::string Jwks = R"({"keys": [{"kty": "EC", "kid": "65289b19-e0c6-4918-8933-7961781adb0d",
+    "crv": "P-256", "alg": "ES256", "x": "NlKjrC2WShZ1_Vge_NnnlI_AvyS4O8-Fe6FjD4ulZ_8",
+    "y": "dyDmVlk98cXnTnggviphJYDmEQNacdCzcAOoLuUWqGY"}]})";
+
+std::string upstreamConfig(const std::string& path, size_t key_cache_size) {
+  return fmt::format(
+      R"({{"jwks_api_cluster": "jwks", "jwks_api_path": "{}", "jwks_key_cache_size": {}}})", path,
+      key_cache_size);
+}
+
+} // namespace
+
+class JwksProviderRegistryTest : public testing::Test {
+public:
+  JwksProviderRegistryTest() : registry_(std::make_shared<JwksProviderRegistry>(store_)) {
+    ON_CALL(dispatcher_, createTimer_(_))
+        .WillByDefault(Invoke(
+            [](Event::TimerCb) -> Event::Timer* { return new NiceMock<Event::MockTimer>(); }));
+    // Parsed key sets come back from the parse thread through the dispatcher, see runPosted().
+    ON_CALL(dispatcher_, post(_)).WillByDefault(Invoke([this](Event::PostCb cb) -> void {
+      std::unique_lock<std::mutex> lock(posted_lock_);
+      posted_.push_back(cb);
+      posted_cv_.notify_one();
+    }));
+  }
+
+  JwksProviderSharedPtr get(const std::string& config) {
+    return registry_->get(*Json::Factory::loadFromString(config), tls_, cm_, dispatcher_, random_);
+  }
+
+  // Answers a provider's fetch with `body`, and publishes the key set once it is parsed.
+  void respond(Http::AsyncClient::Callbacks& callbacks, const std::string& body) {
+    Http::MessagePtr response(new Http::ResponseMessageImpl(
+        Http::HeaderMapPtr{new Http::TestHeaderMapImpl{{":status", "200"}}}));
+    response->body().reset(new Buffer::OwnedImpl(body));
+    callbacks.onSuccess(std::move(response));
+    runPosted();
+  }
+
+  // Runs the next callback posted to the dispatcher, on this thread as if it were the main one.
+  void runPosted() {
+    Event::PostCb cb;
+    {
+      std::unique_lock<std::mutex> lock(posted_lock_);
+      posted_cv_.wait(lock, [this]() -> bool { return !posted_.empty(); });
+      cb = posted_.front();
+      posted_.pop_front();
+    }
+    cb();
+  }
+
+  Json::ObjectSharedPtr state(const JwksProvider& provider) {
+    rapidjson::StringBuffer buffer;
+    AdminWriter writer(buffer);
+    provider.dumpState(writer, 10);
+    return Json::Factory::loadFromString(buffer.GetString());
+  }
+
+  Stats::IsolatedStoreImpl store_;
+  NiceMock<ThreadLocal::MockInstance> tls_;
+  NiceMock<Upstream::MockClusterManager> cm_;
+  NiceMock<Event::MockDispatcher> dispatcher_;
+  NiceMock<Runtime::MockRandomGenerator> random_;
+  JwksProviderRegistrySharedPtr registry_;
+
+  std::mutex posted_lock_;
+  std::condition_variable posted_cv_;
+  std::deque<Event::PostCb> posted_;
+};
+
+// Configs with the same cluster, path and key cache size share one provider, and one fetch.
+TEST_F(JwksProviderRegistryTest, SharedBySource) {
+  EXPECT_CALL(cm_.async_client_, send_(_, _, _)).Times(3);
+  JwksProviderSharedPtr provider = get(upstreamConfig("/jwks", 0));
+  EXPECT_EQ(provider, get(upstreamConfig("/jwks", 0)));
+
+  JwksProviderSharedPtr other_path = get(upstreamConfig("/other", 0));
+  EXPECT_NE(provider, other_path);
+  JwksProviderSharedPtr lazy = get(upstreamConfig("/jwks", 10));
+  EXPECT_NE(provider, lazy);
+  EXPECT_EQ(lazy, get(upstreamConfig("/jwks", 10)));
+}
+
+// Static keys, configured the same way a JWKS lists them, are never shared and never fetched.
+TEST_F(JwksProviderRegistryTest, StaticKeysNotShared) {
+  EXPECT_CALL(cm_.async_client_, send_(_, _, _)).Times(0);
+  JwksProviderSharedPtr provider = get(Jwks);
+  EXPECT_NE(provider, get(Jwks));
+  EXPECT_NE(nullptr, provider->getKey(Kid));
+}
+
+// A replacement for a provider that went away starts with its key set, built keys and refresh
+// schedule instead of fetching.
+TEST_F(JwksProviderRegistryTest, ReplacementStartsFromRetainedState) {
+  Http::AsyncClient::Callbacks* callbacks{};
+  EXPECT_CALL(cm_.async_client_, send_(_, _, _))
+      .WillOnce(Invoke([&callbacks](Http::MessagePtr&, Http::AsyncClient::Callbacks& cb,
+                                    const Optional<std::chrono::milliseconds>&)
+                           -> Http::AsyncClient::Request* {
+        callbacks = &cb;
+        return nullptr;
+      }));
+
+  JwksProviderSharedPtr provider = get(upstreamConfig("/jwks", 0));
+  EXPECT_EQ(nullptr, provider->getKey(Kid));
+  ASSERT_NE(nullptr, callbacks);
+  respond(*callbacks, Jwks);
+  const std::shared_ptr<evp_pkey> key = provider->getKey(Kid);
+  ASSERT_NE(nullptr, key);
+  EXPECT_EQ(1U, store_.counter("scaleft.accessfabric.jwks_fetch_success").value());
+  provider.reset();
+
+  provider = get(upstreamConfig("/jwks", 0));
+  EXPECT_EQ(key, provider->getKey(Kid));
+  EXPECT_EQ(1U, store_.counter("scaleft.accessfabric.jwks_retained_reused").value());
+  Json::ObjectSharedPtr dumped = state(*provider);
+  EXPECT_EQ(1, dumped->getInteger("keys_total"));
+  EXPECT_FALSE(dumped->getBoolean("fetch_in_flight"));
+  EXPECT_LT(0, dumped->getInteger("next_refresh_in_ms"));
+}
+
+// State retained for one key cache size isn't handed to a provider with another.
+TEST_F(JwksProviderRegistryTest, RetainedStateKeyedByCacheSize) {
+  Http::AsyncClient::Callbacks* callbacks{};
+  EXPECT_CALL(cm_.async_client_, send_(_, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&callbacks](Http::MessagePtr&, Http::AsyncClient::Callbacks& cb,
+                                          const Optional<std::chrono::milliseconds>&)
+                                 -> Http::AsyncClient::Request* {
+        callbacks = &cb;
+        return nullptr;
+      }));
+
+  JwksProviderSharedPtr provider = get(upstreamConfig("/jwks", 0));
+  respond(*callbacks, Jwks);
+  provider.reset();
+
+  provider = get(upstreamConfig("/jwks", 10));
+  EXPECT_EQ(nullptr, provider->getKey(Kid));
+  EXPECT_EQ(0U, store_.counter("scaleft.accessfabric.jwks_retained_reused").value());
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
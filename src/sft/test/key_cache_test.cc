@@ -0,0 +1,227 @@
+#include "common/stats/stats_impl.h"
+
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/thread_local/mocks.h"
+
+#include "../jwks_provider.h"
+#include "../key_cache.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using testing::NiceMock;
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+// Keeps the values recorded into each histogram, which the isolated store drops.
+class RecordingStore : public Stats::IsolatedStoreImpl {
+public:
+  void deliverHistogramToSinks(const Stats::Histogram& histogram, uint64_t value) override {
+    values_[histogram.name()].push_back(value);
+  }
+
+  std::map<std::string, std::vector<uint64_t>> values_;
+};
+
+const std::string X1 = "NlKjrC2WShZ1_Vge_NnnlI_AvyS4O8-Fe6FjD4ulZ_8";
+const std::string Y1 = "dyDmVlk98cXnTnggviphJYDmEQNacdCzcAOoLuUWqGY";
+
+CompactECKey decode(const std::string& x, const std::string& y) {
+  CompactECKey compact;
+  EXPECT_TRUE(DecodeECPublicKey("P-256", x, y, compact));
+  return compact;
+}
+
+const CompactECKey Key1 = decode(X1, Y1);
+const CompactECKey Key2 = decode("EawrkuYeV-Bjzab97rDIah46eCiYSJJ0lZIWd74OfJ8",
+                                 "n6QyeaqQ1VvX6YKlMWTGxRvx_qZ0_mv-n2SFjhoa_Dk");
+
+} // namespace
+
+class KeyCacheTest : public testing::Test {
+public:
+  KeyCacheTest()
+      : stats_(JwksProvider::generateKeyCacheStats("scaleft.accessfabric.", store_)),
+        counters_(std::make_shared<KeyCacheCounters>()) {}
+
+  uint64_t counter(const std::string& name) {
+    return store_.counter("scaleft.accessfabric." + name).value();
+  }
+  uint64_t gauge(const std::string& name) {
+    return store_.gauge("scaleft.accessfabric." + name).value();
+  }
+  const std::vector<uint64_t>& buildTimes() {
+    return store_.values_["scaleft.accessfabric.jwks_key_build_us"];
+  }
+
+  RecordingStore store_;
+  KeyCacheStats stats_;
+  KeyCacheCountersSharedPtr counters_;
+};
+
+TEST_F(KeyCacheTest, HitAndMiss) {
+  KeyCache cache(4, stats_, counters_);
+  KeyCacheResult result = KeyCacheResult::NOT_CACHED;
+  std::shared_ptr<evp_pkey> key = cache.get("a", Key1, &result);
+  ASSERT_NE(nullptr, key);
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_EQ(1U, counter("jwks_key_cache_miss"));
+  EXPECT_EQ(1U, counters_->misses_.load());
+  EXPECT_EQ(1U, buildTimes().size());
+
+  EXPECT_EQ(key, cache.get("a", Key1, &result));
+  EXPECT_EQ(KeyCacheResult::HIT, result);
+  EXPECT_EQ(1U, counter("jwks_key_cache_miss"));
+  EXPECT_EQ(1U, buildTimes().size());
+
+  // Hits reach the shared stats in bulk, here on the next miss.
+  EXPECT_EQ(0U, counter("jwks_key_cache_hit"));
+  EXPECT_NE(nullptr, cache.get("b", Key1, &result));
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_EQ(1U, counter("jwks_key_cache_hit"));
+  EXPECT_EQ(1U, counters_->hits_.load());
+  EXPECT_EQ(2U, counter("jwks_key_cache_miss"));
+  EXPECT_EQ(2U, buildTimes().size());
+  EXPECT_EQ(2U, gauge("jwks_key_cache_size"));
+  EXPECT_EQ(2U, counters_->size_.load());
+
+  // Same kid, rotated key.
+  std::shared_ptr<evp_pkey> rotated = cache.get("a", Key2, &result);
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_NE(key, rotated);
+  EXPECT_EQ(rotated, cache.get("a", Key2));
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_EQ(2U, gauge("jwks_key_cache_size"));
+  EXPECT_EQ(0U, counter("jwks_key_cache_evicted"));
+}
+
+TEST_F(KeyCacheTest, HitFlushInterval) {
+  const uint64_t interval = KeyCache::HitFlushInterval;
+  KeyCache cache(4, stats_, counters_);
+  cache.get("a", Key1);
+  for (uint64_t i = 0; i < interval - 1; i++) {
+    cache.get("a", Key1);
+  }
+  EXPECT_EQ(0U, counter("jwks_key_cache_hit"));
+  cache.get("a", Key1);
+  EXPECT_EQ(interval, counter("jwks_key_cache_hit"));
+}
+
+// The least recently used key goes first, and a hit counts as a use.
+TEST_F(KeyCacheTest, LruEviction) {
+  KeyCache cache(2, stats_, counters_);
+  std::shared_ptr<evp_pkey> a = cache.get("a", Key1);
+  std::shared_ptr<evp_pkey> b = cache.get("b", Key2);
+  EXPECT_EQ(a, cache.get("a", Key1));
+
+  KeyCacheResult result = KeyCacheResult::NOT_CACHED;
+  cache.get("c", Key1);
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_EQ(1U, counter("jwks_key_cache_evicted"));
+  EXPECT_EQ(2U, gauge("jwks_key_cache_size"));
+  EXPECT_EQ(a, cache.get("a", Key1, &result));
+  EXPECT_EQ(KeyCacheResult::HIT, result);
+  EXPECT_NE(b, cache.get("b", Key2, &result));
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_EQ(2U, counter("jwks_key_cache_evicted"));
+
+  // "c" was evicted to make room for "b".
+  cache.get("c", Key1, &result);
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_EQ(2U, counters_->size_.load());
+}
+
+TEST_F(KeyCacheTest, BuildFailed) {
+  KeyCache cache(2, stats_, counters_);
+  CompactECKey bad = Key1;
+  bad.point_[0] ^= 1;
+  KeyCacheResult result = KeyCacheResult::NOT_CACHED;
+  EXPECT_EQ(nullptr, cache.get("a", bad, &result));
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_EQ(1U, counter("jwks_key_build_failed"));
+  EXPECT_EQ(1U, buildTimes().size());
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_EQ(0U, gauge("jwks_key_cache_size"));
+}
+
+// Priming builds ahead of the first lookup without counting a miss, and never evicts.
+TEST_F(KeyCacheTest, Prime) {
+  KeyWorkingSetSharedPtr working_set = std::make_shared<KeyWorkingSet>(2);
+  KeyCache cache(2, stats_, counters_, working_set);
+  cache.prime("a", Key1);
+  cache.prime("b", Key2);
+  cache.prime("c", Key1);
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_EQ(0U, counter("jwks_key_cache_miss"));
+  EXPECT_EQ(0U, counter("jwks_key_cache_evicted"));
+  EXPECT_EQ(2U, buildTimes().size());
+  EXPECT_EQ(0U, counters_->build_us_.load());
+  EXPECT_EQ(std::vector<std::string>({"b", "a"}), working_set->kids());
+
+  KeyCacheResult result = KeyCacheResult::NOT_CACHED;
+  cache.get("a", Key1, &result);
+  EXPECT_EQ(KeyCacheResult::HIT, result);
+  cache.get("c", Key1, &result);
+  EXPECT_EQ(KeyCacheResult::MISS, result);
+  EXPECT_EQ(std::vector<std::string>({"c", "b"}), working_set->kids());
+}
+
+// The cache's keys and pending hits leave the shared stats with it.
+TEST_F(KeyCacheTest, Destroyed) {
+  {
+    KeyCache cache(2, stats_, counters_);
+    cache.get("a", Key1);
+    cache.get("a", Key1);
+    cache.get("b", Key1);
+    cache.get("b", Key1);
+    EXPECT_EQ(2U, gauge("jwks_key_cache_size"));
+    EXPECT_EQ(1U, counter("jwks_key_cache_hit"));
+  }
+  EXPECT_EQ(0U, gauge("jwks_key_cache_size"));
+  EXPECT_EQ(0U, counters_->size_.load());
+  EXPECT_EQ(2U, counter("jwks_key_cache_hit"));
+}
+
+// With a jwks_key_cache_size the provider's key set is only decoded, and each worker builds keys
+// into its own cache on first use. Without one every key is built up front.
+TEST(KeyCacheProviderTest, LazyKeySet) {
+  RecordingStore store;
+  NiceMock<ThreadLocal::MockInstance> tls;
+  NiceMock<Event::MockDispatcher> dispatcher;
+
+  for (const bool lazy : {true, false}) {
+    JWKSSharedPtr jwks = std::make_shared<JWKS>(lazy);
+    ASSERT_TRUE(jwks->add("a", "ES256", "P-256", X1, Y1));
+    JwksProviderSharedPtr provider =
+        std::make_shared<JwksProvider>(jwks, lazy ? 2 : 0, tls, dispatcher, store);
+    EXPECT_EQ(lazy, provider->jwks().lazy());
+
+    KeyCacheResult result = KeyCacheResult::NOT_CACHED;
+    std::shared_ptr<evp_pkey> key = provider->getKey("a", &result);
+    ASSERT_NE(nullptr, key);
+    EXPECT_EQ(lazy ? KeyCacheResult::MISS : KeyCacheResult::NOT_CACHED, result);
+    EXPECT_EQ(key, provider->getKey("a", &result));
+    EXPECT_EQ(lazy ? KeyCacheResult::HIT : KeyCacheResult::NOT_CACHED, result);
+
+    result = KeyCacheResult::NOT_CACHED;
+    EXPECT_EQ(nullptr, provider->getKey("b", &result));
+    EXPECT_EQ(KeyCacheResult::NOT_CACHED, result);
+  }
+
+  // Only the lazy provider built a key on a lookup.
+  EXPECT_EQ(1U, store.counter("scaleft.accessfabric.jwks_key_cache_miss").value());
+  EXPECT_EQ(1U, store.values_["scaleft.accessfabric.jwks_key_build_us"].size());
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
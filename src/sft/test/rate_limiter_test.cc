@@ -0,0 +1,123 @@
+#include "../rate_limiter.h"
+#include "filter_fixture.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+TEST(RateLimitTableTest, Burst) {
+  RateLimitTable table(16, 10, 3);
+  bool evicted;
+  EXPECT_TRUE(table.consume(42, 0, evicted));
+  EXPECT_FALSE(evicted);
+  EXPECT_TRUE(table.consume(42, 0, evicted));
+  EXPECT_TRUE(table.consume(42, 0, evicted));
+  EXPECT_FALSE(table.consume(42, 0, evicted));
+
+  // Other keys have their own bucket.
+  EXPECT_TRUE(table.consume(43, 0, evicted));
+}
+
+TEST(RateLimitTableTest, Refill) {
+  RateLimitTable table(16, 10, 3);
+  bool evicted;
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(table.consume(42, 0, evicted));
+  }
+
+  // A token every 100ms, kept across partial refills.
+  EXPECT_FALSE(table.consume(42, 50, evicted));
+  EXPECT_TRUE(table.consume(42, 100, evicted));
+  EXPECT_FALSE(table.consume(42, 100, evicted));
+  EXPECT_FALSE(table.consume(42, 199, evicted));
+  EXPECT_TRUE(table.consume(42, 200, evicted));
+
+  // Up to the burst.
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(table.consume(42, 60000, evicted));
+  }
+  EXPECT_FALSE(table.consume(42, 60000, evicted));
+  EXPECT_FALSE(evicted);
+}
+
+TEST(RateLimitTableTest, RefillAcrossWrap) {
+  RateLimitTable table(16, 10, 1);
+  bool evicted;
+  const uint32_t start = UINT32_MAX - 50;
+  EXPECT_TRUE(table.consume(42, start, evicted));
+  EXPECT_FALSE(table.consume(42, start, evicted));
+  EXPECT_TRUE(table.consume(42, start + 100, evicted));
+}
+
+TEST(RateLimitTableTest, Capacity) {
+  EXPECT_EQ(static_cast<size_t>(RateLimitTable::ProbeWindow), RateLimitTable(1, 1, 1).capacity());
+  EXPECT_EQ(1024U, RateLimitTable(1000, 1, 1).capacity());
+  EXPECT_EQ(1024U, RateLimitTable(1024, 1, 1).capacity());
+}
+
+TEST(RateLimitTableTest, EvictsLeastRecentlyUsed) {
+  // A single probe window covers the whole table. Buckets hold one token and barely refill, so a
+  // key that still has its bucket is refused and a new one is allowed.
+  RateLimitTable table(RateLimitTable::ProbeWindow, 1, 1);
+  bool evicted;
+  for (uint32_t key = 1; key <= RateLimitTable::ProbeWindow; key++) {
+    EXPECT_TRUE(table.consume(key, key, evicted));
+    EXPECT_FALSE(evicted);
+  }
+
+  // Full, key 1 was used longest ago.
+  const uint32_t extra = RateLimitTable::ProbeWindow + 1;
+  EXPECT_TRUE(table.consume(extra, 20, evicted));
+  EXPECT_TRUE(evicted);
+  EXPECT_FALSE(table.consume(extra, 20, evicted));
+  EXPECT_FALSE(evicted);
+
+  // Key 2 kept its bucket, key 1 starts over and evicts key 3.
+  EXPECT_FALSE(table.consume(2, 21, evicted));
+  EXPECT_FALSE(evicted);
+  EXPECT_TRUE(table.consume(1, 22, evicted));
+  EXPECT_TRUE(evicted);
+  EXPECT_TRUE(table.consume(3, 23, evicted));
+  EXPECT_TRUE(evicted);
+}
+
+// The filter keys requests on the configured claim, read as the token is parsed.
+class RateLimiterFilterTest : public FilterFixture {
+public:
+  // The status of a request with a token carrying `claims`, "200" if it is let through.
+  std::string send(const std::string& claims) {
+    TestStreamPtr stream = FilterFixture::stream(token(claims));
+    return stream->decodeHeaders() == FilterHeadersStatus::Continue ? "200" : stream->status_;
+  }
+};
+
+TEST_F(RateLimiterFilterTest, Claim) {
+  makeConfig(R"("rate_limit_per_s": 1, "rate_limit_burst": 1, "rate_limit_claim": "tenant")");
+  EXPECT_EQ("200", send(Claims + R"(, "tenant": "t1")"));
+  EXPECT_EQ("429", send(Claims + R"(, "tenant": "t1", "jti": "id2")"));
+  EXPECT_EQ("200", send(Claims + R"(, "tenant": "t2")"));
+
+  // One that isn't a string leaves the request unlimited, one that appears twice is ambiguous.
+  EXPECT_EQ("200", send(Claims + R"(, "tenant": ["t1"])"));
+  EXPECT_EQ("200", send(Claims + R"(, "tenant": {"id": "t1"})"));
+  EXPECT_EQ("401", send(Claims + R"(, "tenant": "t3", "tenant": "t1")"));
+  EXPECT_EQ(1U, config_->verifyCount(VerifyStatus::JWT_VERIFY_FAIL_MALFORMED));
+}
+
+// The default claim is a registered one, read once for both.
+TEST_F(RateLimiterFilterTest, RegisteredClaim) {
+  makeConfig(R"("rate_limit_per_s": 1, "rate_limit_burst": 1)");
+  EXPECT_EQ("200", send(Claims));
+  EXPECT_EQ("429", send(Claims + R"(, "jti": "id2")"));
+  EXPECT_EQ("200", send(R"("iss": "iss1", "aud": "aud1", "sub": "sub2")"));
+  EXPECT_EQ("401", send(Claims + R"(, "sub": "sub2")"));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
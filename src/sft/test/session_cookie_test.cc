@@ -0,0 +1,151 @@
+#include "common/common/base64.h"
+#include "envoy/common/exception.h"
+
+#include "test/test_common/utility.h"
+
+#include "../session_cookie.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const std::string Secret = "0123456789abcdef0123456789abcdef";
+const std::string Token = "eyJhbGciOiJFUzI1NiJ9.eyJzdWIiOiJzdWIxIn0.c2lnMQ";
+const std::string OtherToken = "eyJhbGciOiJFUzI1NiJ9.eyJzdWIiOiJzdWIxIn0.c2lnMg";
+const LowerCaseString JwtHeader("authenticated-user-jwt");
+const int64_t Now = 1510989561;
+const uint64_t Scope = 0x1234567890abcdef;
+
+// The `name=value` part of a Set-Cookie value.
+std::string cookiePair(const std::string& set_cookie) {
+  return set_cookie.substr(0, set_cookie.find(';'));
+}
+
+std::string replace(std::string value, const std::string& from, const std::string& to) {
+  const size_t pos = value.find(from);
+  EXPECT_NE(std::string::npos, pos);
+  return value.replace(pos, from.size(), to);
+}
+
+} // namespace
+
+class SessionCookieTest : public testing::Test {
+public:
+  SessionCookieTest() : cookie_("sft_session", Secret, std::chrono::seconds(300)) {}
+
+  // The Set-Cookie value for `Token` issued at `Now`.
+  std::string issue(const SessionCookie::Session& session, int64_t token_exp = 0) {
+    return cookie_.issue(Token, session, Scope, token_exp, Now);
+  }
+
+  bool validate(const std::string& cookie_header, int64_t now, SessionCookie::Session& session,
+                const std::string& jwt = "") {
+    TestHeaderMapImpl headers{{"cookie", cookie_header}};
+    if (!jwt.empty()) {
+      headers.addCopy(JwtHeader, jwt);
+    }
+    return cookie_.validate(headers, headers.get(JwtHeader), Scope, now, session);
+  }
+
+  SessionCookie cookie_;
+};
+
+TEST_F(SessionCookieTest, RoundTrip) {
+  const std::string set_cookie = issue({"sub1", "id1", "key1"});
+  EXPECT_EQ(0U, set_cookie.find("sft_session="));
+  EXPECT_NE(std::string::npos, set_cookie.find("; Max-Age=300;"));
+  EXPECT_NE(std::string::npos, set_cookie.find("; Secure; HttpOnly"));
+
+  SessionCookie::Session session;
+  EXPECT_TRUE(validate("a=b; " + cookiePair(set_cookie) + "; c=d", Now + 1, session));
+  EXPECT_EQ("sub1", session.sub_);
+  EXPECT_EQ("id1", session.jti_);
+  EXPECT_EQ("key1", session.rate_limit_key_);
+}
+
+TEST_F(SessionCookieTest, WithoutJti) {
+  SessionCookie::Session session;
+  EXPECT_TRUE(validate(cookiePair(issue({"sub1", "", ""})), Now, session));
+  EXPECT_EQ("sub1", session.sub_);
+  EXPECT_EQ("", session.jti_);
+  EXPECT_EQ("", session.rate_limit_key_);
+}
+
+TEST_F(SessionCookieTest, Missing) {
+  SessionCookie::Session session;
+  EXPECT_FALSE(validate("", Now, session));
+  EXPECT_FALSE(validate("other=1", Now, session));
+  // A cookie whose name starts with ours isn't ours.
+  const std::string pair = cookiePair(issue({"sub1", "id1", "key1"}));
+  EXPECT_FALSE(validate("sft_session_old" + pair.substr(pair.find('=')), Now, session));
+}
+
+TEST_F(SessionCookieTest, Tampered) {
+  const std::string pair = cookiePair(issue({"sub1", "id1", "key1"}));
+  SessionCookie::Session session;
+  ASSERT_TRUE(validate(pair, Now, session));
+
+  // Another subject, jti or rate limit key, a later expiry, or a truncated or altered MAC.
+  EXPECT_FALSE(validate(replace(pair, Base64::encode("sub1", 4), Base64::encode("sub2", 4)), Now,
+                        session));
+  EXPECT_FALSE(
+      validate(replace(pair, Base64::encode("id1", 3), Base64::encode("id2", 3)), Now, session));
+  EXPECT_FALSE(
+      validate(replace(pair, Base64::encode("key1", 4), Base64::encode("key2", 4)), Now, session));
+  EXPECT_FALSE(validate(replace(pair, std::to_string(Now + 300), std::to_string(Now + 3000)),
+                        Now, session));
+  EXPECT_FALSE(validate(pair.substr(0, pair.size() - 1), Now, session));
+  std::string mac = pair;
+  mac[pair.rfind('.') + 1] = mac[pair.rfind('.') + 1] == 'A' ? 'B' : 'A';
+  EXPECT_FALSE(validate(mac, Now, session));
+
+  // Issued with another secret.
+  SessionCookie other("sft_session", "fedcba9876543210fedcba9876543210",
+                      std::chrono::seconds(300));
+  const std::string other_pair =
+      cookiePair(other.issue(Token, {"sub1", "id1", "key1"}, Scope, 0, Now));
+  EXPECT_FALSE(validate(other_pair, Now, session));
+}
+
+TEST_F(SessionCookieTest, Expiry) {
+  const std::string pair = cookiePair(issue({"sub1", "id1", "key1"}));
+  SessionCookie::Session session;
+  EXPECT_TRUE(validate(pair, Now + 299, session));
+  EXPECT_FALSE(validate(pair, Now + 300, session));
+
+  // Capped at the token's own expiry.
+  const std::string set_cookie = issue({"sub1", "id1", "key1"}, Now + 10);
+  EXPECT_NE(std::string::npos, set_cookie.find("; Max-Age=10;"));
+  EXPECT_TRUE(validate(cookiePair(set_cookie), Now + 9, session));
+  EXPECT_FALSE(validate(cookiePair(set_cookie), Now + 10, session));
+}
+
+TEST_F(SessionCookieTest, TokenMismatch) {
+  const std::string pair = cookiePair(issue({"sub1", "id1", "key1"}));
+  SessionCookie::Session session;
+  EXPECT_TRUE(validate(pair, Now, session, Token));
+  EXPECT_FALSE(validate(pair, Now, session, OtherToken));
+}
+
+TEST_F(SessionCookieTest, ScopeMismatch) {
+  TestHeaderMapImpl headers{{"cookie", cookiePair(issue({"sub1", "id1", "key1"}))}};
+  SessionCookie::Session session;
+  EXPECT_TRUE(cookie_.validate(headers, nullptr, Scope, Now, session));
+  EXPECT_FALSE(cookie_.validate(headers, nullptr, Scope + 1, Now, session));
+}
+
+TEST(SessionCookieConfigTest, Invalid) {
+  EXPECT_THROW(SessionCookie("sft_session", "too short", std::chrono::seconds(300)),
+               EnvoyException);
+  EXPECT_THROW(SessionCookie("sft_session", Secret, std::chrono::seconds(0)), EnvoyException);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
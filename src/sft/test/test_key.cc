@@ -0,0 +1,101 @@
+#include "test_key.h"
+
+#include "common/common/assert.h"
+#include "common/common/base64.h"
+
+#include "openssl/bn.h"
+#include "openssl/ecdsa.h"
+#include "openssl/obj_mac.h"
+#include "openssl/sha.h"
+
+#include <algorithm>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const size_t FieldSize = 32;
+
+std::string bnToPadded(const BIGNUM* bn) {
+  std::string out(FieldSize, '\0');
+  RELEASE_ASSERT(BN_bn2bin_padded(reinterpret_cast<uint8_t*>(&out[0]), out.size(), bn) == 1);
+  return out;
+}
+
+BIGNUM* paddedToBn(const std::string& bytes) {
+  return BN_bin2bn(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), nullptr);
+}
+
+} // namespace
+
+std::string Base64UrlEncode(const std::string& input) {
+  std::string output = Base64::encode(input.data(), input.size());
+  output.erase(std::remove(output.begin(), output.end(), '='), output.end());
+  std::replace(output.begin(), output.end(), '+', '-');
+  std::replace(output.begin(), output.end(), '/', '_');
+  return output;
+}
+
+TestKey::TestKey(const std::string& private_key)
+    : key_(EC_KEY_new_by_curve_name(NID_X9_62_prime256v1)) {
+  RELEASE_ASSERT(key_);
+  const EC_GROUP* group = EC_KEY_get0_group(key_);
+  if (private_key.empty()) {
+    RELEASE_ASSERT(EC_KEY_generate_key(key_) == 1);
+  } else {
+    BIGNUM* d = paddedToBn(private_key);
+    EC_POINT* q = EC_POINT_new(group);
+    RELEASE_ASSERT(EC_POINT_mul(group, q, d, nullptr, nullptr, nullptr) == 1);
+    RELEASE_ASSERT(EC_KEY_set_private_key(key_, d) == 1);
+    RELEASE_ASSERT(EC_KEY_set_public_key(key_, q) == 1);
+    EC_POINT_free(q);
+    BN_free(d);
+  }
+
+  BIGNUM* x = BN_new();
+  BIGNUM* y = BN_new();
+  RELEASE_ASSERT(EC_POINT_get_affine_coordinates_GFp(group, EC_KEY_get0_public_key(key_), x, y,
+                                                     nullptr) == 1);
+  compact_.nid_ = NID_X9_62_prime256v1;
+  compact_.point_ = bnToPadded(x) + bnToPadded(y);
+  BN_free(x);
+  BN_free(y);
+}
+
+TestKey::~TestKey() { EC_KEY_free(key_); }
+
+std::string TestKey::signDigest(const std::string& digest) const {
+  ECDSA_SIG* sig =
+      ECDSA_do_sign(reinterpret_cast<const uint8_t*>(digest.data()), digest.size(), key_);
+  RELEASE_ASSERT(sig);
+  const BIGNUM* r;
+  const BIGNUM* s;
+  ECDSA_SIG_get0(sig, &r, &s);
+  const std::string raw = bnToPadded(r) + bnToPadded(s);
+  ECDSA_SIG_free(sig);
+  return raw;
+}
+
+std::string TestKey::sign(const std::string& signing_input) const {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const uint8_t*>(signing_input.data()), signing_input.size(), digest);
+  return signDigest(std::string(reinterpret_cast<const char*>(digest), sizeof(digest)));
+}
+
+bool TestKey::verifyDigest(const std::string& digest, const std::string& signature) const {
+  RELEASE_ASSERT(signature.size() == 2 * FieldSize);
+  ECDSA_SIG* sig = ECDSA_SIG_new();
+  ECDSA_SIG_set0(sig, paddedToBn(signature.substr(0, FieldSize)),
+                 paddedToBn(signature.substr(FieldSize)));
+  const bool valid =
+      ECDSA_do_verify(reinterpret_cast<const uint8_t*>(digest.data()), digest.size(), sig, key_) ==
+      1;
+  ECDSA_SIG_free(sig);
+  return valid;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "openssl/ec.h"
+
+#include "../jwt.h"
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Unpadded base64url, as JWTs and jwks carry binary values.
+std::string Base64UrlEncode(const std::string& input);
+
+// A generated P-256 key, for the tests, benchmarks and tools that mint their own ES256 tokens.
+class TestKey {
+public:
+  // A random key, or the one with the given big endian private scalar.
+  TestKey(const std::string& private_key = "");
+  ~TestKey();
+  TestKey(const TestKey&) = delete;
+  TestKey& operator=(const TestKey&) = delete;
+
+  // The public point, as a key set holds it.
+  const CompactECKey& compact() const { return compact_; }
+
+  // r || s over a digest the caller computed.
+  std::string signDigest(const std::string& digest) const;
+  // The ES256 signature of `signing_input`, r || s.
+  std::string sign(const std::string& signing_input) const;
+  // EVP's answer for an r || s signature over `digest`.
+  bool verifyDigest(const std::string& digest, const std::string& signature) const;
+
+private:
+  EC_KEY* key_;
+  CompactECKey compact_;
+};
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
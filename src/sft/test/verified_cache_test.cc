@@ -0,0 +1,176 @@
+#include "common/common/utility.h"
+#include "common/json/json_loader.h"
+
+#include "../jwt.h"
+#include "../verified_cache.h"
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+const std::string Token = "eyJhbGciOiJFUzI1NiJ9.eyJzdWIiOiJzdWIxIn0.c2lnMQ";
+const int64_t Now = 1510989561;
+
+// Two keys published under the same kid, before and after a rotation.
+std::shared_ptr<evp_pkey> oldKey() {
+  return ParseECPublicKey("P-256", "NlKjrC2WShZ1_Vge_NnnlI_AvyS4O8-Fe6FjD4ulZ_8",
+                          "dyDmVlk98cXnTnggviphJYDmEQNacdCzcAOoLuUWqGY");
+}
+
+std::shared_ptr<evp_pkey> newKey() {
+  return ParseECPublicKey("P-256", "EawrkuYeV-Bjzab97rDIah46eCiYSJJ0lZIWd74OfJ8",
+                          "n6QyeaqQ1VvX6YKlMWTGxRvx_qZ0_mv-n2SFjhoa_Dk");
+}
+
+} // namespace
+
+class VerifiedCacheTest : public testing::Test {
+public:
+  VerifiedCacheTest() : name_(fmt::format("/sft_verified_cache_test_{}", getpid())) {}
+  ~VerifiedCacheTest() { ::shm_unlink(name_.c_str()); }
+
+  std::unique_ptr<VerifiedCache> makeCache(size_t size = 64) {
+    Json::ObjectSharedPtr config = Json::Factory::loadFromString(fmt::format(
+        R"({{"verified_cache_name": "{}", "verified_cache_size": {}}})", name_, size));
+    return std::unique_ptr<VerifiedCache>(new VerifiedCache(*config));
+  }
+
+  const std::string name_;
+};
+
+TEST_F(VerifiedCacheTest, Hit) {
+  std::unique_ptr<VerifiedCache> cache = makeCache();
+  const VerifiedCache::Key key =
+      VerifiedCache::key(Token.data(), Token.size(), oldKey()->fingerprint_);
+
+  bool valid = false;
+  EXPECT_FALSE(cache->lookup(key, Now, valid));
+  cache->insert(key, 0, Now, true);
+  EXPECT_TRUE(cache->lookup(key, Now, valid));
+  EXPECT_TRUE(valid);
+}
+
+// The same kid with a rotated key misses, and so does its verdict once the key rotates back.
+TEST_F(VerifiedCacheTest, KeyRotationMisses) {
+  std::unique_ptr<VerifiedCache> cache = makeCache();
+  const uint64_t old_fingerprint = oldKey()->fingerprint_;
+  const uint64_t new_fingerprint = newKey()->fingerprint_;
+  ASSERT_NE(old_fingerprint, new_fingerprint);
+  // Fingerprints only depend on the key, not on the object that holds it.
+  EXPECT_EQ(old_fingerprint, oldKey()->fingerprint_);
+
+  const VerifiedCache::Key old_key =
+      VerifiedCache::key(Token.data(), Token.size(), old_fingerprint);
+  const VerifiedCache::Key new_key =
+      VerifiedCache::key(Token.data(), Token.size(), new_fingerprint);
+  cache->insert(old_key, 0, Now, true);
+
+  bool valid = false;
+  EXPECT_FALSE(cache->lookup(new_key, Now, valid));
+  cache->insert(new_key, 0, Now, false);
+  EXPECT_TRUE(cache->lookup(new_key, Now, valid));
+  EXPECT_FALSE(valid);
+  EXPECT_TRUE(cache->lookup(old_key, Now, valid));
+  EXPECT_TRUE(valid);
+}
+
+TEST_F(VerifiedCacheTest, Expiry) {
+  std::unique_ptr<VerifiedCache> cache = makeCache();
+  const VerifiedCache::Key key =
+      VerifiedCache::key(Token.data(), Token.size(), oldKey()->fingerprint_);
+
+  // The token's exp wins over the max age (300s by default), and the other way around.
+  bool valid = false;
+  cache->insert(key, Now + 10, Now, true);
+  EXPECT_TRUE(cache->lookup(key, Now + 10, valid));
+  EXPECT_FALSE(cache->lookup(key, Now + 11, valid));
+
+  cache->insert(key, Now + 3600, Now, true);
+  EXPECT_TRUE(cache->lookup(key, Now + 300, valid));
+  EXPECT_FALSE(cache->lookup(key, Now + 301, valid));
+
+  // Already expired tokens aren't recorded.
+  cache->insert(key, Now - 1, Now + 400, true);
+  EXPECT_FALSE(cache->lookup(key, Now + 400, valid));
+}
+
+// A second mapping of the region, as the new process in a hot restart has, sees the verdicts.
+TEST_F(VerifiedCacheTest, SharedAcrossMappings) {
+  std::unique_ptr<VerifiedCache> cache = makeCache();
+  std::unique_ptr<VerifiedCache> other = makeCache();
+  const VerifiedCache::Key key =
+      VerifiedCache::key(Token.data(), Token.size(), oldKey()->fingerprint_);
+
+  cache->insert(key, 0, Now, true);
+  bool valid = false;
+  EXPECT_TRUE(other->lookup(key, Now, valid));
+  EXPECT_TRUE(valid);
+}
+
+// Processes starting at once all end up on the region the first one created, none of them
+// replaces it while it is being set up.
+TEST_F(VerifiedCacheTest, ConcurrentSetUp) {
+  std::vector<std::unique_ptr<VerifiedCache>> caches(8);
+  std::vector<std::thread> threads;
+  for (std::unique_ptr<VerifiedCache>& cache : caches) {
+    threads.emplace_back([this, &cache]() -> void { cache = makeCache(); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  const VerifiedCache::Key key =
+      VerifiedCache::key(Token.data(), Token.size(), oldKey()->fingerprint_);
+  caches[0]->insert(key, 0, Now, true);
+  for (const std::unique_ptr<VerifiedCache>& cache : caches) {
+    bool valid = false;
+    EXPECT_TRUE(cache->lookup(key, Now, valid));
+    EXPECT_TRUE(valid);
+  }
+}
+
+// A region of another size is replaced, its users keep their own mapping.
+TEST_F(VerifiedCacheTest, OtherSize) {
+  std::unique_ptr<VerifiedCache> cache = makeCache();
+  std::unique_ptr<VerifiedCache> larger = makeCache(128);
+  EXPECT_EQ(128U, larger->capacity());
+  const VerifiedCache::Key key =
+      VerifiedCache::key(Token.data(), Token.size(), oldKey()->fingerprint_);
+
+  cache->insert(key, 0, Now, true);
+  bool valid = false;
+  EXPECT_TRUE(cache->lookup(key, Now, valid));
+  EXPECT_FALSE(larger->lookup(key, Now, valid));
+}
+
+// A region that never got sized, as a process dying while creating it leaves, is replaced once
+// it has had time to be set up.
+TEST_F(VerifiedCacheTest, AbandonedRegion) {
+  const int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  ASSERT_LE(0, fd);
+  ::close(fd);
+
+  std::unique_ptr<VerifiedCache> cache = makeCache();
+  const VerifiedCache::Key key =
+      VerifiedCache::key(Token.data(), Token.size(), oldKey()->fingerprint_);
+  cache->insert(key, 0, Now, true);
+  bool valid = false;
+  EXPECT_TRUE(makeCache()->lookup(key, Now, valid));
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,337 @@
+// Verifies a large batch of tokens against a JWKS snapshot, outside of Envoy, for audits, incident
+// response and checking a key set before a rotation.
+//
+//   sft_bulk_verify --jwks <jwks file> --tokens <token file> [--threads N] [--iss <issuer>]
+//                   [--aud <audience>] [--now <unix seconds>]
+//
+// The token file holds one token per line and is memory-mapped. Every token is parsed and its
+// signature checked against the key named by its kid, then its exp/nbf against --now (default: the
+// current time), and its iss and aud if given. Per-status counts and throughput are printed at the
+// end, which also makes this a scaling benchmark for the crypto path (see --threads). Exits with 2
+// if any token failed.
+//
+// Work is split into line-aligned chunks. Each thread starts with an equal contiguous range of
+// chunks and takes from its front; a thread that runs out steals from the back of the busiest
+// looking range, so a slow stretch of the file (large tokens, expensive curves) doesn't leave the
+// other threads idle.
+
+#include "common/common/utility.h"
+#include "common/filesystem/filesystem_impl.h"
+
+#include "../jwks_parser.h"
+#include "../jwt.h"
+#include "../verify_status.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+namespace {
+
+// Target chunk size, small enough to balance well and large enough that taking a chunk is rare.
+const size_t ChunkSize = 256 * 1024;
+
+// A read-only mapping of a whole file.
+class MappedFile {
+public:
+  MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw EnvoyException(fmt::format("unable to open '{}'", path));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw EnvoyException(fmt::format("unable to stat '{}'", path));
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        throw EnvoyException(fmt::format("unable to map '{}'", path));
+      }
+      madvise(data, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char* data_{};
+  size_t size_{};
+};
+
+// A range of chunk indexes [begin, end) packed into one word, so that the owner taking from the
+// front and thieves taking from the back agree through a single compare-and-swap.
+class ChunkRange {
+public:
+  void reset(uint32_t begin, uint32_t end) { range_.store(pack(begin, end)); }
+
+  // Owner: takes the first chunk.
+  bool takeFront(uint32_t& chunk) {
+    uint64_t range = range_.load();
+    while (begin(range) < end(range)) {
+      if (range_.compare_exchange_weak(range, pack(begin(range) + 1, end(range)))) {
+        chunk = begin(range);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Thief: takes the last chunk.
+  bool takeBack(uint32_t& chunk) {
+    uint64_t range = range_.load();
+    while (begin(range) < end(range)) {
+      if (range_.compare_exchange_weak(range, pack(begin(range), end(range) - 1))) {
+        chunk = end(range) - 1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint32_t remaining() const {
+    const uint64_t range = range_.load(std::memory_order_relaxed);
+    return end(range) - begin(range);
+  }
+
+private:
+  static uint64_t pack(uint32_t begin, uint32_t end) {
+    return static_cast<uint64_t>(begin) << 32 | end;
+  }
+  static uint32_t begin(uint64_t range) { return range >> 32; }
+  static uint32_t end(uint64_t range) { return static_cast<uint32_t>(range); }
+
+  std::atomic<uint64_t> range_{0};
+};
+
+// Claims are checked the way the filter checks them, see CheckClaims().
+struct Options {
+  std::string issuer_;
+  std::vector<std::string> audiences_;
+  int64_t now_;
+};
+
+// One thread's results, merged at the end.
+struct WorkerResult {
+  std::array<uint64_t, VerifyStatusCount> counts_{};
+  uint64_t bytes_{};
+  uint64_t chunks_{};
+  uint64_t stolen_{};
+};
+
+VerifyStatus verifyToken(const JWKS& jwks, const Options& options, const std::string& token) {
+  Jwt jwt(token);
+  if (!jwt.IsParsed()) {
+    return JwtStatusToVerifyStatus(jwt.Status());
+  }
+
+  std::shared_ptr<evp_pkey> pkey = jwks.get(jwt.Kid());
+  if (!pkey) {
+    return VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS;
+  }
+  if (!jwt.VerifySignature(pkey)) {
+    return VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE;
+  }
+
+  return CheckClaims(jwt.Claims(), options.now_,
+                     options.issuer_.empty() ? nullptr : &options.issuer_,
+                     options.audiences_.empty() ? nullptr : &options.audiences_);
+}
+
+// Chunk boundaries, each moved forward to just past a newline so no line spans two chunks.
+std::vector<size_t> chunkBoundaries(const MappedFile& file) {
+  std::vector<size_t> boundaries{0};
+  size_t offset = 0;
+  while (offset < file.size()) {
+    offset = std::min(offset + ChunkSize, file.size());
+    const void* newline = memchr(file.data() + offset, '\n', file.size() - offset);
+    offset = newline ? static_cast<const char*>(newline) - file.data() + 1 : file.size();
+    boundaries.push_back(offset);
+  }
+  return boundaries;
+}
+
+void verifyChunk(const JWKS& jwks, const Options& options, const char* begin, const char* end,
+                 WorkerResult& result) {
+  std::string token;
+  while (begin < end) {
+    const char* newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+    const char* line_end = newline ? newline : end;
+    const char* token_end = line_end;
+    while (token_end > begin && (token_end[-1] == '\r' || token_end[-1] == ' ')) {
+      token_end--;
+    }
+    if (token_end > begin) {
+      token.assign(begin, token_end);
+      result.counts_[static_cast<size_t>(verifyToken(jwks, options, token))]++;
+    }
+    begin = line_end + 1;
+  }
+}
+
+int bulkVerify(int argc, char** argv) {
+  std::string jwks_path;
+  std::string tokens_path;
+  uint64_t threads = std::max<uint64_t>(std::thread::hardware_concurrency(), 1);
+  uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+  Options options;
+  bool usage = argc % 2 == 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--jwks") {
+      jwks_path = argv[i + 1];
+    } else if (flag == "--tokens") {
+      tokens_path = argv[i + 1];
+    } else if (flag == "--threads") {
+      usage |= !StringUtil::atoul(argv[i + 1], threads) || threads == 0;
+    } else if (flag == "--iss") {
+      options.issuer_ = argv[i + 1];
+    } else if (flag == "--aud") {
+      options.audiences_ = {argv[i + 1]};
+    } else if (flag == "--now") {
+      usage |= !StringUtil::atoul(argv[i + 1], now);
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || jwks_path.empty() || tokens_path.empty()) {
+    std::cerr << "usage: " << argv[0]
+              << " --jwks <jwks file> --tokens <token file> [--threads N] [--iss <issuer>]"
+                 " [--aud <audience>] [--now <unix seconds>]"
+              << std::endl;
+    return 1;
+  }
+  options.now_ = now;
+
+  JWKSSharedPtr jwks = ParseJwks(Filesystem::fileReadToEnd(jwks_path), false);
+  if (!jwks) {
+    std::cerr << "invalid jwks " << jwks_path << std::endl;
+    return 1;
+  }
+
+  const MappedFile file(tokens_path);
+  const std::vector<size_t> boundaries = chunkBoundaries(file);
+  const uint32_t chunks = boundaries.size() - 1;
+  threads = std::max<uint64_t>(std::min<uint64_t>(threads, chunks), 1);
+
+  std::vector<ChunkRange> ranges(threads);
+  for (uint64_t t = 0; t < threads; t++) {
+    ranges[t].reset(chunks * t / threads, chunks * (t + 1) / threads);
+  }
+  std::vector<WorkerResult> results(threads);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (uint64_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() -> void {
+      // Counted locally so threads don't share cache lines, published once at the end.
+      WorkerResult result;
+      uint32_t chunk;
+      while (true) {
+        bool stolen = false;
+        if (!ranges[t].takeFront(chunk)) {
+          // Steal from whoever has the most left, until nobody has anything.
+          size_t victim = t;
+          uint32_t most = 0;
+          for (size_t v = 0; v < ranges.size(); v++) {
+            if (ranges[v].remaining() > most) {
+              most = ranges[v].remaining();
+              victim = v;
+            }
+          }
+          if (most == 0) {
+            break;
+          }
+          if (!ranges[victim].takeBack(chunk)) {
+            continue;
+          }
+          stolen = true;
+        }
+
+        const size_t begin = boundaries[chunk];
+        const size_t end = boundaries[chunk + 1];
+        verifyChunk(*jwks, options, file.data() + begin, file.data() + end, result);
+        result.bytes_ += end - begin;
+        result.chunks_++;
+        result.stolen_ += stolen;
+      }
+      results[t] = result;
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  WorkerResult total;
+  for (const WorkerResult& result : results) {
+    for (size_t i = 0; i < VerifyStatusCount; i++) {
+      total.counts_[i] += result.counts_[i];
+    }
+    total.bytes_ += result.bytes_;
+    total.chunks_ += result.chunks_;
+    total.stolen_ += result.stolen_;
+  }
+  uint64_t tokens = 0;
+  for (uint64_t count : total.counts_) {
+    tokens += count;
+  }
+
+  std::cout << fmt::format("keys: {}  threads: {}  chunks: {} ({} stolen)", jwks->size(), threads,
+                           total.chunks_, total.stolen_)
+            << std::endl;
+  std::cout << fmt::format("verified: {} tokens ({:.1f} MiB) in {:.3f}s, {:.0f} tokens/s", tokens,
+                           total.bytes_ / 1048576.0, elapsed.count(),
+                           elapsed.count() > 0 ? tokens / elapsed.count() : 0)
+            << std::endl;
+  for (size_t i = 0; i < VerifyStatusCount; i++) {
+    if (total.counts_[i] > 0) {
+      std::cout << fmt::format("{:<36} {:>12}", VerifyStatusToString(static_cast<VerifyStatus>(i)),
+                               total.counts_[i])
+                << std::endl;
+    }
+  }
+  return total.counts_[static_cast<size_t>(VerifyStatus::JWT_VERIFY_SUCCESS)] == tokens ? 0 : 2;
+}
+
+} // namespace
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  try {
+    return Envoy::Http::Sft::bulkVerify(argc, argv);
+  } catch (const Envoy::EnvoyException& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,453 @@
+// Replays a capture trace (see capture.h) through SftJwtDecoderFilter in-process and reports
+// throughput and latency distributions.
+//
+//   sft_replay --trace <capture file> --config <filter config json> [--iterations N]
+//
+// The trace only holds hashes, so the replay synthesizes an equivalent workload: one P-256 key
+// per distinct kid, one ES256 token per distinct token (padded to its recorded size) and a token
+// crafted to fail the same way for each recorded rejection. The filter config is used as is, except that
+// its JWKS source is replaced by the generated keys and capture is turned off. The filter sees a
+// clock that follows the recorded request times, so runs are deterministic.
+
+#include "common/common/utility.h"
+#include "common/event/dispatcher_impl.h"
+#include "common/json/json_loader.h"
+#include "common/runtime/runtime_impl.h"
+#include "common/stats/stats_impl.h"
+#include "common/thread_local/thread_local_impl.h"
+
+#include "test/mocks/access_log/mocks.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "../capture.h"
+#include "../sft_filter.h"
+#include "../test/test_key.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+namespace {
+
+// Clock handed to the filter, moved to each record's capture time before it is replayed.
+class ReplayTimeSource : public SystemTimeSource {
+public:
+  SystemTime currentTime() override { return now_; }
+
+  SystemTime now_;
+};
+
+// A generated signing key standing in for one kid seen in the trace.
+struct ReplayKey {
+  ReplayKey(const std::string& kid) : kid_(kid) {}
+
+  // The public half as a jwk for the filter's static `keys`.
+  void writeJwk(rapidjson::Writer<rapidjson::StringBuffer>& writer) const {
+    writer.StartObject();
+    writer.Key("kty");
+    writer.String("EC");
+    writer.Key("crv");
+    writer.String("P-256");
+    writer.Key("alg");
+    writer.String("ES256");
+    writer.Key("kid");
+    writer.String(kid_.c_str());
+    writer.Key("x");
+    writer.String(Base64UrlEncode(key_.compact().x()).c_str());
+    writer.Key("y");
+    writer.String(Base64UrlEncode(key_.compact().y()).c_str());
+    writer.EndObject();
+  }
+
+  std::string sign(const std::string& signing_input) const { return key_.sign(signing_input); }
+
+  const std::string kid_;
+  const TestKey key_;
+};
+
+typedef std::unique_ptr<ReplayKey> ReplayKeyPtr;
+
+// What the filter should answer for a synthesized request. Some recorded outcomes can't be
+// reproduced from a trace: there is no upstream to refetch unknown kids from, revoked values are
+// only known by hash, session cookies are never sent back, shed tokens were never checked and
+// body digests aren't captured.
+VerifyStatus expectedStatus(VerifyStatus recorded) {
+  switch (recorded) {
+  case VerifyStatus::JWT_VERIFY_PENDING_JWKS_REFRESH:
+    return VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS;
+  case VerifyStatus::JWT_VERIFY_FAIL_REVOKED:
+  case VerifyStatus::SESSION_COOKIE_VALID:
+  case VerifyStatus::JWT_VERIFY_SHED:
+  case VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST:
+    return VerifyStatus::JWT_VERIFY_SUCCESS;
+  case VerifyStatus::JWT_VERIFY_FAIL_UNKNOWN:
+    return VerifyStatus::JWT_VERIFY_FAIL_MALFORMED;
+  default:
+    return recorded;
+  }
+}
+
+class TokenFactory {
+public:
+  TokenFactory(const SFTConfig& config, int64_t first_s, int64_t last_s)
+      : issuer_(config.allowed_issuer_),
+        audience_(config.allowed_audiences_.empty() ? "" : config.allowed_audiences_[0]),
+        first_s_(first_s), last_s_(last_s) {}
+
+  // An empty string means "send no token".
+  std::string make(VerifyStatus expected, const ReplayKey& key, uint32_t token_hash,
+                   size_t size) {
+    switch (expected) {
+    case VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT:
+    case VerifyStatus::WHITELISTED_PATH:
+      return "";
+    case VerifyStatus::JWT_VERIFY_FAIL_MALFORMED:
+      return pad("malformed.", size, 'x');
+    default:
+      break;
+    }
+
+    std::string kid = key.kid_;
+    std::string iss = issuer_;
+    std::string aud = audience_;
+    int64_t exp = last_s_ + 3600;
+    int64_t nbf = first_s_ - 3600;
+    if (expected == VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS) {
+      kid = "replay-unknown-kid";
+    } else if (expected == VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH) {
+      iss = "replay-unknown-issuer";
+    } else if (expected == VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH) {
+      aud = "replay-unknown-audience";
+    } else if (expected == VerifyStatus::JWT_VERIFY_FAIL_EXPIRED) {
+      exp = first_s_ - 1;
+    } else if (expected == VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE) {
+      nbf = last_s_ + 3600;
+    }
+
+    const std::string header =
+        Base64UrlEncode(fmt::format(R"({{"alg":"ES256","typ":"JWT","kid":"{}"}})", kid));
+    std::string claims = fmt::format(
+        R"({{"iss":"{}","aud":"{}","sub":"replay-{:08x}","jti":"{:08x}","nbf":{},"exp":{})",
+        iss, aud, token_hash, token_hash, nbf, exp);
+
+    // Grow the payload so the whole token ends up close to the recorded size. The signature and
+    // header don't depend on the payload, so one pass is enough.
+    const size_t fixed = header.size() + 2 + 86;
+    const size_t unpadded = Base64UrlEncode(claims + "}").size();
+    if (fixed + unpadded < size) {
+      const size_t extra = (size - fixed - unpadded) * 3 / 4;
+      claims += fmt::format(R"(,"pad":"{}")", std::string(extra > 9 ? extra - 9 : 0, 'x'));
+    }
+    claims += "}";
+
+    const std::string signing_input = header + "." + Base64UrlEncode(claims);
+    std::string signature = key.sign(signing_input);
+    if (expected == VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE) {
+      signature[signature.size() / 2] ^= 0x01;
+    }
+    return signing_input + "." + Base64UrlEncode(signature);
+  }
+
+private:
+  static std::string pad(const std::string& prefix, size_t size, char c) {
+    return prefix + std::string(size > prefix.size() ? size - prefix.size() : 0, c);
+  }
+
+  const std::string issuer_;
+  const std::string audience_;
+  const int64_t first_s_;
+  const int64_t last_s_;
+};
+
+struct Request {
+  std::string path_;
+  std::string token_;
+  VerifyStatus recorded_;
+  VerifyStatus expected_;
+  SystemTime time_;
+};
+
+// A record and the trace it was read from. Hashes are keyed per trace (see capture.h), so equal
+// hashes from different traces are unrelated.
+struct TraceRecord {
+  uint32_t trace_;
+  CaptureRecord record_;
+};
+
+std::vector<TraceRecord> readTrace(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw EnvoyException(fmt::format("unable to read trace '{}'", path));
+  }
+
+  std::vector<TraceRecord> records;
+  uint32_t trace = 0;
+  char frame[CaptureFrameSize];
+  while (file.read(frame, sizeof(frame))) {
+    CaptureRecord record;
+    if (!DecodeCaptureRecord(frame, record)) {
+      trace++;
+    } else if (record.status_ < VerifyStatusCount) {
+      records.push_back({trace, record});
+    }
+  }
+  return records;
+}
+
+// The user's filter config with `keys` replaced by the generated keys, and every option that would
+// reach outside the process removed. Batching and load shedding are removed too: requests are
+// replayed one at a time and never wait on the dispatcher, and all of them are verified. So is
+// body binding, replayed requests have no body.
+std::string replayConfig(const std::string& path, const std::vector<ReplayKeyPtr>& keys) {
+  std::ifstream file(path);
+  if (!file) {
+    throw EnvoyException(fmt::format("unable to read config '{}'", path));
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+
+  rapidjson::Document original;
+  original.Parse(contents.str().c_str());
+  if (original.HasParseError() || !original.IsObject()) {
+    throw EnvoyException(fmt::format("invalid config '{}'", path));
+  }
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  for (auto it = original.MemberBegin(); it != original.MemberEnd(); ++it) {
+    const std::string name = it->name.GetString();
+    if (name == "keys" || name == "capture_path" || name == "verify_batch" ||
+        name == "body_digest_claim" || name.find("verified_cache_") == 0 ||
+        name.find("shed_") == 0 || name.find("jwks_api_") == 0 ||
+        name.find("denylist_api_") == 0) {
+      continue;
+    }
+    writer.Key(name.c_str());
+    it->value.Accept(writer);
+  }
+  writer.Key("keys");
+  writer.StartArray();
+  for (const ReplayKeyPtr& key : keys) {
+    key->writeJwk(writer);
+  }
+  writer.EndArray();
+  writer.EndObject();
+  return buffer.GetString();
+}
+
+double percentile(const std::vector<uint64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+  return sorted[index] / 1000.0;
+}
+
+void printDistribution(const std::string& name, std::vector<uint64_t>& ns) {
+  std::sort(ns.begin(), ns.end());
+  std::cout << fmt::format("{:<10} p50 {:>9.1f}us  p90 {:>9.1f}us  p99 {:>9.1f}us  "
+                           "p99.9 {:>9.1f}us  max {:>9.1f}us",
+                           name, percentile(ns, 0.5), percentile(ns, 0.9), percentile(ns, 0.99),
+                           percentile(ns, 0.999), ns.empty() ? 0 : ns.back() / 1000.0)
+            << std::endl;
+}
+
+int replay(int argc, char** argv) {
+  std::string trace_path;
+  std::string config_path;
+  uint64_t iterations = 1;
+  bool usage = argc % 2 == 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string flag = argv[i];
+    if (flag == "--trace") {
+      trace_path = argv[i + 1];
+    } else if (flag == "--config") {
+      config_path = argv[i + 1];
+    } else if (flag == "--iterations") {
+      usage |= !StringUtil::atoul(argv[i + 1], iterations) || iterations == 0;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || trace_path.empty() || config_path.empty()) {
+    std::cerr << "usage: " << argv[0]
+              << " --trace <capture file> --config <filter config json> [--iterations N]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::vector<TraceRecord> records = readTrace(trace_path);
+  if (records.empty()) {
+    std::cerr << "no records in " << trace_path << std::endl;
+    return 1;
+  }
+
+  // One key per distinct kid, in order of first use.
+  std::vector<ReplayKeyPtr> keys;
+  std::map<std::pair<uint32_t, uint32_t>, size_t> key_index;
+  for (const TraceRecord& traced : records) {
+    const CaptureRecord& record = traced.record_;
+    if (key_index.emplace(std::make_pair(traced.trace_, record.kid_hash_), keys.size()).second) {
+      keys.emplace_back(
+          new ReplayKey(fmt::format("replay-{}-{:08x}", traced.trace_, record.kid_hash_)));
+    }
+  }
+
+  Event::DispatcherImpl dispatcher;
+  ThreadLocal::InstanceImpl tls;
+  tls.registerThread(dispatcher, true);
+  Stats::IsolatedStoreImpl store;
+  Runtime::RandomGeneratorImpl random;
+  testing::NiceMock<Upstream::MockClusterManager> cm;
+  testing::NiceMock<AccessLog::MockAccessLogManager> log_manager;
+  ReplayTimeSource clock;
+
+  Json::ObjectSharedPtr json = Json::Factory::loadFromString(replayConfig(config_path, keys));
+  SFTConfigSharedPtr config = std::make_shared<SFTConfig>(
+      "replay", *json, std::make_shared<JwksProviderRegistry>(store), tls, cm, dispatcher, store,
+      random, log_manager, clock);
+
+  // Synthesize every request up front so token minting stays out of the measurements. Workers
+  // append to the trace independently, so it is only roughly in time order.
+  uint64_t first_us = UINT64_MAX;
+  uint64_t last_us = 0;
+  for (const TraceRecord& traced : records) {
+    first_us = std::min(first_us, traced.record_.time_us_);
+    last_us = std::max(last_us, traced.record_.time_us_);
+  }
+  TokenFactory tokens(*config, first_us / 1000000, last_us / 1000000);
+  std::map<std::tuple<uint32_t, uint32_t, VerifyStatus>, std::string> minted;
+  std::vector<Request> requests;
+  std::vector<uint64_t> recorded_ns;
+  for (const TraceRecord& traced : records) {
+    const CaptureRecord& record = traced.record_;
+    Request request;
+    request.recorded_ = static_cast<VerifyStatus>(record.status_);
+    request.expected_ = expectedStatus(request.recorded_);
+    request.time_ = SystemTime(std::chrono::microseconds(record.time_us_));
+    request.path_ = request.expected_ == VerifyStatus::WHITELISTED_PATH &&
+                            !config->whitelisted_paths_.empty()
+                        ? config->whitelisted_paths_[0]
+                        : fmt::format("/replay/{}/{:08x}", traced.trace_, record.path_hash_);
+
+    const auto minted_key = std::make_tuple(traced.trace_, record.token_hash_, request.expected_);
+    auto it = minted.find(minted_key);
+    if (it == minted.end()) {
+      const ReplayKey& key = *keys[key_index[std::make_pair(traced.trace_, record.kid_hash_)]];
+      const std::string token =
+          tokens.make(request.expected_, key, record.token_hash_, record.token_size_);
+      it = minted.emplace(minted_key, token).first;
+    }
+    request.token_ = it->second;
+    requests.push_back(request);
+    recorded_ns.push_back(record.verify_ns_);
+  }
+
+  testing::NiceMock<MockStreamDecoderFilterCallbacks> callbacks;
+  std::vector<uint64_t> replayed_ns;
+  replayed_ns.reserve(requests.size() * iterations);
+  std::map<VerifyStatus, uint64_t> replayed_counts;
+  uint64_t mismatches = 0;
+  std::chrono::nanoseconds total{};
+
+  for (uint64_t iteration = 0; iteration < iterations; iteration++) {
+    for (const Request& request : requests) {
+      TestHeaderMapImpl headers{
+          {":method", "GET"}, {":path", request.path_}, {":authority", "replay"}};
+      if (!request.token_.empty()) {
+        headers.addCopy(config->headerKey, request.token_);
+      }
+      clock.now_ = request.time_;
+
+      std::array<uint64_t, VerifyStatusCount> before;
+      for (size_t i = 0; i < VerifyStatusCount; i++) {
+        before[i] = config->verifyCount(static_cast<VerifyStatus>(i));
+      }
+
+      SftJwtDecoderFilter filter(config);
+      filter.setDecoderFilterCallbacks(callbacks);
+      const auto start = std::chrono::steady_clock::now();
+      filter.decodeHeaders(headers, true);
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      filter.onDestroy();
+
+      total += elapsed;
+      replayed_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      for (size_t i = 0; i < VerifyStatusCount; i++) {
+        if (config->verifyCount(static_cast<VerifyStatus>(i)) != before[i]) {
+          replayed_counts[static_cast<VerifyStatus>(i)]++;
+          mismatches += static_cast<VerifyStatus>(i) != request.expected_;
+        }
+      }
+    }
+  }
+
+  const uint64_t replayed = replayed_ns.size();
+  std::cout << fmt::format("records: {}  keys: {}  distinct tokens: {}  iterations: {}",
+                           records.size(), keys.size(), minted.size(), iterations)
+            << std::endl;
+  std::cout << fmt::format("replayed: {} requests in {:.3f}s of filter time, {:.0f} req/s",
+                           replayed, total.count() / 1e9,
+                           total.count() > 0 ? replayed / (total.count() / 1e9) : 0)
+            << std::endl;
+  printDistribution("replayed", replayed_ns);
+  printDistribution("recorded", recorded_ns);
+
+  std::map<VerifyStatus, uint64_t> recorded_counts;
+  for (const Request& request : requests) {
+    recorded_counts[request.recorded_]++;
+  }
+  std::cout << fmt::format("{:<36} {:>12} {:>12}", "status", "recorded", "replayed") << std::endl;
+  for (size_t i = 0; i < VerifyStatusCount; i++) {
+    const VerifyStatus status = static_cast<VerifyStatus>(i);
+    if (recorded_counts[status] == 0 && replayed_counts[status] == 0) {
+      continue;
+    }
+    std::cout << fmt::format("{:<36} {:>12} {:>12}", VerifyStatusToString(status),
+                             recorded_counts[status] * iterations, replayed_counts[status])
+              << std::endl;
+  }
+  std::cout << fmt::format("unexpected outcomes: {}", mismatches) << std::endl;
+  std::cout << fmt::format(
+                   "key cache: {} hits, {} misses",
+                   store.counter("scaleft.accessfabric.jwks_key_cache_hit").value(),
+                   store.counter("scaleft.accessfabric.jwks_key_cache_miss").value())
+            << std::endl;
+
+  config.reset();
+  tls.shutdownGlobalThreading();
+  tls.shutdownThread();
+  return 0;
+}
+
+} // namespace
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  try {
+    return Envoy::Http::Sft::replay(argc, argv);
+  } catch (const Envoy::EnvoyException& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
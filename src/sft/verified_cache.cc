@@ -0,0 +1,223 @@
+#include "verified_cache.h"
+
+#include "common/common/utility.h"
+#include "envoy/common/exception.h"
+#include "openssl/sha.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+namespace {
+
+// "SFTVC" and the slot layout version, bump it whenever Header or Slot change.
+const uint64_t Magic = 0x5346545643000001;
+
+// How long a region another process just created is given to be sized and set up.
+const std::chrono::milliseconds SetUpWait(1000);
+const std::chrono::milliseconds SetUpPoll(1);
+
+// Polls `ready` until it returns true or SetUpWait has passed, returns its last answer.
+template <class Ready> bool waitFor(Ready ready) {
+  const MonotonicTime deadline = ProdMonotonicTimeSource::instance_.currentTime() + SetUpWait;
+  while (!ready()) {
+    if (ProdMonotonicTimeSource::instance_.currentTime() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(SetUpPoll);
+  }
+  return true;
+}
+
+} // namespace
+
+VerifiedCache::VerifiedCache(const Json::Object& config)
+    : name_(config.getString("verified_cache_name")),
+      max_age_s_(config.getInteger("verified_cache_max_age_s", 300)) {
+  const int64_t capacity = config.getInteger("verified_cache_size", 65536);
+  if (name_.size() < 2 || name_[0] != '/' || name_.find('/', 1) != std::string::npos) {
+    throw EnvoyException(
+        fmt::format("invalid 'verified_cache_name' '{}' in sft filter config", name_));
+  }
+  if (capacity <= 0 || capacity > (1 << 24)) {
+    throw EnvoyException("invalid 'verified_cache_size' in sft filter config");
+  }
+  if (max_age_s_ <= 0) {
+    throw EnvoyException("invalid 'verified_cache_max_age_s' in sft filter config");
+  }
+
+  size_t slots = ProbeWindow;
+  while (slots < static_cast<size_t>(capacity)) {
+    slots <<= 1;
+  }
+  mask_ = slots - 1;
+  size_ = sizeof(Header) + slots * sizeof(Slot);
+
+  if (!map()) {
+    // Left by a build with another slot layout, configured with another size, or never set up by
+    // a process that died creating it. Processes still using it keep their mapping, this one
+    // starts a fresh region under the same name.
+    ::shm_unlink(name_.c_str());
+    if (!map()) {
+      throw EnvoyException(fmt::format("unable to set up verified_cache_name '{}'", name_));
+    }
+  }
+}
+
+VerifiedCache::~VerifiedCache() { unmap(); }
+
+bool VerifiedCache::configured(const Json::Object& config) {
+  return config.hasObject("verified_cache_name");
+}
+
+bool VerifiedCache::map() {
+  bool created = true;
+  int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = ::shm_open(name_.c_str(), O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    throw EnvoyException(
+        fmt::format("unable to open verified_cache_name '{}': {}", name_, strerror(errno)));
+  }
+
+  // ftruncate zero-fills, and a zeroed slot is an empty one.
+  struct stat st;
+  bool usable;
+  if (created) {
+    usable = ::ftruncate(fd, size_) == 0;
+  } else {
+    // Another process may still be creating the region, it is sized in one step.
+    waitFor([fd, &st]() -> bool { return ::fstat(fd, &st) != 0 || st.st_size != 0; });
+    usable = ::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size_;
+  }
+  if (usable) {
+    region_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    usable = region_ != MAP_FAILED;
+    if (!usable) {
+      region_ = nullptr;
+    }
+  }
+  ::close(fd);
+  if (!usable) {
+    return false;
+  }
+
+  Header* header = static_cast<Header*>(region_);
+  slots_ = reinterpret_cast<Slot*>(header + 1);
+  if (created) {
+    new (header) Header();
+    header->capacity_ = capacity();
+    header->magic_.store(Magic, std::memory_order_release);
+    return true;
+  }
+  // Its creator stores the magic last.
+  waitFor([header]() -> bool { return header->magic_.load(std::memory_order_acquire) != 0; });
+  if (header->magic_.load(std::memory_order_acquire) != Magic ||
+      header->capacity_ != capacity()) {
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+void VerifiedCache::unmap() {
+  if (region_) {
+    ::munmap(region_, size_);
+    region_ = nullptr;
+    slots_ = nullptr;
+  }
+}
+
+VerifiedCache::Key VerifiedCache::key(const char* token, size_t size, uint64_t key_fingerprint) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const uint8_t*>(token), size, digest);
+  Key key;
+  memcpy(key.digest_, digest, sizeof(key.digest_));
+  key.key_ = key_fingerprint;
+  return key;
+}
+
+bool VerifiedCache::lookup(const Key& key, int64_t now, bool& valid) const {
+  for (size_t i = 0; i < ProbeWindow; i++) {
+    const Slot& slot = slots_[(key.digest_[0] + i) & mask_];
+    const uint64_t sequence = slot.sequence_.load(std::memory_order_acquire);
+    const uint64_t digest0 = slot.digest_[0].load(std::memory_order_relaxed);
+    const uint64_t digest1 = slot.digest_[1].load(std::memory_order_relaxed);
+    const uint64_t key_fingerprint = slot.key_.load(std::memory_order_relaxed);
+    const uint64_t verdict = slot.verdict_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((sequence & 1) || slot.sequence_.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    // Verdicts are only ever replaced, so a key is never past the first empty slot.
+    if (verdict == 0) {
+      return false;
+    }
+    if (digest0 == key.digest_[0] && digest1 == key.digest_[1] && key_fingerprint == key.key_) {
+      if (static_cast<int64_t>(verdict >> 1) < now) {
+        return false;
+      }
+      valid = verdict & 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+void VerifiedCache::insert(const Key& key, int64_t exp, int64_t now, bool valid) {
+  int64_t expires = now + max_age_s_;
+  if (exp > 0 && exp < expires) {
+    expires = exp;
+  }
+  if (expires < now) {
+    return;
+  }
+
+  Slot* victim = nullptr;
+  uint64_t victim_expires = UINT64_MAX;
+  for (size_t i = 0; i < ProbeWindow; i++) {
+    Slot& slot = slots_[(key.digest_[0] + i) & mask_];
+    const uint64_t verdict = slot.verdict_.load(std::memory_order_relaxed);
+    if (verdict == 0 || (slot.digest_[0].load(std::memory_order_relaxed) == key.digest_[0] &&
+                         slot.digest_[1].load(std::memory_order_relaxed) == key.digest_[1] &&
+                         slot.key_.load(std::memory_order_relaxed) == key.key_)) {
+      victim = &slot;
+      break;
+    }
+    if ((verdict >> 1) < victim_expires) {
+      victim = &slot;
+      victim_expires = verdict >> 1;
+    }
+  }
+
+  uint64_t sequence = victim->sequence_.load(std::memory_order_relaxed);
+  if ((sequence & 1) || !victim->sequence_.compare_exchange_strong(sequence, sequence + 1,
+                                                                   std::memory_order_relaxed)) {
+    // Another writer has the slot, the verdict is dropped rather than waited on.
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  victim->digest_[0].store(key.digest_[0], std::memory_order_relaxed);
+  victim->digest_[1].store(key.digest_[1], std::memory_order_relaxed);
+  victim->key_.store(key.key_, std::memory_order_relaxed);
+  victim->verdict_.store((static_cast<uint64_t>(expires) << 1) | valid,
+                         std::memory_order_relaxed);
+  victim->sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
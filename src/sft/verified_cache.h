@@ -0,0 +1,92 @@
+#pragma once
+
+#include "envoy/json/json_object.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Signature verdicts of recently seen tokens (`verified_cache_name`, `verified_cache_size`,
+// `verified_cache_max_age_s`), in a fixed-size table in POSIX shared memory. The process taking
+// over in a hot restart maps the same region, so it starts with the old process's verdicts instead
+// of re-verifying every active token at once, and both keep reading and filling it while the old
+// one drains.
+//
+// A verdict is keyed on 128 bits of the token's SHA-256 and on the fingerprint of the key that
+// checked it (evp_pkey::fingerprint_), so a kid whose key is rotated misses instead of reusing a
+// verdict made with the old key. Only the signature is cached: claims, revocation and policy are
+// still checked on every request. Verdicts expire with the token, or after the max age.
+//
+// Slots are updated under a per-slot sequence counter (a seqlock). Readers never wait: a slot that
+// is being written reads as a miss. Writers never wait either: a writer that finds its slot taken
+// by another writer, in this process or another one, drops its verdict. A key lives in one of the
+// ProbeWindow slots following its hash, and replaces the one expiring first when they are all
+// taken.
+class VerifiedCache {
+public:
+  static const size_t ProbeWindow = 4;
+
+  struct Key {
+    uint64_t digest_[2];
+    uint64_t key_;
+  };
+
+  // Maps the region, creating it if it doesn't exist or was created with another size.
+  VerifiedCache(const Json::Object& config);
+  ~VerifiedCache();
+
+  // True if the filter config asks for the cache.
+  static bool configured(const Json::Object& config);
+
+  static Key key(const char* token, size_t size, uint64_t key_fingerprint);
+
+  // Any thread. Returns true and sets `valid` if `key` has a verdict that hasn't expired by `now`
+  // (seconds since the epoch).
+  bool lookup(const Key& key, int64_t now, bool& valid) const;
+  // Any thread. Records `key`'s verdict until the token's `exp` (0 if it has none), at most
+  // verified_cache_max_age_s from `now`.
+  void insert(const Key& key, int64_t exp, int64_t now, bool valid);
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Header {
+    std::atomic<uint64_t> magic_; // Stored last, once the region is set up.
+    uint64_t capacity_;
+  };
+
+  struct Slot {
+    std::atomic<uint64_t> sequence_; // Odd while a writer updates the slot.
+    std::atomic<uint64_t> digest_[2];
+    std::atomic<uint64_t> key_;
+    // Expiry in seconds since the epoch, shifted left by one, with the low bit set if the
+    // signature was valid. 0 for an empty slot.
+    std::atomic<uint64_t> verdict_;
+  };
+
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory slots need lock-free atomics");
+
+  // Maps the region, creating it if needed. Returns false if it exists but can't be used as is.
+  // One another process is creating is waited on until it is set up.
+  bool map();
+  void unmap();
+
+  const std::string name_;
+  const int64_t max_age_s_;
+  size_t mask_;
+  size_t size_{};
+  void* region_{};
+  Slot* slots_{};
+};
+
+typedef std::unique_ptr<VerifiedCache> VerifiedCachePtr;
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
@@ -0,0 +1,34 @@
+#include "verify_status.h"
+
+#include <map>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+std::string VerifyStatusToString(VerifyStatus status) {
+  static std::map<VerifyStatus, std::string> table = {
+      {VerifyStatus::WHITELISTED_PATH, "WHITELISTED_PATH"},
+      {VerifyStatus::JWT_VERIFY_SUCCESS, "JWT_VERIFY_SUCCESS"},
+      {VerifyStatus::SESSION_COOKIE_VALID, "SESSION_COOKIE_VALID"},
+      {VerifyStatus::JWT_VERIFY_FAIL_UNKNOWN, "JWT_VERIFY_FAIL_UNKNOWN"},
+      {VerifyStatus::JWT_VERIFY_FAIL_NOT_PRESENT, "JWT_VERIFY_FAIL_NOT_PRESENT"},
+      {VerifyStatus::JWT_VERIFY_FAIL_EXPIRED, "JWT_VERIFY_FAIL_EXPIRED"},
+      {VerifyStatus::JWT_VERIFY_FAIL_NOT_BEFORE, "JWT_VERIFY_FAIL_NOT_BEFORE"},
+      {VerifyStatus::JWT_VERIFY_FAIL_INVALID_SIGNATURE, "JWT_VERIFY_FAIL_INVALID_SIGNATURE"},
+      {VerifyStatus::JWT_VERIFY_FAIL_NO_VALIDATORS, "JWT_VERIFY_FAIL_NO_VALIDATORS"},
+      {VerifyStatus::JWT_VERIFY_FAIL_MALFORMED, "JWT_VERIFY_FAIL_MALFORMED"},
+      {VerifyStatus::JWT_VERIFY_FAIL_ISSUER_MISMATCH, "JWT_VERIFY_FAIL_ISSUER_MISMATCH"},
+      {VerifyStatus::JWT_VERIFY_FAIL_AUDIENCE_MISMATCH, "JWT_VERIFY_FAIL_AUDIENCE_MISMATCH"},
+      {VerifyStatus::JWT_VERIFY_FAIL_REVOKED, "JWT_VERIFY_FAIL_REVOKED"},
+      {VerifyStatus::JWT_VERIFY_PENDING_JWKS_REFRESH, "JWT_VERIFY_PENDING_JWKS_REFRESH"},
+      {VerifyStatus::JWT_VERIFY_PENDING_SIGNATURE, "JWT_VERIFY_PENDING_SIGNATURE"},
+      {VerifyStatus::JWT_VERIFY_SHED, "JWT_VERIFY_SHED"},
+      {VerifyStatus::JWT_VERIFY_FAIL_BODY_DIGEST, "JWT_VERIFY_FAIL_BODY_DIGEST"},
+      {VerifyStatus::OPTIONAL_NOT_PRESENT, "OPTIONAL_NOT_PRESENT"}};
+  return table[status];
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy
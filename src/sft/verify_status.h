@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+namespace Envoy {
+namespace Http {
+namespace Sft {
+
+// Recorded by value in capture traces (see CaptureRecord), so new statuses go at the end.
+enum class VerifyStatus {
+  WHITELISTED_PATH,
+  JWT_VERIFY_SUCCESS,
+  SESSION_COOKIE_VALID,
+  JWT_VERIFY_FAIL_UNKNOWN,
+  JWT_VERIFY_FAIL_NOT_PRESENT,
+  JWT_VERIFY_FAIL_EXPIRED,
+  JWT_VERIFY_FAIL_NOT_BEFORE,
+  JWT_VERIFY_FAIL_INVALID_SIGNATURE,
+  JWT_VERIFY_FAIL_NO_VALIDATORS,
+  JWT_VERIFY_FAIL_MALFORMED,
+  JWT_VERIFY_FAIL_ISSUER_MISMATCH,
+  JWT_VERIFY_FAIL_AUDIENCE_MISMATCH,
+  JWT_VERIFY_FAIL_REVOKED,
+  JWT_VERIFY_PENDING_JWKS_REFRESH,
+  JWT_VERIFY_PENDING_SIGNATURE,
+  JWT_VERIFY_SHED,
+  JWT_VERIFY_FAIL_BODY_DIGEST,
+  OPTIONAL_NOT_PRESENT
+};
+
+// Number of VerifyStatus values, for tables indexed by status.
+const size_t VerifyStatusCount = static_cast<size_t>(VerifyStatus::OPTIONAL_NOT_PRESENT) + 1;
+
+std::string VerifyStatusToString(VerifyStatus status);
+
+// True for the outcomes that let the request through.
+inline bool VerifyStatusAllowed(VerifyStatus status) {
+  return status == VerifyStatus::WHITELISTED_PATH || status == VerifyStatus::JWT_VERIFY_SUCCESS ||
+         status == VerifyStatus::SESSION_COOKIE_VALID ||
+         status == VerifyStatus::OPTIONAL_NOT_PRESENT;
+}
+
+} // namespace Sft
+} // namespace Http
+} // namespace Envoy